@@ -0,0 +1,104 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelTerrainActor.h"
+#include "VoxelAccessor.h"
+
+// Times a pass of reads through a read function. Returns nanoseconds per read.
+template<typename ReadFunctionType>
+static double TimeVoxelReads(const TArray<FIntVector>& Positions, ReadFunctionType ReadVoxel, uint32& OutChecksum)
+{
+	uint32 Checksum = 0;
+
+	const double StartTime = FPlatformTime::Seconds();
+	for (const FIntVector& Position : Positions)
+	{
+		Checksum += ReadVoxel(Position).getMaterial();
+	}
+	const double EndTime = FPlatformTime::Seconds();
+
+	// Use the reads so they can't be optimised away
+	OutChecksum = Checksum;
+	return (EndTime - StartTime) * 1e9 / FMath::Max(Positions.Num(), 1);
+}
+
+// Compares PagedVolume::getVoxel with FVoxelAccessor on random and coherent reads of chunks that are already paged in
+static void BenchmarkVoxelAccess(AVoxelTerrainActor& Terrain, int32 NumReads)
+{
+	FScopeLock Lock(&Terrain.GetVolumeLock());
+
+	FVoxelVolume* Volume = Terrain.GetVolume();
+	const FVoxelChunkIndex& ChunkIndex = Terrain.GetPager()->GetChunkIndex();
+
+	TArray<FIntVector> Chunks;
+	ChunkIndex.ForEach([&Chunks](const FIntVector& ChunkCoords, const FVoxelChunkIndex::FEntry& Entry)
+	{
+		Chunks.Add(ChunkCoords);
+	});
+
+	if (Chunks.Num() == 0)
+	{
+		UE_LOG(LogVoxelTerrain, Display, TEXT("%s has no chunks paged in yet"), *Terrain.GetName());
+		return;
+	}
+
+	// Work out the positions up front so that generating them isn't part of the timings
+	FRandomStream Random(0x5eed);
+
+	// Random: anywhere in any paged in chunk
+	TArray<FIntVector> RandomPositions;
+	RandomPositions.Reserve(NumReads);
+	for (int32 Read = 0; Read < NumReads; Read++)
+	{
+		const FIntVector Chunk = Chunks[Random.RandHelper(Chunks.Num())];
+		RandomPositions.Add(Chunk * VOXEL_CHUNK_SIZE + FIntVector(Random.RandHelper(VOXEL_CHUNK_SIZE), Random.RandHelper(VOXEL_CHUNK_SIZE), Random.RandHelper(VOXEL_CHUNK_SIZE)));
+	}
+
+	// Coherent: a random walk one voxel at a time, like a trace or a flood fill. Steps that would leave the paged in chunks are taken back.
+	TArray<FIntVector> CoherentPositions;
+	CoherentPositions.Reserve(NumReads);
+	FIntVector Position = Chunks[0] * VOXEL_CHUNK_SIZE;
+	for (int32 Read = 0; Read < NumReads; Read++)
+	{
+		FIntVector Step = FIntVector::ZeroValue;
+		Step[Random.RandHelper(3)] = Random.RandHelper(2) * 2 - 1;
+
+		const FIntVector Next = Position + Step;
+		if (ChunkIndex.Contains(GetVoxelChunkCoords(Next.X, Next.Y, Next.Z)))
+		{
+			Position = Next;
+		}
+
+		CoherentPositions.Add(Position);
+	}
+
+	FVoxelAccessor Accessor(Volume, ChunkIndex);
+	auto ReadThroughVolume = [Volume](const FIntVector& At) { return Volume->getVoxel(At.X, At.Y, At.Z); };
+	auto ReadThroughAccessor = [&Accessor](const FIntVector& At) { return Accessor.GetVoxel(At.X, At.Y, At.Z); };
+
+	uint32 VolumeChecksum = 0;
+	uint32 AccessorChecksum = 0;
+
+	const double RandomVolumeTime = TimeVoxelReads(RandomPositions, ReadThroughVolume, VolumeChecksum);
+	const double RandomAccessorTime = TimeVoxelReads(RandomPositions, ReadThroughAccessor, AccessorChecksum);
+	UE_LOG(LogVoxelTerrain, Display, TEXT("Random reads:   getVoxel %.1f ns, accessor %.1f ns (%d chunks, checksums %u/%u)"), RandomVolumeTime, RandomAccessorTime, Chunks.Num(), VolumeChecksum, AccessorChecksum);
+
+	const double CoherentVolumeTime = TimeVoxelReads(CoherentPositions, ReadThroughVolume, VolumeChecksum);
+	const double CoherentAccessorTime = TimeVoxelReads(CoherentPositions, ReadThroughAccessor, AccessorChecksum);
+	UE_LOG(LogVoxelTerrain, Display, TEXT("Coherent reads: getVoxel %.1f ns, accessor %.1f ns (%d chunks, checksums %u/%u)"), CoherentVolumeTime, CoherentAccessorTime, Chunks.Num(), VolumeChecksum, AccessorChecksum);
+}
+
+static void BenchmarkVoxelAccessCommand(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 NumReads = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1000000;
+
+	for (TActorIterator<AVoxelTerrainActor> It(World); It; ++It)
+	{
+		BenchmarkVoxelAccess(**It, NumReads);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GBenchmarkVoxelAccessCommand(
+	TEXT("VoxelTerrain.BenchmarkAccess"),
+	TEXT("Times random and coherent voxel reads through PagedVolume::getVoxel and FVoxelAccessor. Usage: VoxelTerrain.BenchmarkAccess [NumReads]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkVoxelAccessCommand));
@@ -0,0 +1,21 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelAccessor.h"
+
+const FVoxelChunkIndex::FEntry& FVoxelAccessor::FindEntry(const FIntVector& ChunkCoords)
+{
+	const FVoxelChunkIndex::FEntry* Entry = ChunkIndex.FindEntry(ChunkCoords);
+	if (Entry == nullptr)
+	{
+		// Going through the volume pages the chunk in, which adds it to the index. Paging in can page other chunks out,
+		// but the only chunk we hold on to is the one we're about to replace.
+		Volume->getVoxel(ChunkCoords.X * VOXEL_CHUNK_SIZE, ChunkCoords.Y * VOXEL_CHUNK_SIZE, ChunkCoords.Z * VOXEL_CHUNK_SIZE);
+		Entry = ChunkIndex.FindEntry(ChunkCoords);
+		check(Entry != nullptr);
+	}
+
+	LastChunkCoords = ChunkCoords;
+	LastEntry = *Entry;
+	return LastEntry;
+}
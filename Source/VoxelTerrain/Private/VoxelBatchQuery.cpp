@@ -0,0 +1,52 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelBatchQuery.h"
+#include "VoxelChunkIndex.h"
+
+void FVoxelBatchQuery::Run(const FVoxelChunkIndex& ChunkIndex, const FIntVector* VoxelCoords, int32 NumQueries, FVoxelQueryResult* OutResults)
+{
+	// Group the queries by chunk
+	Entries.Reset();
+	Entries.AddUninitialized(NumQueries);
+	for (int32 QueryIndex = 0; QueryIndex < NumQueries; QueryIndex++)
+	{
+		const FIntVector& Coords = VoxelCoords[QueryIndex];
+		Entries[QueryIndex].ChunkKey = FVoxelChunkIndex::PackCoords(GetVoxelChunkCoords(Coords.X, Coords.Y, Coords.Z));
+		Entries[QueryIndex].QueryIndex = QueryIndex;
+	}
+
+	Entries.Sort([](const FEntry& A, const FEntry& B)
+	{
+		return A.ChunkKey < B.ChunkKey;
+	});
+
+	const int32 ChunkMask = VOXEL_CHUNK_SIZE - 1;
+
+	// Answer the queries one chunk at a time
+	for (int32 RunStart = 0; RunStart < NumQueries;)
+	{
+		const uint64 ChunkKey = Entries[RunStart].ChunkKey;
+		FVoxelVolume::Chunk* Chunk = ChunkIndex.Find(FVoxelChunkIndex::UnpackCoords(ChunkKey));
+
+		int32 RunEnd = RunStart;
+		for (; RunEnd < NumQueries && Entries[RunEnd].ChunkKey == ChunkKey; RunEnd++)
+		{
+			FVoxelQueryResult& Result = OutResults[Entries[RunEnd].QueryIndex];
+			if (Chunk == nullptr)
+			{
+				Result = FVoxelQueryResult();
+				continue;
+			}
+
+			const FIntVector& Coords = VoxelCoords[Entries[RunEnd].QueryIndex];
+			const PolyVox::MaterialDensityPair44 Voxel = Chunk->getVoxel(Coords.X & ChunkMask, Coords.Y & ChunkMask, Coords.Z & ChunkMask);
+
+			Result.Material = Voxel.getMaterial();
+			Result.Density = Voxel.getDensity();
+			Result.bLoaded = true;
+		}
+
+		RunStart = RunEnd;
+	}
+}
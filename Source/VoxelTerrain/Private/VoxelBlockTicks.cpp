@@ -0,0 +1,408 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelBlockTicks.h"
+#include "VoxelChunkIndex.h"
+#include "VoxelIntegrity.h"
+#include "VoxelTerrainStats.h"
+#include "Async/ParallelFor.h"
+
+using namespace PolyVox;
+
+const float FVoxelBlockTicker::OreRegrowChance = 0.125f;
+
+namespace
+{
+	const int32 ChunkMask = VOXEL_CHUNK_SIZE - 1;
+
+	// What voxels in chunks that aren't paged in read as
+	const uint8 UnknownMaterial = 0xFF;
+
+	// Reads the materials of a chunk and the voxels around it without paging anything in
+	class FNeighbourhoodReader
+	{
+	public:
+		FNeighbourhoodReader(const FVoxelChunkIndex& ChunkIndex, const FIntVector& ChunkCoords)
+		{
+			for (int32 Z = -1; Z <= 1; Z++)
+			{
+				for (int32 Y = -1; Y <= 1; Y++)
+				{
+					for (int32 X = -1; X <= 1; X++)
+					{
+						Chunks[(X + 1) + (Y + 1) * 3 + (Z + 1) * 9] = ChunkIndex.Find(ChunkCoords + FIntVector(X, Y, Z));
+					}
+				}
+			}
+		}
+
+		// The chunk being read
+		FVoxelVolume::Chunk* GetChunk() const { return Chunks[13]; }
+
+		// Returns the material of a voxel, relative to the chunk, from -1 to VOXEL_CHUNK_SIZE along each axis
+		FORCEINLINE uint8 GetMaterial(int32 X, int32 Y, int32 Z) const
+		{
+			// The shift takes -1 to -1, the chunk to 0 and VOXEL_CHUNK_SIZE to 1
+			FVoxelVolume::Chunk* Chunk = Chunks[((X >> VOXEL_CHUNK_SHIFT) + 1) + ((Y >> VOXEL_CHUNK_SHIFT) + 1) * 3 + ((Z >> VOXEL_CHUNK_SHIFT) + 1) * 9];
+			return Chunk != nullptr ? Chunk->getVoxel(X & ChunkMask, Y & ChunkMask, Z & ChunkMask).getMaterial() : UnknownMaterial;
+		}
+
+	private:
+		FVoxelVolume::Chunk* Chunks[27];
+	};
+
+	// Works out what a voxel turns into when it ticks, or returns its own material if it stays the same. Sets bOutTickable to whether the voxel
+	// could change at all, and so belongs on its chunk's list. Voxels that depend on a chunk that isn't paged in don't, until it is.
+	uint8 EvaluateVoxel(const FNeighbourhoodReader& Reader, int32 X, int32 Y, int32 Z, uint8 Material, bool& bOutTickable)
+	{
+		bOutTickable = false;
+
+		switch (Material)
+		{
+		case VOXEL_MATERIAL_DIRT:
+		{
+			// Uncovered dirt grows grass if there's grass next to it. Dirt under a chunk that isn't paged in stays off the list until it is.
+			const uint8 Above = Reader.GetMaterial(X, Y, Z + 1);
+			if (Above != VOXEL_MATERIAL_AIR)
+			{
+				return Material;
+			}
+
+			bOutTickable = true;
+			for (int32 OffsetZ = -1; OffsetZ <= 1; OffsetZ++)
+			{
+				for (int32 OffsetY = -1; OffsetY <= 1; OffsetY++)
+				{
+					for (int32 OffsetX = -1; OffsetX <= 1; OffsetX++)
+					{
+						if (Reader.GetMaterial(X + OffsetX, Y + OffsetY, Z + OffsetZ) == VOXEL_MATERIAL_GRASS)
+						{
+							return VOXEL_MATERIAL_GRASS;
+						}
+					}
+				}
+			}
+
+			return Material;
+		}
+
+		case VOXEL_MATERIAL_GRASS:
+		{
+			// Covered grass dies back to dirt
+			const uint8 Above = Reader.GetMaterial(X, Y, Z + 1);
+			if (Above == VOXEL_MATERIAL_AIR || Above == UnknownMaterial)
+			{
+				return Material;
+			}
+
+			bOutTickable = true;
+			return VOXEL_MATERIAL_DIRT;
+		}
+
+		case VOXEL_MATERIAL_STONE:
+		{
+			// Enclosed stone between at least two ore voxels turns into ore. Stone outside a vein's bounding box can never touch two of its voxels,
+			// so veins fill back in without growing. Exposed stone doesn't, so digging out a vein doesn't just refill the tunnel.
+			const uint8 Neighbours[6] =
+			{
+				Reader.GetMaterial(X + 1, Y, Z),
+				Reader.GetMaterial(X - 1, Y, Z),
+				Reader.GetMaterial(X, Y + 1, Z),
+				Reader.GetMaterial(X, Y - 1, Z),
+				Reader.GetMaterial(X, Y, Z + 1),
+				Reader.GetMaterial(X, Y, Z - 1)
+			};
+
+			int32 NumOre = 0;
+			int32 NumUnknown = 0;
+			for (const uint8 Neighbour : Neighbours)
+			{
+				if (Neighbour == UnknownMaterial)
+				{
+					NumUnknown++;
+					continue;
+				}
+
+				if (!FVoxelIntegrityChecker::IsStructuralMaterial(Neighbour))
+				{
+					return Material;
+				}
+
+				NumOre += Neighbour == VOXEL_MATERIAL_ORE ? 1 : 0;
+			}
+
+			if (NumUnknown > 0 || NumOre < 2)
+			{
+				return Material;
+			}
+
+			bOutTickable = true;
+			return VOXEL_MATERIAL_ORE;
+		}
+
+		default:
+			return Material;
+		}
+	}
+}
+
+void FVoxelBlockTicker::Tick(const FVoxelChunkIndex& ChunkIndex, int32 RandomTicksPerChunk, int32 TickBudget, int32 ScanBudget, TArray<FVoxelBlockTickEdit>& OutEdits)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelBlockTick);
+
+	TickCount++;
+
+	// Forget chunks that were paged out. If they come back they're built from scratch, so their lists are too.
+	int32 NumTickable = 0;
+	for (auto It = ChunkCells.CreateIterator(); It; ++It)
+	{
+		if (!ChunkIndex.Contains(It.Key()))
+		{
+			It.Value()->Reset();
+			FreeCellLists.Add(It.Value());
+			It.RemoveCurrent();
+			continue;
+		}
+
+		NumTickable += It.Value()->Num();
+	}
+
+	PendingScans.RemoveAll([this](const FPendingScan& Scan)
+	{
+		return !ChunkCells.Contains(Scan.ChunkCoords);
+	});
+
+	// Each chunk gets at most one task, since a task is the only thing that touches its chunk's list
+	int32 NumTasks = 0;
+	ChunkTasks.Reset();
+	auto AddTask = [this, &NumTasks](const FIntVector& ChunkCoords, FVoxelCellList* Cells) -> FChunkTask&
+	{
+		if (NumTasks == Tasks.Num())
+		{
+			Tasks.AddDefaulted();
+		}
+
+		ChunkTasks.Add(ChunkCoords, NumTasks);
+		FChunkTask& Task = Tasks[NumTasks++];
+		Task.ChunkCoords = ChunkCoords;
+		Task.Cells = Cells;
+		Task.NumTicks = 0;
+		Task.ScanStart = 0;
+		Task.ScanEnd = 0;
+		Task.Random.Initialize((int32)(TickCount * 7919u) ^ (int32)GetTypeHash(ChunkCoords));
+		Task.Edits.Reset();
+		return Task;
+	};
+
+	// Each chunk ticks as many voxels as it would have hit picking random voxels from the whole chunk, scaled down to fit the budget.
+	// Round the fractions up or down at random so small lists still tick at the right rate on average.
+	const float TicksPerVoxel = (float)FMath::Max(RandomTicksPerChunk, 0) / VOXEL_CHUNK_VOLUME;
+	const float ExpectedTicks = NumTickable * TicksPerVoxel;
+	const float BudgetScale = ExpectedTicks > TickBudget ? FMath::Max(TickBudget, 0) / ExpectedTicks : 1.f;
+	FRandomStream Random(TickCount);
+
+	for (const auto& Pair : ChunkCells)
+	{
+		const float ChunkTicks = Pair.Value->Num() * TicksPerVoxel * BudgetScale;
+		const int32 NumTicks = FMath::FloorToInt(ChunkTicks) + (Random.FRand() < FMath::Frac(ChunkTicks) ? 1 : 0);
+		if (NumTicks > 0)
+		{
+			AddTask(Pair.Key, Pair.Value).NumTicks = NumTicks;
+		}
+	}
+
+	// Chunks we haven't seen before get an empty list and a scan of the whole chunk to fill it
+	NewChunks.Reset();
+	ChunkIndex.ForEach([this](const FIntVector& ChunkCoords, const FVoxelChunkIndex::FEntry& Entry)
+	{
+		if (!ChunkCells.Contains(ChunkCoords))
+		{
+			NewChunks.Add(ChunkCoords);
+		}
+	});
+
+	// The voxels of older chunks that face a new one may have been left off their lists because they couldn't see into it, so scan them again.
+	// This runs before the new chunks are added, since their own scans already see each other.
+	for (const FIntVector& ChunkCoords : NewChunks)
+	{
+		for (int32 Z = -1; Z <= 1; Z++)
+		{
+			for (int32 Y = -1; Y <= 1; Y++)
+			{
+				for (int32 X = -1; X <= 1; X++)
+				{
+					const FIntVector Offset(X, Y, Z);
+					const FIntVector Neighbour = ChunkCoords - Offset;
+					if (Offset == FIntVector(0, 0, 0) || !ChunkCells.Contains(Neighbour))
+					{
+						continue;
+					}
+
+					// The neighbour's layer of voxels along each axis where the new chunk is next to it, or all of them where it's level with it
+					FIntVector Min;
+					FIntVector Size;
+					for (int32 Axis = 0; Axis < 3; Axis++)
+					{
+						Min[Axis] = Offset[Axis] > 0 ? VOXEL_CHUNK_SIZE - 1 : 0;
+						Size[Axis] = Offset[Axis] != 0 ? 1 : VOXEL_CHUNK_SIZE;
+					}
+
+					AddScan(Neighbour, Min, Size);
+				}
+			}
+		}
+	}
+
+	for (const FIntVector& ChunkCoords : NewChunks)
+	{
+		FVoxelCellList* Cells = nullptr;
+		if (FreeCellLists.Num() > 0)
+		{
+			Cells = FreeCellLists.Pop(false);
+		}
+		else
+		{
+			Cells = new FVoxelCellList();
+			CellLists.Emplace(Cells);
+		}
+
+		ChunkCells.Add(ChunkCoords, Cells);
+		AddScan(ChunkCoords, FIntVector(0, 0, 0), FIntVector(VOXEL_CHUNK_SIZE, VOXEL_CHUNK_SIZE, VOXEL_CHUNK_SIZE));
+	}
+
+	// Hand out the scan budget oldest scan first. A chunk only does part of one scan per tick, so later scans of a busy chunk wait their turn.
+	int32 ScanBudgetLeft = FMath::Max(ScanBudget, 0);
+	for (int32 ScanIndex = 0; ScanIndex < PendingScans.Num() && ScanBudgetLeft > 0; ScanIndex++)
+	{
+		FPendingScan& Scan = PendingScans[ScanIndex];
+
+		const int32* TaskIndex = ChunkTasks.Find(Scan.ChunkCoords);
+		FChunkTask& Task = TaskIndex != nullptr ? Tasks[*TaskIndex] : AddTask(Scan.ChunkCoords, ChunkCells.FindChecked(Scan.ChunkCoords));
+		if (Task.ScanEnd > Task.ScanStart)
+		{
+			continue;
+		}
+
+		const int32 NumVoxels = FMath::Min(Scan.Size.X * Scan.Size.Y * Scan.Size.Z - Scan.NumScanned, ScanBudgetLeft);
+		Task.ScanMin = Scan.Min;
+		Task.ScanSize = Scan.Size;
+		Task.ScanStart = Scan.NumScanned;
+		Task.ScanEnd = Scan.NumScanned + NumVoxels;
+
+		Scan.NumScanned += NumVoxels;
+		ScanBudgetLeft -= NumVoxels;
+	}
+
+	PendingScans.RemoveAll([](const FPendingScan& Scan)
+	{
+		return Scan.NumScanned >= Scan.Size.X * Scan.Size.Y * Scan.Size.Z;
+	});
+
+	// Each task only touches its own chunk's list, and nothing writes to the volume until all of them are done
+	ParallelFor(NumTasks, [this, &ChunkIndex](int32 TaskIndex)
+	{
+		TickChunk(ChunkIndex, Tasks[TaskIndex]);
+	});
+
+	for (int32 TaskIndex = 0; TaskIndex < NumTasks; TaskIndex++)
+	{
+		OutEdits.Append(Tasks[TaskIndex].Edits);
+	}
+
+	SET_DWORD_STAT(STAT_VoxelTickableVoxels, GetNumTickableVoxels());
+}
+
+void FVoxelBlockTicker::OnVoxelChanged(const FIntVector& VoxelCoords)
+{
+	static const FIntVector Offsets[7] =
+	{
+		FIntVector(0, 0, 0),
+		FIntVector(1, 0, 0),
+		FIntVector(-1, 0, 0),
+		FIntVector(0, 1, 0),
+		FIntVector(0, -1, 0),
+		FIntVector(0, 0, 1),
+		FIntVector(0, 0, -1)
+	};
+
+	// Put them all on the list and let the next tick that visits them work out whether they belong there.
+	// Chunks we haven't seen yet will pick the change up when they build their lists.
+	for (const FIntVector& Offset : Offsets)
+	{
+		const FIntVector Voxel = VoxelCoords + Offset;
+		if (FVoxelCellList** Cells = ChunkCells.Find(GetVoxelChunkCoords(Voxel.X, Voxel.Y, Voxel.Z)))
+		{
+			(*Cells)->Add(FVoxelCellList::GetCellIndex(Voxel.X & ChunkMask, Voxel.Y & ChunkMask, Voxel.Z & ChunkMask));
+		}
+	}
+}
+
+void FVoxelBlockTicker::AddScan(const FIntVector& ChunkCoords, const FIntVector& Min, const FIntVector& Size)
+{
+	FPendingScan& Scan = PendingScans[PendingScans.AddUninitialized()];
+	Scan.ChunkCoords = ChunkCoords;
+	Scan.Min = Min;
+	Scan.Size = Size;
+	Scan.NumScanned = 0;
+}
+
+int32 FVoxelBlockTicker::GetNumTickableVoxels() const
+{
+	int32 NumTickable = 0;
+	for (const auto& Pair : ChunkCells)
+	{
+		NumTickable += Pair.Value->Num();
+	}
+
+	return NumTickable;
+}
+
+void FVoxelBlockTicker::TickChunk(const FVoxelChunkIndex& ChunkIndex, FChunkTask& Task) const
+{
+	const FNeighbourhoodReader Reader(ChunkIndex, Task.ChunkCoords);
+	FVoxelVolume::Chunk* Chunk = Reader.GetChunk();
+	FVoxelCellList& Cells = *Task.Cells;
+	bool bTickable = false;
+
+	const FIntVector ChunkBase = Task.ChunkCoords * VOXEL_CHUNK_SIZE;
+	for (int32 TickIndex = 0; TickIndex < Task.NumTicks && Cells.Num() > 0; TickIndex++)
+	{
+		const int32 ListIndex = Task.Random.RandHelper(Cells.Num());
+		const FIntVector Cell = FVoxelCellList::GetCellCoords(Cells[ListIndex]);
+		const uint8 Material = Chunk->getVoxel(Cell.X, Cell.Y, Cell.Z).getMaterial();
+		const uint8 NewMaterial = EvaluateVoxel(Reader, Cell.X, Cell.Y, Cell.Z, Material, bTickable);
+
+		if (NewMaterial == VOXEL_MATERIAL_ORE && Task.Random.FRand() >= OreRegrowChance)
+		{
+			continue;
+		}
+
+		// Voxels that change come off the list too; the edit puts back whichever of them and their neighbours can change next
+		if (!bTickable || NewMaterial != Material)
+		{
+			Cells.RemoveAtSwap(ListIndex);
+		}
+
+		if (NewMaterial != Material)
+		{
+			FVoxelBlockTickEdit Edit;
+			Edit.VoxelCoords = ChunkBase + Cell;
+			Edit.Material = NewMaterial;
+			Task.Edits.Add(Edit);
+		}
+	}
+
+	// Then this tick's part of the chunk's scan, if it has one. The list makes sure voxels the ticks just put back aren't added twice.
+	for (int32 ScanIndex = Task.ScanStart; ScanIndex < Task.ScanEnd; ScanIndex++)
+	{
+		const int32 X = Task.ScanMin.X + ScanIndex % Task.ScanSize.X;
+		const int32 Y = Task.ScanMin.Y + (ScanIndex / Task.ScanSize.X) % Task.ScanSize.Y;
+		const int32 Z = Task.ScanMin.Z + ScanIndex / (Task.ScanSize.X * Task.ScanSize.Y);
+
+		EvaluateVoxel(Reader, X, Y, Z, Chunk->getVoxel(X, Y, Z).getMaterial(), bTickable);
+		if (bTickable)
+		{
+			Cells.Add(FVoxelCellList::GetCellIndex(X, Y, Z));
+		}
+	}
+}
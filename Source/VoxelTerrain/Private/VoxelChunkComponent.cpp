@@ -0,0 +1,618 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelChunkComponent.h"
+#include "VoxelTerrainStats.h"
+#include "DynamicMeshBuilder.h"
+#include "PhysicsEngine/BodySetup.h"
+
+// Vertex buffer that is filled straight from a section's shared buffers when it's created
+class FVoxelChunkVertexBuffer : public FVertexBuffer
+{
+public:
+	FVoxelMeshBuffersRef Buffers;
+	int32 NumVertices = 0;
+
+	virtual void InitRHI() override
+	{
+		const FVoxelMeshBuffers& Source = *Buffers;
+		NumVertices = Source.Vertices.Num();
+
+		FRHIResourceCreateInfo CreateInfo;
+		void* VertexBufferData = nullptr;
+		VertexBufferRHI = RHICreateAndLockVertexBuffer(NumVertices * sizeof(FDynamicMeshVertex), BUF_Static, CreateInfo, VertexBufferData);
+
+		// Interleave the vertices directly into the locked buffer so there's no intermediate copy on the CPU
+		FDynamicMeshVertex* Vertices = (FDynamicMeshVertex*)VertexBufferData;
+		for (int32 VertexIndex = 0; VertexIndex < NumVertices; VertexIndex++)
+		{
+			FDynamicMeshVertex& Vertex = Vertices[VertexIndex];
+			Vertex.Position = Source.Vertices[VertexIndex];
+			Vertex.TextureCoordinate = Source.UV0.IsValidIndex(VertexIndex) ? Source.UV0[VertexIndex] : FVector2D::ZeroVector;
+			Vertex.Color = Source.Colors.IsValidIndex(VertexIndex) ? Source.Colors[VertexIndex] : FColor::White;
+
+			const FProcMeshTangent Tangent = Source.Tangents.IsValidIndex(VertexIndex) ? Source.Tangents[VertexIndex] : FProcMeshTangent();
+			Vertex.TangentX = Tangent.TangentX;
+			Vertex.TangentZ = Source.Normals.IsValidIndex(VertexIndex) ? Source.Normals[VertexIndex] : FVector(0, 0, 1);
+			Vertex.TangentZ.Vector.W = Tangent.bFlipTangentY ? 0 : 255;
+		}
+
+		RHIUnlockVertexBuffer(VertexBufferRHI);
+	}
+};
+
+// Index buffer that is filled straight from a section's shared buffers when it's created.
+// Sections with few enough vertices get 16 bit indices, which is nearly all of them, halving the buffer's size and the bandwidth to read it.
+class FVoxelChunkIndexBuffer : public FIndexBuffer
+{
+public:
+	FVoxelMeshBuffersRef Buffers;
+	int32 NumIndices = 0;
+
+	virtual void InitRHI() override
+	{
+		const TArray<int32>& Indices = Buffers->Indices;
+		NumIndices = Indices.Num();
+
+		// Sections with few enough vertices use 16 bit indices
+		const bool b32Bit = Buffers->Vertices.Num() > MAX_uint16 + 1;
+
+		const uint32 Stride = b32Bit ? sizeof(uint32) : sizeof(uint16);
+
+		FRHIResourceCreateInfo CreateInfo;
+		void* IndexBufferData = nullptr;
+		IndexBufferRHI = RHICreateAndLockIndexBuffer(Stride, NumIndices * Stride, BUF_Static, CreateInfo, IndexBufferData);
+
+		if (b32Bit)
+		{
+			FMemory::Memcpy(IndexBufferData, Indices.GetData(), NumIndices * sizeof(int32));
+		}
+		else
+		{
+			// Narrow the indices straight into the locked buffer
+			uint16* Narrowed = (uint16*)IndexBufferData;
+			for (int32 Index = 0; Index < NumIndices; Index++)
+			{
+				Narrowed[Index] = (uint16)Indices[Index];
+			}
+		}
+
+		RHIUnlockIndexBuffer(IndexBufferRHI);
+	}
+};
+
+// Vertex factory for a chunk section
+class FVoxelChunkVertexFactory : public FLocalVertexFactory
+{
+public:
+	// Sets up the vertex streams. Must be called on the render thread.
+	void Init_RenderThread(const FVoxelChunkVertexBuffer* VertexBuffer)
+	{
+		check(IsInRenderingThread());
+
+		FDataType NewData;
+		NewData.PositionComponent = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, FDynamicMeshVertex, Position, VET_Float3);
+		NewData.TextureCoordinates.Add(FVertexStreamComponent(VertexBuffer, STRUCT_OFFSET(FDynamicMeshVertex, TextureCoordinate), sizeof(FDynamicMeshVertex), VET_Float2));
+		NewData.TangentBasisComponents[0] = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, FDynamicMeshVertex, TangentX, VET_PackedNormal);
+		NewData.TangentBasisComponents[1] = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, FDynamicMeshVertex, TangentZ, VET_PackedNormal);
+		NewData.ColorComponent = STRUCTMEMBER_VERTEXSTREAMCOMPONENT(VertexBuffer, FDynamicMeshVertex, Color, VET_Color);
+		SetData(NewData);
+	}
+};
+
+// The GPU copy of a set of shared mesh buffers. Identical sections share their buffers, so they also share one of these and their geometry is
+// only uploaded once however many chunks draw it. Only touched on the render thread.
+class FVoxelChunkRenderBuffers
+{
+public:
+	FVoxelChunkVertexBuffer VertexBuffer;
+	FVoxelChunkIndexBuffer IndexBuffer;
+	FVoxelChunkVertexFactory VertexFactory;
+
+	// Returns the GPU copy of a set of buffers, creating it if no section is using one yet
+	static FVoxelChunkRenderBuffers* Acquire(const FVoxelMeshBuffersRef& Buffers)
+	{
+		check(IsInRenderingThread());
+
+		FVoxelChunkRenderBuffers*& RenderBuffers = GetSharedBuffers().FindOrAdd(Buffers.GetReference());
+		if (RenderBuffers == nullptr)
+		{
+			RenderBuffers = new FVoxelChunkRenderBuffers();
+			RenderBuffers->VertexBuffer.Buffers = Buffers;
+			RenderBuffers->IndexBuffer.Buffers = Buffers;
+			RenderBuffers->VertexBuffer.InitResource();
+			RenderBuffers->IndexBuffer.InitResource();
+			RenderBuffers->VertexFactory.Init_RenderThread(&RenderBuffers->VertexBuffer);
+			RenderBuffers->VertexFactory.InitResource();
+		}
+
+		RenderBuffers->NumUsers++;
+		return RenderBuffers;
+	}
+
+	// Lets go of a GPU copy returned by Acquire, freeing it once nothing uses it
+	static void Release(FVoxelChunkRenderBuffers* RenderBuffers)
+	{
+		check(IsInRenderingThread());
+
+		if (--RenderBuffers->NumUsers == 0)
+		{
+			GetSharedBuffers().Remove(RenderBuffers->VertexBuffer.Buffers.GetReference());
+			RenderBuffers->VertexBuffer.ReleaseResource();
+			RenderBuffers->IndexBuffer.ReleaseResource();
+			RenderBuffers->VertexFactory.ReleaseResource();
+			delete RenderBuffers;
+		}
+	}
+
+private:
+	// The GPU copy of every set of buffers that's being drawn. The copy holds a reference to its buffers, so they can't be reused for something
+	// else while they're in here.
+	static TMap<const FVoxelSharedMeshBuffers*, FVoxelChunkRenderBuffers*>& GetSharedBuffers()
+	{
+		static TMap<const FVoxelSharedMeshBuffers*, FVoxelChunkRenderBuffers*> SharedBuffers;
+		return SharedBuffers;
+	}
+
+	int32 NumUsers = 0;
+};
+
+// The render thread's copy of a section. It shares its geometry with the component rather than copying it.
+class FVoxelChunkProxySection
+{
+public:
+	UMaterialInterface* Material = nullptr;
+	FVoxelMeshBuffersRef Buffers;
+	FVoxelChunkRenderBuffers* RenderBuffers = nullptr;
+	bool bSectionVisible = true;
+};
+
+// Scene proxy for a chunk component
+class FVoxelChunkSceneProxy : public FPrimitiveSceneProxy
+{
+public:
+	FVoxelChunkSceneProxy(UVoxelChunkComponent* Component)
+		: FPrimitiveSceneProxy(Component)
+		, MaterialRelevance(Component->GetMaterialRelevance(GetScene().GetFeatureLevel()))
+		, bOccluded(Component->bOccluded)
+	{
+		Sections.AddZeroed(Component->Sections.Num());
+
+		for (int32 SectionIndex = 0; SectionIndex < Component->Sections.Num(); SectionIndex++)
+		{
+			const FVoxelChunkSection& SrcSection = Component->Sections[SectionIndex];
+			if (!SrcSection.Buffers.IsValid() || SrcSection.Buffers->Indices.Num() == 0)
+			{
+				continue;
+			}
+
+			FVoxelChunkProxySection* NewSection = new FVoxelChunkProxySection();
+
+			// Take another reference to the component's buffers. Their GPU copy is found or created on the render thread.
+			NewSection->Buffers = SrcSection.Buffers;
+
+			NewSection->Material = Component->GetMaterial(SectionIndex);
+			if (NewSection->Material == nullptr)
+			{
+				NewSection->Material = UMaterial::GetDefaultMaterial(MD_Surface);
+			}
+
+			NewSection->bSectionVisible = SrcSection.bSectionVisible;
+			Sections[SectionIndex] = NewSection;
+		}
+	}
+
+	virtual ~FVoxelChunkSceneProxy()
+	{
+		for (FVoxelChunkProxySection* Section : Sections)
+		{
+			if (Section != nullptr)
+			{
+				if (Section->RenderBuffers != nullptr)
+				{
+					FVoxelChunkRenderBuffers::Release(Section->RenderBuffers);
+				}
+
+				delete Section;
+			}
+		}
+	}
+
+	virtual void CreateRenderThreadResources() override
+	{
+		for (FVoxelChunkProxySection* Section : Sections)
+		{
+			if (Section != nullptr)
+			{
+				Section->RenderBuffers = FVoxelChunkRenderBuffers::Acquire(Section->Buffers);
+			}
+		}
+	}
+
+	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap, FMeshElementCollector& Collector) const override
+	{
+		// Set up wireframe material (if needed)
+		const bool bWireframe = AllowDebugViewmodes() && ViewFamily.EngineShowFlags.Wireframe;
+
+		FColoredMaterialRenderProxy* WireframeMaterialInstance = nullptr;
+		if (bWireframe)
+		{
+			WireframeMaterialInstance = new FColoredMaterialRenderProxy(GEngine->WireframeMaterial ? GEngine->WireframeMaterial->GetRenderProxy(IsSelected()) : nullptr, FLinearColor(0, 0.5f, 1.f));
+			Collector.RegisterOneFrameMaterialProxy(WireframeMaterialInstance);
+		}
+
+		for (const FVoxelChunkProxySection* Section : Sections)
+		{
+			if (Section == nullptr || Section->RenderBuffers == nullptr || !Section->bSectionVisible)
+			{
+				continue;
+			}
+
+			FMaterialRenderProxy* MaterialProxy = bWireframe ? WireframeMaterialInstance : Section->Material->GetRenderProxy(IsSelected());
+
+			for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+			{
+				if (VisibilityMap & (1 << ViewIndex))
+				{
+					FMeshBatch& Mesh = Collector.AllocateMesh();
+					FMeshBatchElement& BatchElement = Mesh.Elements[0];
+					BatchElement.IndexBuffer = &Section->RenderBuffers->IndexBuffer;
+					Mesh.bWireframe = bWireframe;
+					Mesh.VertexFactory = &Section->RenderBuffers->VertexFactory;
+					Mesh.MaterialRenderProxy = MaterialProxy;
+					BatchElement.PrimitiveUniformBuffer = CreatePrimitiveUniformBufferImmediate(GetLocalToWorld(), GetBounds(), GetLocalBounds(), true, UseEditorDepthTest());
+					BatchElement.FirstIndex = 0;
+					BatchElement.NumPrimitives = Section->RenderBuffers->IndexBuffer.NumIndices / 3;
+					BatchElement.MinVertexIndex = 0;
+					BatchElement.MaxVertexIndex = Section->RenderBuffers->VertexBuffer.NumVertices - 1;
+					Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
+					Mesh.Type = PT_TriangleList;
+					Mesh.DepthPriorityGroup = SDPG_World;
+					Mesh.bCanApplyViewModeOverrides = false;
+					Collector.AddMesh(ViewIndex, Mesh);
+				}
+			}
+		}
+	}
+
+	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) override
+	{
+		FPrimitiveViewRelevance Result;
+		Result.bDrawRelevance = IsShown(View) && !bOccluded;
+		Result.bShadowRelevance = IsShadowCast(View);
+		Result.bDynamicRelevance = true;
+		Result.bRenderInMainPass = ShouldRenderInMainPass();
+		Result.bRenderCustomDepth = ShouldRenderCustomDepth();
+		MaterialRelevance.SetPrimitiveViewRelevance(Result);
+		return Result;
+	}
+
+	virtual bool CanBeOccluded() const override
+	{
+		return !MaterialRelevance.bDisableDepthTest;
+	}
+
+	virtual uint32 GetMemoryFootprint() const override
+	{
+		return sizeof(*this) + GetAllocatedSize();
+	}
+
+	uint32 GetAllocatedSize() const
+	{
+		return FPrimitiveSceneProxy::GetAllocatedSize();
+	}
+
+	// Called on the render thread when the component is hidden or shown by occlusion culling
+	void SetOccluded_RenderThread(bool bNewOccluded)
+	{
+		check(IsInRenderingThread());
+		bOccluded = bNewOccluded;
+	}
+
+private:
+	TArray<FVoxelChunkProxySection*> Sections;
+	FMaterialRelevance MaterialRelevance;
+
+	// Whether the chunk is hidden from the main pass by occlusion culling
+	bool bOccluded;
+};
+
+UVoxelChunkComponent::UVoxelChunkComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+	, LocalBounds(ForceInitToZero)
+	, Collision(nullptr)
+	, bOccluded(false)
+{
+}
+
+void UVoxelChunkComponent::SetMeshSection(int32 SectionIndex, FVoxelMeshBuffers&& Buffers)
+{
+	SetMeshSection(SectionIndex, FVoxelMeshBufferPool::Get().Acquire(MoveTemp(Buffers)));
+}
+
+void UVoxelChunkComponent::SetMeshSection(int32 SectionIndex, FVoxelMeshBuffersRef Buffers)
+{
+	SetSectionBuffers(SectionIndex, MoveTemp(Buffers));
+	SectionsChanged();
+}
+
+void UVoxelChunkComponent::SetMeshSections(const TArray<FVoxelMeshBuffersRef>& Buffers)
+{
+	Sections.Reset();
+	for (int32 SectionIndex = 0; SectionIndex < Buffers.Num(); SectionIndex++)
+	{
+		SetSectionBuffers(SectionIndex, Buffers[SectionIndex]);
+	}
+
+	SectionsChanged();
+}
+
+void UVoxelChunkComponent::SetSectionBuffers(int32 SectionIndex, FVoxelMeshBuffersRef Buffers)
+{
+	check(SectionIndex >= 0);
+
+	if (SectionIndex >= Sections.Num())
+	{
+		Sections.SetNum(SectionIndex + 1, false);
+	}
+
+	FVoxelChunkSection& Section = Sections[SectionIndex];
+	Section.Buffers = MoveTemp(Buffers);
+	Section.LocalBox = FBox(0);
+	for (const FVector& Vertex : Section.Buffers->Vertices)
+	{
+		Section.LocalBox += Vertex;
+	}
+}
+
+void UVoxelChunkComponent::ClearMeshSection(int32 SectionIndex)
+{
+	if (Sections.IsValidIndex(SectionIndex))
+	{
+		Sections[SectionIndex] = FVoxelChunkSection();
+		SectionsChanged();
+	}
+}
+
+void UVoxelChunkComponent::ClearAllMeshSections()
+{
+	// Keep the array's allocation; chunk components get reused
+	Sections.Reset();
+	SectionsChanged();
+}
+
+void UVoxelChunkComponent::SetOccluded(bool bNewOccluded)
+{
+	if (bOccluded == bNewOccluded)
+	{
+		return;
+	}
+
+	bOccluded = bNewOccluded;
+
+	// Recreating the proxy would upload the sections again, so just tell the existing one
+	if (SceneProxy != nullptr)
+	{
+		ENQUEUE_UNIQUE_RENDER_COMMAND_TWOPARAMETER(
+			FSetVoxelChunkOccluded,
+			FVoxelChunkSceneProxy*, Proxy, (FVoxelChunkSceneProxy*)SceneProxy,
+			bool, bOccluded, bOccluded,
+			{
+				Proxy->SetOccluded_RenderThread(bOccluded);
+			});
+	}
+}
+
+void UVoxelChunkComponent::SetCollisionMesh(const TArray<FVoxelMeshBuffersRef>& Buffers)
+{
+	// Section 0 is voxel material 1. Leaving out a section keeps the indices of the others, so they keep their physical materials.
+	TArray<FVoxelMeshBuffersRef> SolidBuffers;
+	SolidBuffers.Reserve(Buffers.Num());
+	for (int32 SectionIndex = 0; SectionIndex < Buffers.Num(); SectionIndex++)
+	{
+		SolidBuffers.Add(IsVoxelMaterialFluid(SectionIndex + 1) ? FVoxelMeshBuffersRef() : Buffers[SectionIndex]);
+	}
+
+	SetCollision(UVoxelChunkCollision::Acquire(SolidBuffers));
+}
+
+void UVoxelChunkComponent::ClearCollisionMesh()
+{
+	if (Collision != nullptr)
+	{
+		SetCollision(nullptr);
+	}
+}
+
+void UVoxelChunkComponent::SetCollision(UVoxelChunkCollision* NewCollision)
+{
+	// If the physics state has been created, shut it down while we switch bodies
+	const bool bCreatePhysState = bPhysicsStateCreated;
+	if (bCreatePhysState)
+	{
+		DestroyPhysicsState();
+	}
+
+	if (Collision != nullptr)
+	{
+		Collision->Release();
+	}
+
+	Collision = NewCollision;
+
+	if (bCreatePhysState)
+	{
+		CreatePhysicsState();
+	}
+}
+
+void UVoxelChunkComponent::SectionsChanged()
+{
+	UpdateLocalBounds();
+	MarkRenderStateDirty();
+}
+
+void UVoxelChunkComponent::UpdateLocalBounds()
+{
+	FBox LocalBox(0);
+	for (const FVoxelChunkSection& Section : Sections)
+	{
+		LocalBox += Section.LocalBox;
+	}
+
+	LocalBounds = LocalBox.IsValid ? FBoxSphereBounds(LocalBox) : FBoxSphereBounds(FVector::ZeroVector, FVector::ZeroVector, 0);
+
+	// Update global bounds
+	UpdateBounds();
+}
+
+FPrimitiveSceneProxy* UVoxelChunkComponent::CreateSceneProxy()
+{
+	return new FVoxelChunkSceneProxy(this);
+}
+
+int32 UVoxelChunkComponent::GetNumMaterials() const
+{
+	return Sections.Num();
+}
+
+void UVoxelChunkComponent::OnComponentDestroyed(bool bDestroyingHierarchy)
+{
+	// Let other chunks know we're no longer using our collision, so it can go once they aren't either
+	ClearCollisionMesh();
+
+	Super::OnComponentDestroyed(bDestroyingHierarchy);
+}
+
+UBodySetup* UVoxelChunkComponent::GetBodySetup()
+{
+	return Collision != nullptr ? Collision->GetBodySetup() : nullptr;
+}
+
+FBoxSphereBounds UVoxelChunkComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	FBoxSphereBounds Ret(LocalBounds.TransformBy(LocalToWorld));
+
+	Ret.BoxExtent *= BoundsScale;
+	Ret.SphereRadius *= BoundsScale;
+
+	return Ret;
+}
+
+// UVoxelChunkCollision
+
+UVoxelChunkCollision* UVoxelChunkCollision::Acquire(const TArray<FVoxelMeshBuffersRef>& Buffers)
+{
+	check(IsInGameThread());
+
+	const uint32 Hash = HashBuffers(Buffers);
+	for (auto It = GetSharedCollision().CreateConstKeyIterator(Hash); It; ++It)
+	{
+		if (It.Value()->Buffers == Buffers)
+		{
+			INC_DWORD_STAT(STAT_VoxelSharedCollisionMeshes);
+			It.Value()->NumUsers++;
+			return It.Value();
+		}
+	}
+
+	UVoxelChunkCollision* Collision = NewObject<UVoxelChunkCollision>(GetTransientPackage());
+	Collision->Buffers = Buffers;
+	Collision->NumUsers = 1;
+
+	// The cooker reads the mesh from the body's outer
+	UBodySetup* BodySetup = NewObject<UBodySetup>(Collision);
+	BodySetup->BodySetupGuid = FGuid::NewGuid();
+	BodySetup->bGenerateMirroredCollision = false;
+	BodySetup->bDoubleSidedGeometry = true;
+	BodySetup->CollisionTraceFlag = CTF_UseComplexAsSimple;
+	Collision->BodySetup = BodySetup;
+
+#if WITH_RUNTIME_PHYSICS_COOKING || WITH_EDITOR
+	BodySetup->CreatePhysicsMeshes();
+#endif // WITH_RUNTIME_PHYSICS_COOKING || WITH_EDITOR
+
+	// Keep it alive for as long as it's in the table, whoever is or isn't referencing it
+	Collision->AddToRoot();
+	GetSharedCollision().Add(Hash, Collision);
+	return Collision;
+}
+
+void UVoxelChunkCollision::Release()
+{
+	check(IsInGameThread() && NumUsers > 0);
+
+	if (--NumUsers == 0)
+	{
+		GetSharedCollision().RemoveSingle(HashBuffers(Buffers), this);
+		RemoveFromRoot();
+
+		// Let the buffers go now rather than whenever we're garbage collected
+		Buffers.Reset();
+	}
+}
+
+TMultiMap<uint32, UVoxelChunkCollision*>& UVoxelChunkCollision::GetSharedCollision()
+{
+	static TMultiMap<uint32, UVoxelChunkCollision*> SharedCollision;
+	return SharedCollision;
+}
+
+uint32 UVoxelChunkCollision::HashBuffers(const TArray<FVoxelMeshBuffersRef>& Buffers)
+{
+	uint32 Hash = 0;
+	for (const FVoxelMeshBuffersRef& Section : Buffers)
+	{
+		Hash = HashCombine(Hash, PointerHash(Section.GetReference()));
+	}
+
+	return Hash;
+}
+
+bool UVoxelChunkCollision::GetPhysicsTriMeshData(struct FTriMeshCollisionData* CollisionData, bool InUseAllTriData)
+{
+	int32 VertexBase = 0;
+
+	for (int32 BufferIndex = 0; BufferIndex < Buffers.Num(); BufferIndex++)
+	{
+		if (!Buffers[BufferIndex].IsValid())
+		{
+			continue;
+		}
+
+		const FVoxelMeshBuffers& Section = *Buffers[BufferIndex];
+		CollisionData->Vertices.Append(Section.Vertices);
+
+		const int32 NumTriangles = Section.Indices.Num() / 3;
+		for (int32 TriangleIndex = 0; TriangleIndex < NumTriangles; TriangleIndex++)
+		{
+			FTriIndices Triangle;
+			Triangle.v0 = Section.Indices[(TriangleIndex * 3) + 0] + VertexBase;
+			Triangle.v1 = Section.Indices[(TriangleIndex * 3) + 1] + VertexBase;
+			Triangle.v2 = Section.Indices[(TriangleIndex * 3) + 2] + VertexBase;
+			CollisionData->Indices.Add(Triangle);
+
+			// Also store the material info
+			CollisionData->MaterialIndices.Add(BufferIndex);
+		}
+
+		VertexBase = CollisionData->Vertices.Num();
+	}
+
+	CollisionData->bFlipNormals = true;
+
+	return true;
+}
+
+bool UVoxelChunkCollision::ContainsPhysicsTriMeshData(bool InUseAllTriData) const
+{
+	for (const FVoxelMeshBuffersRef& Section : Buffers)
+	{
+		if (Section.IsValid() && Section->Indices.Num() >= 3)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelChunkIndex.h"
+
+// Enough for a few thousand chunks before the table has to grow
+static const uint32 InitialLog2NumSlots = 12;
+
+FVoxelChunkIndex::FVoxelChunkIndex()
+{
+	InitSlots(InitialLog2NumSlots);
+}
+
+void FVoxelChunkIndex::Add(const FIntVector& ChunkCoords, const FEntry& Entry)
+{
+	// Keep the table at most half full
+	if ((NumChunks + 1) * 2 > Slots.Num())
+	{
+		TArray<FSlot> OldSlots = MoveTemp(Slots);
+		InitSlots(FMath::FloorLog2(OldSlots.Num()) + 1);
+
+		NumChunks = 0;
+		for (const FSlot& Slot : OldSlots)
+		{
+			if (Slot.Key != EmptyKey)
+			{
+				Insert(Slot.Key, Slot.Entry);
+			}
+		}
+	}
+
+	Insert(PackCoords(ChunkCoords), Entry);
+}
+
+void FVoxelChunkIndex::Remove(const FIntVector& ChunkCoords)
+{
+	const uint64 Key = PackCoords(ChunkCoords);
+
+	uint32 Hole = GetHomeSlot(Key);
+	for (; Slots[Hole].Key != Key; Hole = (Hole + 1) & SlotMask)
+	{
+		if (Slots[Hole].Key == EmptyKey)
+		{
+			return;
+		}
+	}
+
+	// Rather than leaving a tombstone, shift back any entries after the hole that would have been placed in it if it had been empty.
+	// An entry can move back as long as the hole isn't before its home slot.
+	for (uint32 Next = (Hole + 1) & SlotMask; Slots[Next].Key != EmptyKey; Next = (Next + 1) & SlotMask)
+	{
+		const uint32 Home = GetHomeSlot(Slots[Next].Key);
+		if (((Next - Home) & SlotMask) >= ((Next - Hole) & SlotMask))
+		{
+			Slots[Hole] = Slots[Next];
+			Hole = Next;
+		}
+	}
+
+	Slots[Hole].Key = EmptyKey;
+	Slots[Hole].Entry.Chunk = nullptr;
+	Slots[Hole].Entry.Occupancy = nullptr;
+	NumChunks--;
+}
+
+void FVoxelChunkIndex::Reset()
+{
+	InitSlots(InitialLog2NumSlots);
+	NumChunks = 0;
+}
+
+FIntVector FVoxelChunkIndex::UnpackCoords(uint64 Key)
+{
+	// Shift each coordinate up to the top of an int32 and back down again to sign extend it
+	const int32 SignShift = 32 - CoordBits;
+	return FIntVector(
+		(int32)((uint32)(Key & CoordMask) << SignShift) >> SignShift,
+		(int32)((uint32)((Key >> CoordBits) & CoordMask) << SignShift) >> SignShift,
+		(int32)((uint32)((Key >> (CoordBits * 2)) & CoordMask) << SignShift) >> SignShift);
+}
+
+void FVoxelChunkIndex::InitSlots(uint32 Log2NumSlots)
+{
+	FSlot EmptySlot;
+	EmptySlot.Key = EmptyKey;
+	EmptySlot.Entry.Chunk = nullptr;
+	EmptySlot.Entry.Occupancy = nullptr;
+
+	Slots.Init(EmptySlot, 1 << Log2NumSlots);
+	SlotMask = (1u << Log2NumSlots) - 1;
+	SlotShift = 64 - Log2NumSlots;
+}
+
+void FVoxelChunkIndex::Insert(uint64 Key, const FEntry& Entry)
+{
+	for (uint32 Slot = GetHomeSlot(Key); ; Slot = (Slot + 1) & SlotMask)
+	{
+		FSlot& Candidate = Slots[Slot];
+		if (Candidate.Key == Key)
+		{
+			Candidate.Entry = Entry;
+			return;
+		}
+
+		if (Candidate.Key == EmptyKey)
+		{
+			Candidate.Key = Key;
+			Candidate.Entry = Entry;
+			NumChunks++;
+			return;
+		}
+	}
+}
@@ -0,0 +1,273 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelChunkMesher.h"
+#include "VoxelPaddedChunk.h"
+#include "VoxelTerrainStats.h"
+
+using namespace PolyVox;
+
+FVoxelChunkMesher::FVoxelChunkMesher(int32 NumMaterials)
+{
+	Sections.SetNum(NumMaterials);
+	FaceMasks.SetNumZeroed(VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE * 2);
+
+	// Looked up for every pair of voxels, so keep it as a table
+	for (int32 Material = 0; Material < ARRAY_COUNT(OpaqueMaterials); Material++)
+	{
+		OpaqueMaterials[Material] = IsVoxelMaterialOpaque(Material);
+	}
+}
+
+void FVoxelChunkMesher::MeshChunk(const FVoxelPaddedChunk& Chunk)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelMeshChunk);
+
+	const SIZE_T AllocatedBefore = GetAllocatedSize();
+
+	QuadCorners.Reset();
+	QuadMaterials.Reset();
+
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		FindQuads(Chunk, Axis);
+	}
+
+	WriteSections();
+
+	// Work out whether meshing this chunk had to allocate anything
+	const SIZE_T AllocatedAfter = GetAllocatedSize();
+	if (bWarmedUp && AllocatedAfter != AllocatedBefore)
+	{
+		SteadyStateAllocations++;
+		INC_DWORD_STAT(STAT_VoxelSteadyStateAllocations);
+		UE_LOG(LogVoxelTerrain, Verbose, TEXT("Mesher grew its buffers from %u to %u bytes while meshing a warmed up chunk"), (uint32)AllocatedBefore, (uint32)AllocatedAfter);
+	}
+
+	bWarmedUp = true;
+}
+
+void FVoxelChunkMesher::FindQuads(const FVoxelPaddedChunk& Chunk, int32 Axis)
+{
+	// Each slice is walked along the other two axes
+	const int32 AxisU = (Axis + 1) % 3;
+	const int32 AxisV = (Axis + 2) % 3;
+
+	const int32 Strides[3] = { 1, FVoxelPaddedChunk::StrideY, FVoxelPaddedChunk::StrideZ };
+	const int32 Stride = Strides[Axis];
+	const int32 StrideU = Strides[AxisU];
+	const int32 StrideV = Strides[AxisV];
+
+	const MaterialDensityPair44* Voxels = Chunk.GetData();
+	uint8* NegativeMask = FaceMasks.GetData();
+	uint8* PositiveMask = NegativeMask + VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE;
+
+	// Like PolyVox's cubic extractor, compare each voxel with its neighbour on the negative side of the axis.
+	// Faces on the chunk's upper boundary are left for the next chunk to add.
+	for (int32 Slice = 0; Slice < VOXEL_CHUNK_SIZE; Slice++)
+	{
+		const int32 SliceIndex = FVoxelPaddedChunk::GetIndex(0, 0, 0) + Slice * Stride;
+		int32 MaskIndex = 0;
+
+		for (int32 V = 0; V < VOXEL_CHUNK_SIZE; V++)
+		{
+			int32 Index = SliceIndex + V * StrideV;
+			for (int32 U = 0; U < VOXEL_CHUNK_SIZE; U++, Index += StrideU, MaskIndex++)
+			{
+				const uint8 Current = Voxels[Index].getMaterial();
+				const uint8 Behind = Voxels[Index - Stride].getMaterial();
+
+				// A voxel has a face pointing back along the axis if what's behind it is a different material that can be seen through, and
+				// the other way around. Air is never opaque, and a zero material in the mask means there's no face.
+				NegativeMask[MaskIndex] = (Current != Behind && !OpaqueMaterials[Behind]) ? Current : 0;
+				PositiveMask[MaskIndex] = (Behind != Current && !OpaqueMaterials[Current]) ? Behind : 0;
+			}
+		}
+
+		MergeFaces(NegativeMask, Axis, Slice, false);
+		MergeFaces(PositiveMask, Axis, Slice, true);
+	}
+}
+
+void FVoxelChunkMesher::MergeFaces(uint8* Mask, int32 Axis, int32 Slice, bool bFacesPositive)
+{
+	for (int32 V = 0; V < VOXEL_CHUNK_SIZE; V++)
+	{
+		uint8* MaskRow = Mask + V * VOXEL_CHUNK_SIZE;
+
+		for (int32 U = 0; U < VOXEL_CHUNK_SIZE;)
+		{
+			const uint8 Material = MaskRow[U];
+			if (Material == 0)
+			{
+				U++;
+				continue;
+			}
+
+			// Grow the quad along U for as long as the material carries on
+			int32 Width = 1;
+			while (U + Width < VOXEL_CHUNK_SIZE && MaskRow[U + Width] == Material)
+			{
+				Width++;
+			}
+
+			// Then along V for as long as the whole width carries on
+			int32 Height = 1;
+			for (; V + Height < VOXEL_CHUNK_SIZE; Height++)
+			{
+				const uint8* NextRow = MaskRow + Height * VOXEL_CHUNK_SIZE + U;
+
+				int32 Matching = 0;
+				while (Matching < Width && NextRow[Matching] == Material)
+				{
+					Matching++;
+				}
+
+				if (Matching < Width)
+				{
+					break;
+				}
+			}
+
+			// Clear the faces the quad covers so they don't end up in another one
+			for (int32 Row = 0; Row < Height; Row++)
+			{
+				FMemory::Memzero(MaskRow + Row * VOXEL_CHUNK_SIZE + U, Width);
+			}
+
+			AddQuad(Axis, Slice, U, V, Width, Height, Material, bFacesPositive);
+			U += Width;
+		}
+	}
+}
+
+void FVoxelChunkMesher::AddQuad(int32 Axis, int32 Slice, int32 U, int32 V, int32 Width, int32 Height, uint8 Material, bool bFacesPositive)
+{
+	const int32 AxisU = (Axis + 1) % 3;
+	const int32 AxisV = (Axis + 2) % 3;
+
+	// The corners go around the quad in the same order as PolyVox's, so the winding matches what its extractor produced
+	int32 Corners[4][3];
+	for (int32 Corner = 0; Corner < 4; Corner++)
+	{
+		Corners[Corner][Axis] = Slice;
+	}
+
+	Corners[0][AxisU] = U;
+	Corners[0][AxisV] = V;
+	Corners[1][AxisU] = U;
+	Corners[1][AxisV] = V + Height;
+	Corners[2][AxisU] = U + Width;
+	Corners[2][AxisV] = V + Height;
+	Corners[3][AxisU] = U + Width;
+	Corners[3][AxisV] = V;
+
+	// Quads facing the other way are wound the other way
+	static const int32 NegativeOrder[4] = { 0, 1, 2, 3 };
+	static const int32 PositiveOrder[4] = { 0, 3, 2, 1 };
+	const int32* Order = bFacesPositive ? PositiveOrder : NegativeOrder;
+
+	FVoxelMeshDecoder::FEncodedVertex* Encoded = QuadCorners.GetData() + QuadCorners.AddUninitialized(4);
+	for (int32 Corner = 0; Corner < 4; Corner++)
+	{
+		const int32* Position = Corners[Order[Corner]];
+		Encoded[Corner].encodedPosition = Vector3DUint8(Position[0], Position[1], Position[2]);
+	}
+
+	QuadMaterials.Add(Material);
+}
+
+void FVoxelChunkMesher::WriteSections()
+{
+	const int32 NumQuads = QuadMaterials.Num();
+
+	// Decode every corner in one bulk pass
+	DecodedPositions.SetNumUninitialized(NumQuads * 4, false);
+	FVoxelMeshDecoder::DecodePositions(QuadCorners.GetData(), NumQuads * 4, FVector::ZeroVector, VOXEL_SIZE, DecodedPositions.GetData());
+
+	// Count the quads of each material so that the sections can be sized up front and written without any capacity checks
+	QuadCounts.Reset();
+	QuadCounts.AddZeroed(Sections.Num());
+	for (int32 Quad = 0; Quad < NumQuads; Quad++)
+	{
+		const int32 Material = QuadMaterials[Quad] - 1;
+		if (QuadCounts.IsValidIndex(Material))
+		{
+			QuadCounts[Material]++;
+		}
+	}
+
+	// Where the next quad of each section gets written
+	SectionCursors.Reset();
+	SectionCursors.AddZeroed(Sections.Num());
+	for (int32 Material = 0; Material < Sections.Num(); Material++)
+	{
+		const int32 NumSectionVertices = QuadCounts[Material] * 4;
+		FVoxelMeshBuffers& Section = Sections[Material];
+		Section.Reset();
+		Section.Vertices.SetNumUninitialized(NumSectionVertices, false);
+		Section.Indices.SetNumUninitialized(QuadCounts[Material] * 6, false);
+		Section.Normals.SetNumUninitialized(NumSectionVertices, false);
+		Section.Tangents.SetNumUninitialized(NumSectionVertices, false);
+	}
+
+	const FVector* Positions = DecodedPositions.GetData();
+
+	for (int32 Quad = 0; Quad < NumQuads; Quad++)
+	{
+		const int32 Material = QuadMaterials[Quad] - 1;
+
+		// Skip anything that doesn't have a terrain material assigned to it
+		if (!Sections.IsValidIndex(Material))
+		{
+			continue;
+		}
+
+		const FVector* Corners = Positions + Quad * 4;
+
+		FVoxelMeshBuffers& Section = Sections[Material];
+		const int32 QuadIndex = SectionCursors[Material]++;
+		const int32 First = QuadIndex * 4;
+
+		FVector* Vertices = Section.Vertices.GetData() + First;
+		Vertices[0] = Corners[0];
+		Vertices[1] = Corners[1];
+		Vertices[2] = Corners[2];
+		Vertices[3] = Corners[3];
+
+		// Both triangles need to be wound in reverse or the mesh will be upside down
+		int32* Indices = Section.Indices.GetData() + QuadIndex * 6;
+		Indices[0] = First + 2;
+		Indices[1] = First + 1;
+		Indices[2] = First;
+		Indices[3] = First + 3;
+		Indices[4] = First + 2;
+		Indices[5] = First;
+
+		// The quad is flat, so every corner has the same tangents
+		const FVector Edge01 = Corners[1] - Corners[0];
+		const FVector Edge02 = Corners[2] - Corners[0];
+
+		const FVector TangentX = Edge01.GetSafeNormal();
+		const FVector TangentZ = (Edge01 ^ Edge02).GetSafeNormal();
+
+		FVector* Normals = Section.Normals.GetData() + First;
+		FProcMeshTangent* Tangents = Section.Tangents.GetData() + First;
+		for (int32 Corner = 0; Corner < 4; Corner++)
+		{
+			Tangents[Corner] = FProcMeshTangent(TangentX, false);
+			Normals[Corner] = TangentZ;
+		}
+	}
+}
+
+SIZE_T FVoxelChunkMesher::GetAllocatedSize() const
+{
+	SIZE_T AllocatedSize = FaceMasks.GetAllocatedSize() + QuadCorners.GetAllocatedSize() + QuadMaterials.GetAllocatedSize() + DecodedPositions.GetAllocatedSize();
+	for (const FVoxelMeshBuffers& Section : Sections)
+	{
+		AllocatedSize += Section.GetAllocatedSize();
+	}
+
+	return AllocatedSize;
+}
@@ -0,0 +1,470 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelChunkPipeline.h"
+#include "VoxelChunkMesher.h"
+#include "VoxelVertexCache.h"
+#include "VoxelPaddedChunk.h"
+#include "VoxelTerrainActor.h"
+#include "VoxelTerrainStats.h"
+
+// A worker thread for one of the background stages
+class FVoxelChunkPipeline::FWorker : public FRunnable
+{
+public:
+	FWorker(FVoxelChunkPipeline& InPipeline, EVoxelPipelineStage InStage, int32 WorkerIndex)
+		: Stage(InStage)
+		, Mesher(InPipeline.NumMaterials)
+		, Pipeline(InPipeline)
+		, WorkEvent(FPlatformProcess::GetSynchEventFromPool())
+	{
+		if (Stage == EVoxelPipelineStage::Generate)
+		{
+			NoiseExecutor = Pipeline.Pager->CreateNoiseExecutor();
+		}
+
+		const TCHAR* StageName = Stage == EVoxelPipelineStage::Generate ? TEXT("Generate") : TEXT("Mesh");
+		Thread = FRunnableThread::Create(this, *FString::Printf(TEXT("VoxelTerrain%sWorker%d"), StageName, WorkerIndex), 0, TPri_BelowNormal);
+	}
+
+	virtual ~FWorker()
+	{
+		// Kill calls Stop and waits for Run to return
+		Thread->Kill(true);
+		delete Thread;
+
+		FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+	}
+
+	// FRunnable functions
+	virtual uint32 Run() override
+	{
+		while (!bStopping)
+		{
+			FVoxelChunkJob* Job = Pipeline.PopJob(Stage);
+			if (Job == nullptr)
+			{
+				// Sleep until there's more work. The timeout is just a safety net.
+				WorkEvent->Wait(100);
+				continue;
+			}
+
+			// Cancelled jobs are passed straight back so that they can be retired
+			if (!Job->bCancelled)
+			{
+				if (Stage == EVoxelPipelineStage::Generate)
+				{
+					Pipeline.GenerateChunk(*Job, *this);
+				}
+				else
+				{
+					Pipeline.MeshChunk(*Job, *this);
+				}
+			}
+
+			Pipeline.FinishJob(Stage, Job);
+		}
+
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		bStopping = true;
+		WorkEvent->Trigger();
+	}
+
+	// Wakes the worker up if it's waiting for work
+	void Wake()
+	{
+		WorkEvent->Trigger();
+	}
+
+	// The stage this worker runs
+	const EVoxelPipelineStage Stage;
+
+	// Per thread state for the work itself
+	TUniquePtr<anl::CNoiseExecutor> NoiseExecutor;
+	FVoxelPaddedChunk PaddedChunk;
+	FVoxelChunkMesher Mesher;
+	FVoxelVertexCacheOptimizer VertexCacheOptimizer;
+
+private:
+	FVoxelChunkPipeline& Pipeline;
+	FEvent* WorkEvent;
+	FRunnableThread* Thread;
+	FThreadSafeBool bStopping;
+};
+
+FVoxelChunkPipeline::FVoxelChunkPipeline(FVoxelVolume* InVolume, VoxelTerrainPager* InPager, FCriticalSection* InVolumeLock, int32 InNumMaterials, const TArray<FVoxelPipelineStageSettings>& InStageSettings, bool bInOptimizeVertexCache)
+	: Volume(InVolume)
+	, Pager(InPager)
+	, VolumeLock(InVolumeLock)
+	, NumMaterials(InNumMaterials)
+	, bOptimizeVertexCache(bInOptimizeVertexCache)
+{
+	check(InStageSettings.Num() == (int32)EVoxelPipelineStage::Num);
+
+	for (int32 StageIndex = 0; StageIndex < (int32)EVoxelPipelineStage::Num; StageIndex++)
+	{
+		FStage& Stage = Stages[StageIndex];
+		Stage.Settings = InStageSettings[StageIndex];
+		Stage.Settings.Capacity = FMath::Max(Stage.Settings.Capacity, 1);
+		Stage.Settings.Workers = FMath::Max(Stage.Settings.Workers, 1);
+
+		// Reserve everything up front so that moving jobs around never allocates
+		Stage.Queue.Reserve(Stage.Settings.Capacity);
+		Stage.Finished.Reserve(Stage.Settings.Capacity);
+	}
+
+	// Start the background workers
+	for (EVoxelPipelineStage Stage : { EVoxelPipelineStage::Generate, EVoxelPipelineStage::Mesh })
+	{
+		for (int32 WorkerIndex = 0; WorkerIndex < GetStageSettings(Stage).Workers; WorkerIndex++)
+		{
+			Workers.Add(new FWorker(*this, Stage, WorkerIndex));
+		}
+	}
+}
+
+FVoxelChunkPipeline::~FVoxelChunkPipeline()
+{
+	// Stop the workers before tearing down the jobs they might be working on
+	for (FWorker* Worker : Workers)
+	{
+		delete Worker;
+	}
+
+	for (const auto& Pair : ActiveJobs)
+	{
+		delete Pair.Value;
+	}
+
+	for (FVoxelChunkJob* Job : FreeJobs)
+	{
+		delete Job;
+	}
+}
+
+bool FVoxelChunkPipeline::TryRequestChunk(const FIntVector& ChunkCoords, float Priority, FVoxelChunkJobHandle* OutHandle)
+{
+	FScopeLock Lock(&PipelineLock);
+
+	FVoxelChunkJob* Job = ActiveJobs.FindRef(ChunkCoords);
+	if (Job == nullptr)
+	{
+		FStage& FirstStage = Stages[(int32)EVoxelPipelineStage::Generate];
+		if (!FirstStage.HasRoom())
+		{
+			return false;
+		}
+
+		Job = FreeJobs.Num() > 0 ? FreeJobs.Pop(false) : new FVoxelChunkJob();
+		Job->ChunkCoords = ChunkCoords;
+		Job->Serial = NextSerial++;
+		Job->bCancelled = false;
+
+		// Skip zero when the serial wraps around, since that means an invalid handle
+		if (NextSerial == 0)
+		{
+			NextSerial = 1;
+		}
+
+		FirstStage.Queue.Add(Job);
+		ActiveJobs.Add(ChunkCoords, Job);
+		WakeWorkers(EVoxelPipelineStage::Generate);
+	}
+
+	Job->Priority = Priority;
+
+	if (OutHandle != nullptr)
+	{
+		OutHandle->ChunkCoords = ChunkCoords;
+		OutHandle->Serial = Job->Serial;
+	}
+
+	return true;
+}
+
+bool FVoxelChunkPipeline::IsChunkInFlight(const FIntVector& ChunkCoords) const
+{
+	FScopeLock Lock(&PipelineLock);
+	return ActiveJobs.Contains(ChunkCoords);
+}
+
+FVoxelChunkJobHandle FVoxelChunkPipeline::FindJob(const FIntVector& ChunkCoords) const
+{
+	FScopeLock Lock(&PipelineLock);
+
+	FVoxelChunkJobHandle Handle;
+	if (const FVoxelChunkJob* Job = ActiveJobs.FindRef(ChunkCoords))
+	{
+		Handle.ChunkCoords = ChunkCoords;
+		Handle.Serial = Job->Serial;
+	}
+
+	return Handle;
+}
+
+void FVoxelChunkPipeline::CancelJob(const FVoxelChunkJobHandle& Handle)
+{
+	FScopeLock Lock(&PipelineLock);
+
+	FVoxelChunkJob* Job = ActiveJobs.FindRef(Handle.ChunkCoords);
+	// Dropping a job frees up room that finished jobs further back may be waiting for. Nothing else moves them on when no job is in flight.
+	if (Job != nullptr && Job->Serial == Handle.Serial && CancelJobLocked(Job))
+	{
+		AdvanceJobs();
+	}
+}
+
+void FVoxelChunkPipeline::SetJobPriority(const FVoxelChunkJobHandle& Handle, float Priority)
+{
+	FScopeLock Lock(&PipelineLock);
+
+	FVoxelChunkJob* Job = ActiveJobs.FindRef(Handle.ChunkCoords);
+	if (Job != nullptr && Job->Serial == Handle.Serial)
+	{
+		Job->Priority = Priority;
+	}
+}
+
+void FVoxelChunkPipeline::UpdatePriorities(TFunctionRef<float(const FIntVector&)> GetPriority)
+{
+	FScopeLock Lock(&PipelineLock);
+
+	CancelledScratch.Reset();
+	for (const auto& Pair : ActiveJobs)
+	{
+		FVoxelChunkJob* Job = Pair.Value;
+		Job->Priority = GetPriority(Job->ChunkCoords);
+
+		if (Job->Priority < 0.f)
+		{
+			CancelledScratch.Add(Job);
+		}
+	}
+
+	// Cancelling removes jobs from ActiveJobs, so it can't happen while we're iterating over it
+	bool bFreedRoom = false;
+	for (FVoxelChunkJob* Job : CancelledScratch)
+	{
+		bFreedRoom |= CancelJobLocked(Job);
+	}
+
+	if (bFreedRoom)
+	{
+		AdvanceJobs();
+	}
+}
+
+FVoxelChunkJob* FVoxelChunkPipeline::PopJob(EVoxelPipelineStage Stage)
+{
+	FScopeLock Lock(&PipelineLock);
+
+	FStage& StageInfo = Stages[(int32)Stage];
+	if (StageInfo.Queue.Num() == 0)
+	{
+		return nullptr;
+	}
+
+	// Priorities change as the player moves around, so look for the most important job rather than keeping the queue sorted.
+	// Queues are bounded by the stage's capacity, so this never looks at many jobs.
+	int32 BestIndex = 0;
+	for (int32 Index = 1; Index < StageInfo.Queue.Num(); Index++)
+	{
+		if (StageInfo.Queue[Index]->Priority < StageInfo.Queue[BestIndex]->Priority)
+		{
+			BestIndex = Index;
+		}
+	}
+
+	FVoxelChunkJob* Job = StageInfo.Queue[BestIndex];
+	StageInfo.Queue.RemoveAt(BestIndex, 1, false);
+	StageInfo.NumInFlight++;
+
+	return Job;
+}
+
+void FVoxelChunkPipeline::FinishJob(EVoxelPipelineStage Stage, FVoxelChunkJob* Job)
+{
+	FScopeLock Lock(&PipelineLock);
+
+	FStage& StageInfo = Stages[(int32)Stage];
+	StageInfo.NumInFlight--;
+	StageInfo.Finished.Add(Job);
+
+	AdvanceJobs();
+}
+
+int32 FVoxelChunkPipeline::GetStageDepth(EVoxelPipelineStage Stage) const
+{
+	FScopeLock Lock(&PipelineLock);
+	return Stages[(int32)Stage].GetDepth();
+}
+
+void FVoxelChunkPipeline::Tick()
+{
+	FScopeLock Lock(&PipelineLock);
+
+	SET_DWORD_STAT(STAT_VoxelGenerateQueueDepth, Stages[(int32)EVoxelPipelineStage::Generate].GetDepth());
+	SET_DWORD_STAT(STAT_VoxelMeshQueueDepth, Stages[(int32)EVoxelPipelineStage::Mesh].GetDepth());
+	SET_DWORD_STAT(STAT_VoxelCollisionQueueDepth, Stages[(int32)EVoxelPipelineStage::Collision].GetDepth());
+	SET_DWORD_STAT(STAT_VoxelUploadQueueDepth, Stages[(int32)EVoxelPipelineStage::Upload].GetDepth());
+}
+
+void FVoxelChunkPipeline::AdvanceJobs()
+{
+	// Work backwards so that room freed up at the end of the pipeline can be used by the stages before it straight away
+	for (int32 StageIndex = (int32)EVoxelPipelineStage::Num - 1; StageIndex >= 0; StageIndex--)
+	{
+		FStage& Stage = Stages[StageIndex];
+
+		// Jobs that were cancelled while a worker had them go no further
+		for (int32 Index = Stage.Finished.Num() - 1; Index >= 0; Index--)
+		{
+			if (Stage.Finished[Index]->bCancelled)
+			{
+				RetireJob(Stage.Finished[Index]);
+				Stage.Finished.RemoveAt(Index, 1, false);
+			}
+		}
+
+		if (StageIndex == (int32)EVoxelPipelineStage::Num - 1)
+		{
+			for (FVoxelChunkJob* Job : Stage.Finished)
+			{
+				RetireJob(Job);
+			}
+
+			Stage.Finished.Reset();
+			continue;
+		}
+
+		FStage& NextStage = Stages[StageIndex + 1];
+		int32 NumMoved = 0;
+
+		while (NumMoved < Stage.Finished.Num() && NextStage.HasRoom())
+		{
+			NextStage.Queue.Add(Stage.Finished[NumMoved]);
+			NumMoved++;
+		}
+
+		if (NumMoved > 0)
+		{
+			Stage.Finished.RemoveAt(0, NumMoved, false);
+			WakeWorkers((EVoxelPipelineStage)(StageIndex + 1));
+		}
+	}
+}
+
+void FVoxelChunkPipeline::WakeWorkers(EVoxelPipelineStage Stage)
+{
+	for (FWorker* Worker : Workers)
+	{
+		if (Worker->Stage == Stage)
+		{
+			Worker->Wake();
+		}
+	}
+}
+
+void FVoxelChunkPipeline::RetireJob(FVoxelChunkJob* Job)
+{
+	// A cancelled job has already been replaced in ActiveJobs if its chunk was requested again
+	if (ActiveJobs.FindRef(Job->ChunkCoords) == Job)
+	{
+		ActiveJobs.Remove(Job->ChunkCoords);
+	}
+
+	// Let go of the mesh. The chunk's component holds its own references to it.
+	Job->Sections.Reset();
+	FreeJobs.Add(Job);
+}
+
+bool FVoxelChunkPipeline::CancelJobLocked(FVoxelChunkJob* Job)
+{
+	if (Job->bCancelled)
+	{
+		return false;
+	}
+
+	Job->bCancelled = true;
+	INC_DWORD_STAT(STAT_VoxelCancelledJobs);
+
+	// Forget the job straight away so the chunk can be requested again
+	ActiveJobs.Remove(Job->ChunkCoords);
+
+	// If the job is waiting in a stage, drop it now. Otherwise a worker has it, and it's dropped when the worker finishes with it.
+	for (FStage& Stage : Stages)
+	{
+		if (Stage.Queue.RemoveSingle(Job) > 0 || Stage.Finished.RemoveSingle(Job) > 0)
+		{
+			RetireJob(Job);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void FVoxelChunkPipeline::GenerateChunk(FVoxelChunkJob& Job, FWorker& Worker)
+{
+	const PolyVox::Region Region = GetVoxelChunkRegion(Job.ChunkCoords);
+
+	// Chunks that are already in the volume (e.g. ones that went out of view and came back) keep their voxels and any edits made to them
+	{
+		FScopeLock Lock(VolumeLock);
+		if (Pager->IsChunkPagedIn(Job.ChunkCoords))
+		{
+			return;
+		}
+	}
+
+	// Evaluating the noise is the expensive part, and it doesn't need the volume, so do it without holding the lock
+	Job.Voxels.SetNumUninitialized(VOXEL_CHUNK_VOLUME, false);
+	Pager->GenerateRegion(Region, *Worker.NoiseExecutor, Job.Voxels.GetData());
+
+	// Don't bother paging in a chunk that's no longer needed
+	if (Job.bCancelled)
+	{
+		return;
+	}
+
+	// Touching any voxel in the chunk pages it in, which copies the voxels we just generated into the volume
+	FScopeLock Lock(VolumeLock);
+	Pager->SetPregeneratedVoxels(&Region, Job.Voxels.GetData());
+	Volume->getVoxel(Region.getLowerX(), Region.getLowerY(), Region.getLowerZ());
+	Pager->SetPregeneratedVoxels(nullptr, nullptr);
+}
+
+void FVoxelChunkPipeline::MeshChunk(FVoxelChunkJob& Job, FWorker& Worker)
+{
+	// PagedVolume isn't thread safe, so copying the chunk out of it has to hold the volume's lock. Meshing the copy doesn't.
+	// Neighbours that haven't been generated yet aren't paged in here, since that would generate them while holding the lock. The owner
+	// meshes the chunk again when they arrive.
+	{
+		FScopeLock Lock(VolumeLock);
+		Job.MissingNeighbours = Worker.PaddedChunk.CopyFromChunks(Pager->GetChunkIndex(), Job.ChunkCoords);
+	}
+
+	if (Job.bCancelled)
+	{
+		return;
+	}
+
+	Worker.Mesher.MeshChunk(Worker.PaddedChunk);
+
+	// Move the sections into pooled shared buffers that the chunk's component can hold on to. Optimizing first doesn't get in the way of
+	// sharing, since identical sections come out of it identical.
+	Job.Sections.SetNum(NumMaterials, false);
+	for (int32 Material = 0; Material < NumMaterials; Material++)
+	{
+		if (bOptimizeVertexCache)
+		{
+			Worker.VertexCacheOptimizer.Optimize(Worker.Mesher.GetSection(Material));
+		}
+
+		Job.Sections[Material] = FVoxelMeshBufferPool::Get().Acquire(MoveTemp(Worker.Mesher.GetSection(Material)));
+	}
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelClusterMesh.h"
+#include "VoxelMeshSimplifier.h"
+#include "VoxelVertexCache.h"
+#include "VoxelTerrainStats.h"
+
+FVoxelClusterMergeTask::FVoxelClusterMergeTask(int32 NumMaterials, int32 InTriangleBudget, bool bInMergeMaterials, bool bInOptimizeVertexCache)
+	: ChunkMask(0)
+	, TriangleBudget(InTriangleBudget)
+	, bMergeMaterials(bInMergeMaterials)
+	, bOptimizeVertexCache(bInOptimizeVertexCache)
+{
+	Sections.SetNum(bMergeMaterials ? FMath::Min(NumMaterials, 1) : NumMaterials);
+}
+
+void FVoxelClusterMergeTask::AddChunk(const FIntVector& ChunkOffset, const TArray<FVoxelMeshBuffersRef>& ChunkSections)
+{
+	FChunk& Chunk = Chunks[Chunks.AddDefaulted()];
+	Chunk.Offset = GetVoxelChunkOrigin(ChunkOffset);
+	Chunk.Sections = ChunkSections;
+	ChunkMask |= uint64(1) << GetVoxelClusterChunkIndex(ChunkOffset);
+}
+
+void FVoxelClusterMergeTask::DoWork()
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelMergeCluster);
+
+	for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+	{
+		// The chunk sections that go into this one
+		const int32 FirstMaterial = SectionIndex;
+		const int32 LastMaterial = bMergeMaterials ? MAX_int32 : SectionIndex;
+
+		// Size the section up front so that appending never reallocates
+		int32 NumVertices = 0;
+		int32 NumIndices = 0;
+		for (const FChunk& Chunk : Chunks)
+		{
+			for (int32 Material = FirstMaterial; Material < Chunk.Sections.Num() && Material <= LastMaterial; Material++)
+			{
+				if (Chunk.Sections[Material].IsValid())
+				{
+					NumVertices += Chunk.Sections[Material]->Vertices.Num();
+					NumIndices += Chunk.Sections[Material]->Indices.Num();
+				}
+			}
+		}
+
+		FVoxelMeshBuffers& Section = Sections[SectionIndex];
+		Section.Reset();
+		Section.Vertices.Reserve(NumVertices);
+		Section.Indices.Reserve(NumIndices);
+		Section.Normals.Reserve(NumVertices);
+		Section.Tangents.Reserve(NumVertices);
+
+		for (const FChunk& Chunk : Chunks)
+		{
+			for (int32 Material = FirstMaterial; Material < Chunk.Sections.Num() && Material <= LastMaterial; Material++)
+			{
+				if (!Chunk.Sections[Material].IsValid())
+				{
+					continue;
+				}
+
+				const FVoxelMeshBuffers& Source = *Chunk.Sections[Material];
+				const int32 VertexBase = Section.Vertices.Num();
+
+				for (const FVector& Vertex : Source.Vertices)
+				{
+					Section.Vertices.Add(Vertex + Chunk.Offset);
+				}
+
+				for (int32 Index : Source.Indices)
+				{
+					Section.Indices.Add(Index + VertexBase);
+				}
+
+				Section.Normals.Append(Source.Normals);
+				Section.UV0.Append(Source.UV0);
+				Section.Colors.Append(Source.Colors);
+				Section.Tangents.Append(Source.Tangents);
+			}
+		}
+	}
+
+	// Let go of the chunks' meshes as soon as we're done with them
+	Chunks.Empty();
+
+	int32 NumTriangles = 0;
+	for (const FVoxelMeshBuffers& Section : Sections)
+	{
+		NumTriangles += Section.Indices.Num() / 3;
+	}
+
+	if (TriangleBudget > 0 && NumTriangles > TriangleBudget)
+	{
+		// Faces sit half a voxel below voxel centers, so that's where the cluster's outside faces are
+		const FVector HalfVoxel(VOXEL_SIZE * 0.5f);
+		const FBox Bounds(-HalfVoxel, GetVoxelChunkOrigin(FIntVector(VOXEL_CLUSTER_SIZE, VOXEL_CLUSTER_SIZE, VOXEL_CLUSTER_SIZE)) - HalfVoxel);
+
+		// Share the budget out between the sections by how many triangles they have
+		FVoxelMeshSimplifier Simplifier;
+		for (FVoxelMeshBuffers& Section : Sections)
+		{
+			const int32 SectionBudget = int32(int64(TriangleBudget) * (Section.Indices.Num() / 3) / NumTriangles);
+			Simplifier.Simplify(Section, SectionBudget, Bounds);
+		}
+
+		int32 NumSimplifiedTriangles = 0;
+		for (const FVoxelMeshBuffers& Section : Sections)
+		{
+			NumSimplifiedTriangles += Section.Indices.Num() / 3;
+		}
+
+		INC_DWORD_STAT_BY(STAT_VoxelSimplifyTriangleBudget, TriangleBudget);
+		INC_DWORD_STAT_BY(STAT_VoxelSimplifiedTriangles, NumSimplifiedTriangles);
+
+		// Locked vertices can stop the simplifier short of the budget
+		if (NumSimplifiedTriangles > TriangleBudget)
+		{
+			UE_LOG(LogVoxelTerrain, Verbose, TEXT("Simplified a cluster from %d to %d triangles, over its budget of %d"), NumTriangles, NumSimplifiedTriangles, TriangleBudget);
+		}
+	}
+
+	// Simplified sections are welded, so they gain the most from this
+	if (bOptimizeVertexCache)
+	{
+		FVoxelVertexCacheOptimizer VertexCacheOptimizer;
+		for (FVoxelMeshBuffers& Section : Sections)
+		{
+			VertexCacheOptimizer.Optimize(Section);
+		}
+	}
+}
+
+TStatId FVoxelClusterMergeTask::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(FVoxelClusterMergeTask, STATGROUP_ThreadPoolAsyncTasks);
+}
@@ -0,0 +1,518 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelFluids.h"
+#include "VoxelChunkIndex.h"
+#include "VoxelOccupancy.h"
+#include "VoxelTerrainStats.h"
+#include "Async/ParallelFor.h"
+
+using namespace PolyVox;
+
+namespace
+{
+	const int32 ChunkMask = VOXEL_CHUNK_SIZE - 1;
+
+	// The six neighbours of a voxel. Fluid falls along the last one and levels out along the first four.
+	enum EDirection
+	{
+		PositiveX,
+		NegativeX,
+		PositiveY,
+		NegativeY,
+		PositiveZ,
+		NegativeZ,
+		NumDirections
+	};
+
+	const FIntVector DirectionOffsets[NumDirections] =
+	{
+		FIntVector(1, 0, 0),
+		FIntVector(-1, 0, 0),
+		FIntVector(0, 1, 0),
+		FIntVector(0, -1, 0),
+		FIntVector(0, 0, 1),
+		FIntVector(0, 0, -1)
+	};
+
+	FORCEINLINE bool IsInChunk(int32 X, int32 Y, int32 Z)
+	{
+		return ((X | Y | Z) & ~ChunkMask) == 0;
+	}
+}
+
+bool FVoxelFluidSimulation::AddFluid(const FVoxelChunkIndex& ChunkIndex, const FIntVector& VoxelCoords, EVoxelFluid Fluid, uint8 Level, TSet<FIntVector>& OutDirtyChunks)
+{
+	const FVoxelChunkIndex::FEntry* Entry = ChunkIndex.FindEntry(GetVoxelChunkCoords(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z));
+	if (Entry == nullptr || Level == 0)
+	{
+		return false;
+	}
+
+	const uint8 Material = GetFluidMaterial(Fluid);
+	const uint8 Existing = Entry->Chunk->getVoxel(VoxelCoords.X & ChunkMask, VoxelCoords.Y & ChunkMask, VoxelCoords.Z & ChunkMask).getMaterial();
+	if (Existing != VOXEL_MATERIAL_AIR && Existing != Material)
+	{
+		return false;
+	}
+
+	uint8 Amount = FMath::Min(Level, VOXEL_FLUID_MAX_LEVEL);
+	if (PourInto(*Entry->Chunk, *Entry->Occupancy, VoxelCoords.X & ChunkMask, VoxelCoords.Y & ChunkMask, VoxelCoords.Z & ChunkMask, Material, Amount))
+	{
+		AddChunksMeshingVoxel(VoxelCoords, OutDirtyChunks);
+	}
+
+	WakeVoxel(VoxelCoords);
+	return true;
+}
+
+void FVoxelFluidSimulation::WakeVoxel(const FIntVector& VoxelCoords)
+{
+	ActivateVoxel(VoxelCoords);
+	for (int32 Direction = 0; Direction < NumDirections; Direction++)
+	{
+		ActivateVoxel(VoxelCoords + DirectionOffsets[Direction]);
+	}
+}
+
+void FVoxelFluidSimulation::Step(const FVoxelChunkIndex& ChunkIndex, int32 CellBudget, TSet<FIntVector>& OutDirtyChunks)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelFluidStep);
+
+	StepCount++;
+
+	// Drop chunks that have settled, and ones that were paged out, since their fluid went with them
+	ActiveChunks.Reset();
+	for (auto It = ChunkActiveCells.CreateIterator(); It; ++It)
+	{
+		FVoxelCellList* ActiveCells = It.Value();
+		if (ActiveCells->Num() == 0 || !ChunkIndex.Contains(It.Key()))
+		{
+			ActiveCells->Reset();
+			FreeCellLists.Add(ActiveCells);
+			It.RemoveCurrent();
+			continue;
+		}
+
+		ActiveChunks.Add(It.Key());
+	}
+
+	// Fluid that was left over last step goes back in before anything moves. Spills in chunks that were paged out went with them, and spills
+	// into voxels that have been built over since are displaced by them, the same as fluid that's built over.
+	for (int32 SpillIndex = 0; SpillIndex < Spills.Num();)
+	{
+		FTransfer& Spill = Spills[SpillIndex];
+		const FIntVector& VoxelCoords = Spill.VoxelCoords;
+		const FVoxelChunkIndex::FEntry* Entry = ChunkIndex.FindEntry(GetVoxelChunkCoords(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z));
+		bool bDisplaced = Entry == nullptr;
+		if (Entry != nullptr)
+		{
+			const uint8 Existing = Entry->Chunk->getVoxel(VoxelCoords.X & ChunkMask, VoxelCoords.Y & ChunkMask, VoxelCoords.Z & ChunkMask).getMaterial();
+			bDisplaced = Existing != VOXEL_MATERIAL_AIR && !IsFluidMaterial(Existing);
+		}
+
+		if (!bDisplaced)
+		{
+			if (PourInto(*Entry->Chunk, *Entry->Occupancy, VoxelCoords.X & ChunkMask, VoxelCoords.Y & ChunkMask, VoxelCoords.Z & ChunkMask, Spill.Material, Spill.Amount))
+			{
+				AddChunksMeshingVoxel(VoxelCoords, OutDirtyChunks);
+			}
+
+			WakeVoxel(VoxelCoords);
+		}
+
+		if (bDisplaced || Spill.Amount == 0)
+		{
+			Spills.RemoveAtSwap(SpillIndex, 1, false);
+		}
+		else
+		{
+			SpillIndex++;
+		}
+	}
+
+	// Keep the chunks in a stable order so the budget cursor picks up where it left off
+	ActiveChunks.Sort([](const FIntVector& A, const FIntVector& B)
+	{
+		return A.Z != B.Z ? A.Z < B.Z : (A.Y != B.Y ? A.Y < B.Y : A.X < B.X);
+	});
+
+	// Hand out the budget, starting with the chunks that went short last time, and sort the chunks into their checkerboard passes
+	int32 NumTasks[8] = { 0 };
+	int32 RemainingBudget = FMath::Max(CellBudget, 0);
+	int32 NumServed = 0;
+	const int32 NumActiveChunks = ActiveChunks.Num();
+	const int32 FirstChunk = NumActiveChunks > 0 ? BudgetCursor % NumActiveChunks : 0;
+
+	for (int32 Offset = 0; Offset < NumActiveChunks && RemainingBudget > 0; Offset++)
+	{
+		const FIntVector& ChunkCoords = ActiveChunks[(FirstChunk + Offset) % NumActiveChunks];
+		FVoxelCellList* ActiveCells = ChunkActiveCells.FindChecked(ChunkCoords);
+
+		const int32 NumCells = FMath::Min(ActiveCells->Num(), RemainingBudget);
+		RemainingBudget -= NumCells;
+		if (NumCells == ActiveCells->Num())
+		{
+			NumServed++;
+		}
+
+		const int32 Pass = (ChunkCoords.X & 1) | ((ChunkCoords.Y & 1) << 1) | ((ChunkCoords.Z & 1) << 2);
+		if (NumTasks[Pass] == Passes[Pass].Num())
+		{
+			Passes[Pass].AddDefaulted();
+		}
+
+		FChunkTask& Task = Passes[Pass][NumTasks[Pass]++];
+		Task.ChunkCoords = ChunkCoords;
+		Task.ActiveCells = ActiveCells;
+		Task.Transfers.Reset();
+		Task.Wakes.Reset();
+		Task.Changed.Reset();
+
+		// Take the cells off the front of the list. Anything they wake goes on the end and waits for the next step.
+		ActiveCells->PopFront(NumCells, Task.Cells);
+	}
+
+	BudgetCursor = NumActiveChunks > 0 ? (FirstChunk + NumServed) % NumActiveChunks : 0;
+
+	for (int32 Pass = 0; Pass < 8; Pass++)
+	{
+		TArray<FChunkTask>& Tasks = Passes[Pass];
+		ParallelFor(NumTasks[Pass], [this, &ChunkIndex, &Tasks](int32 TaskIndex)
+		{
+			StepChunk(ChunkIndex, Tasks[TaskIndex]);
+		});
+
+		// The neighbours of this pass's chunks can step in a later pass, so they need to see what flowed into them first
+		for (int32 TaskIndex = 0; TaskIndex < NumTasks[Pass]; TaskIndex++)
+		{
+			ApplyTask(ChunkIndex, Tasks[TaskIndex], OutDirtyChunks);
+		}
+	}
+
+	SET_DWORD_STAT(STAT_VoxelActiveFluidCells, GetNumActiveCells());
+}
+
+int32 FVoxelFluidSimulation::GetNumActiveCells() const
+{
+	int32 NumCells = 0;
+	for (const auto& Pair : ChunkActiveCells)
+	{
+		NumCells += Pair.Value->Num();
+	}
+
+	return NumCells;
+}
+
+void FVoxelFluidSimulation::StepChunk(const FVoxelChunkIndex& ChunkIndex, FChunkTask& Task) const
+{
+	const FVoxelChunkIndex::FEntry* Entry = ChunkIndex.FindEntry(Task.ChunkCoords);
+	check(Entry != nullptr);
+
+	FVoxelVolume::Chunk& Chunk = *Entry->Chunk;
+	FVoxelChunkOccupancy& Occupancy = *Entry->Occupancy;
+	FVoxelCellList& ActiveCells = *Task.ActiveCells;
+	const FIntVector ChunkBase = Task.ChunkCoords * VOXEL_CHUNK_SIZE;
+
+	// Fluid treats chunks that aren't paged in as walls
+	FVoxelVolume::Chunk* Neighbours[NumDirections];
+	for (int32 Direction = 0; Direction < NumDirections; Direction++)
+	{
+		Neighbours[Direction] = ChunkIndex.Find(Task.ChunkCoords + DirectionOffsets[Direction]);
+	}
+
+	// Reads the voxel next to a cell. Returns false if there's nothing to read.
+	auto ReadNeighbour = [&](int32 X, int32 Y, int32 Z, int32 Direction, MaterialDensityPair44& OutVoxel)
+	{
+		const FIntVector Next = FIntVector(X, Y, Z) + DirectionOffsets[Direction];
+		if (IsInChunk(Next.X, Next.Y, Next.Z))
+		{
+			OutVoxel = Chunk.getVoxel(Next.X, Next.Y, Next.Z);
+			return true;
+		}
+
+		if (Neighbours[Direction] == nullptr)
+		{
+			return false;
+		}
+
+		OutVoxel = Neighbours[Direction]->getVoxel(Next.X & ChunkMask, Next.Y & ChunkMask, Next.Z & ChunkMask);
+		return true;
+	};
+
+	// Wakes a cell and its neighbours. Neighbours in other chunks are woken after the pass.
+	auto Wake = [&](int32 X, int32 Y, int32 Z)
+	{
+		ActiveCells.Add(FVoxelCellList::GetCellIndex(X, Y, Z));
+		for (int32 Direction = 0; Direction < NumDirections; Direction++)
+		{
+			const FIntVector Next = FIntVector(X, Y, Z) + DirectionOffsets[Direction];
+			if (IsInChunk(Next.X, Next.Y, Next.Z))
+			{
+				ActiveCells.Add(FVoxelCellList::GetCellIndex(Next.X, Next.Y, Next.Z));
+			}
+			else
+			{
+				Task.Wakes.Add(ChunkBase + Next);
+			}
+		}
+	};
+
+	// Moves fluid into the voxel next to a cell. Fluid leaving the chunk is queued up for after the pass.
+	auto Pour = [&](int32 X, int32 Y, int32 Z, int32 Direction, uint8 Material, uint8 Amount)
+	{
+		const FIntVector Next = FIntVector(X, Y, Z) + DirectionOffsets[Direction];
+		if (!IsInChunk(Next.X, Next.Y, Next.Z))
+		{
+			FTransfer Transfer;
+			Transfer.VoxelCoords = ChunkBase + Next;
+			Transfer.SourceCoords = ChunkBase + FIntVector(X, Y, Z);
+			Transfer.Material = Material;
+			Transfer.Amount = Amount;
+			Task.Transfers.Add(Transfer);
+			return;
+		}
+
+		// The cell's room was checked when it was read, and nothing else in this chunk moves in the meantime, so it all fits
+		uint8 Poured = Amount;
+		if (PourInto(Chunk, Occupancy, Next.X, Next.Y, Next.Z, Material, Poured))
+		{
+			Task.Changed.Add(ChunkBase + Next);
+		}
+
+		Wake(Next.X, Next.Y, Next.Z);
+	};
+
+	// Replaces the voxel in a cell
+	auto SetCell = [&](int32 X, int32 Y, int32 Z, const MaterialDensityPair44& Voxel, uint8 OldMaterial)
+	{
+		Chunk.setVoxel(X, Y, Z, Voxel);
+		Occupancy.OnVoxelChanged(X, Y, Z, Voxel, Chunk);
+
+		if (Voxel.getMaterial() != OldMaterial)
+		{
+			Task.Changed.Add(ChunkBase + FIntVector(X, Y, Z));
+		}
+
+		Wake(X, Y, Z);
+	};
+
+	const bool bLavaFlows = (StepCount % LavaFlowInterval) == 0;
+
+	for (const uint16 CellIndex : Task.Cells)
+	{
+		const int32 X = CellIndex & ChunkMask;
+		const int32 Y = (CellIndex >> VOXEL_CHUNK_SHIFT) & ChunkMask;
+		const int32 Z = CellIndex >> (VOXEL_CHUNK_SHIFT * 2);
+
+		MaterialDensityPair44 Voxel = Chunk.getVoxel(X, Y, Z);
+		const uint8 Material = Voxel.getMaterial();
+		if (!IsFluidMaterial(Material))
+		{
+			continue;
+		}
+
+		MaterialDensityPair44 Target;
+
+		if (Material == VOXEL_MATERIAL_LAVA)
+		{
+			// Lava touching water cools into stone
+			bool bTouchesWater = false;
+			for (int32 Direction = 0; Direction < NumDirections && !bTouchesWater; Direction++)
+			{
+				bTouchesWater = ReadNeighbour(X, Y, Z, Direction, Target) && Target.getMaterial() == VOXEL_MATERIAL_WATER;
+			}
+
+			if (bTouchesWater)
+			{
+				Voxel.setMaterial(VOXEL_MATERIAL_STONE);
+				Voxel.setDensity(VOXEL_FLUID_MAX_LEVEL);
+				SetCell(X, Y, Z, Voxel, Material);
+				continue;
+			}
+
+			// Stay awake until it's lava's turn to flow
+			if (!bLavaFlows)
+			{
+				ActiveCells.Add(CellIndex);
+				continue;
+			}
+		}
+
+		const uint8 Level = Voxel.getDensity();
+		uint8 Remaining = Level;
+
+		// Fall into the voxel below for as long as it has room
+		if (ReadNeighbour(X, Y, Z, NegativeZ, Target))
+		{
+			const uint8 TargetMaterial = Target.getMaterial();
+			const uint8 Room = TargetMaterial == VOXEL_MATERIAL_AIR ? VOXEL_FLUID_MAX_LEVEL : (TargetMaterial == Material ? VOXEL_FLUID_MAX_LEVEL - Target.getDensity() : 0);
+			const uint8 Flow = FMath::Min(Remaining, Room);
+			if (Flow > 0)
+			{
+				Pour(X, Y, Z, NegativeZ, Material, Flow);
+				Remaining -= Flow;
+			}
+		}
+
+		// Level out with the voxels beside it, a unit at a time. Each step starts from a different side so fluid doesn't drift one way.
+		for (int32 Side = 0; Side < 4 && Remaining > 1; Side++)
+		{
+			const int32 Direction = (Side + StepCount) & 3;
+			if (!ReadNeighbour(X, Y, Z, Direction, Target))
+			{
+				continue;
+			}
+
+			const uint8 TargetMaterial = Target.getMaterial();
+			if (TargetMaterial != VOXEL_MATERIAL_AIR && TargetMaterial != Material)
+			{
+				continue;
+			}
+
+			const uint8 TargetLevel = TargetMaterial == VOXEL_MATERIAL_AIR ? 0 : Target.getDensity();
+			if (TargetLevel + 1 < Remaining)
+			{
+				Pour(X, Y, Z, Direction, Material, 1);
+				Remaining--;
+			}
+		}
+
+		// Cells that didn't move have settled and drop off the active list
+		if (Remaining != Level)
+		{
+			if (Remaining == 0)
+			{
+				Voxel.setMaterial(VOXEL_MATERIAL_AIR);
+			}
+
+			Voxel.setDensity(Remaining);
+			SetCell(X, Y, Z, Voxel, Material);
+		}
+	}
+}
+
+void FVoxelFluidSimulation::ApplyTask(const FVoxelChunkIndex& ChunkIndex, FChunkTask& Task, TSet<FIntVector>& OutDirtyChunks)
+{
+	for (const FTransfer& Transfer : Task.Transfers)
+	{
+		// The source has already given the fluid up, so whatever the target can't take goes back to it
+		const FIntVector& VoxelCoords = Transfer.VoxelCoords;
+		const FVoxelChunkIndex::FEntry* Entry = ChunkIndex.FindEntry(GetVoxelChunkCoords(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z));
+		uint8 Amount = Transfer.Amount;
+		if (Entry != nullptr)
+		{
+			if (PourInto(*Entry->Chunk, *Entry->Occupancy, VoxelCoords.X & ChunkMask, VoxelCoords.Y & ChunkMask, VoxelCoords.Z & ChunkMask, Transfer.Material, Amount))
+			{
+				AddChunksMeshingVoxel(VoxelCoords, OutDirtyChunks);
+			}
+
+			WakeVoxel(VoxelCoords);
+		}
+
+		if (Amount > 0)
+		{
+			ReturnFluid(ChunkIndex, Transfer.SourceCoords, Transfer.Material, Amount, OutDirtyChunks);
+		}
+	}
+
+	for (const FIntVector& VoxelCoords : Task.Wakes)
+	{
+		ActivateVoxel(VoxelCoords);
+	}
+
+	for (const FIntVector& VoxelCoords : Task.Changed)
+	{
+		AddChunksMeshingVoxel(VoxelCoords, OutDirtyChunks);
+	}
+}
+
+bool FVoxelFluidSimulation::PourInto(FVoxelVolume::Chunk& Chunk, FVoxelChunkOccupancy& Occupancy, int32 X, int32 Y, int32 Z, uint8 Material, uint8& InOutAmount)
+{
+	MaterialDensityPair44 Voxel = Chunk.getVoxel(X, Y, Z);
+	const uint8 Existing = Voxel.getMaterial();
+
+	if (Existing == Material)
+	{
+		// Just a change of level, which doesn't change the mesh
+		const uint8 Poured = FMath::Min<uint8>(InOutAmount, VOXEL_FLUID_MAX_LEVEL - Voxel.getDensity());
+		Voxel.setDensity(Voxel.getDensity() + Poured);
+		Chunk.setVoxel(X, Y, Z, Voxel);
+		InOutAmount -= Poured;
+		return false;
+	}
+
+	if (Existing == VOXEL_MATERIAL_AIR)
+	{
+		const uint8 Poured = FMath::Min(InOutAmount, VOXEL_FLUID_MAX_LEVEL);
+		Voxel.setMaterial(Material);
+		Voxel.setDensity(Poured);
+		InOutAmount -= Poured;
+	}
+	else if (IsFluidMaterial(Existing))
+	{
+		// Water and lava meeting turn to stone
+		Voxel.setMaterial(VOXEL_MATERIAL_STONE);
+		Voxel.setDensity(VOXEL_FLUID_MAX_LEVEL);
+		InOutAmount = 0;
+	}
+	else
+	{
+		return false;
+	}
+
+	Chunk.setVoxel(X, Y, Z, Voxel);
+	Occupancy.OnVoxelChanged(X, Y, Z, Voxel, Chunk);
+	return true;
+}
+
+void FVoxelFluidSimulation::ReturnFluid(const FVoxelChunkIndex& ChunkIndex, const FIntVector& VoxelCoords, uint8 Material, uint8 Amount, TSet<FIntVector>& OutDirtyChunks)
+{
+	// The source is in the chunk that was just stepped, so it's always paged in. It can still be full again by now if fluid from the cells
+	// stepped after it flowed into it, in which case the rest waits in Spills.
+	const FVoxelChunkIndex::FEntry* Entry = ChunkIndex.FindEntry(GetVoxelChunkCoords(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z));
+	check(Entry != nullptr);
+
+	if (PourInto(*Entry->Chunk, *Entry->Occupancy, VoxelCoords.X & ChunkMask, VoxelCoords.Y & ChunkMask, VoxelCoords.Z & ChunkMask, Material, Amount))
+	{
+		AddChunksMeshingVoxel(VoxelCoords, OutDirtyChunks);
+	}
+
+	WakeVoxel(VoxelCoords);
+
+	if (Amount > 0)
+	{
+		FTransfer& Spill = Spills[Spills.AddUninitialized()];
+		Spill.VoxelCoords = VoxelCoords;
+		Spill.SourceCoords = VoxelCoords;
+		Spill.Material = Material;
+		Spill.Amount = Amount;
+	}
+}
+
+void FVoxelFluidSimulation::ActivateVoxel(const FIntVector& VoxelCoords)
+{
+	FindOrAddActiveCells(GetVoxelChunkCoords(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z)).Add(FVoxelCellList::GetCellIndex(VoxelCoords.X & ChunkMask, VoxelCoords.Y & ChunkMask, VoxelCoords.Z & ChunkMask));
+}
+
+FVoxelCellList& FVoxelFluidSimulation::FindOrAddActiveCells(const FIntVector& ChunkCoords)
+{
+	if (FVoxelCellList** Existing = ChunkActiveCells.Find(ChunkCoords))
+	{
+		return **Existing;
+	}
+
+	FVoxelCellList* ActiveCells = nullptr;
+	if (FreeCellLists.Num() > 0)
+	{
+		ActiveCells = FreeCellLists.Pop(false);
+	}
+	else
+	{
+		ActiveCells = new FVoxelCellList();
+		CellLists.Emplace(ActiveCells);
+	}
+
+	ChunkActiveCells.Add(ChunkCoords, ActiveCells);
+	return *ActiveCells;
+}
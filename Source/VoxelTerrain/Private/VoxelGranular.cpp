@@ -0,0 +1,142 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelGranular.h"
+#include "VoxelAccessor.h"
+#include "VoxelIntegrity.h"
+#include "VoxelTerrainStats.h"
+
+using namespace PolyVox;
+
+namespace
+{
+	// Tells which voxels of a column are in chunks that are paged in, looking each chunk up only once
+	class FColumnChunks
+	{
+	public:
+		FColumnChunks(const FVoxelChunkIndex& InChunkIndex, int32 InX, int32 InY)
+			: ChunkIndex(InChunkIndex)
+			, X(InX)
+			, Y(InY)
+		{}
+
+		FORCEINLINE bool IsLoaded(int32 Z)
+		{
+			const int32 ChunkZ = Z >> VOXEL_CHUNK_SHIFT;
+			if (ChunkZ != LastChunkZ)
+			{
+				LastChunkZ = ChunkZ;
+				bLastLoaded = ChunkIndex.Contains(GetVoxelChunkCoords(X, Y, Z));
+			}
+
+			return bLastLoaded;
+		}
+
+	private:
+		const FVoxelChunkIndex& ChunkIndex;
+		int32 X;
+		int32 Y;
+		int32 LastChunkZ = MIN_int32;
+		bool bLastLoaded = false;
+	};
+}
+
+void FVoxelGranularSimulation::WakeVoxel(const FIntVector& VoxelCoords)
+{
+	WokenVoxels.Add(VoxelCoords);
+}
+
+void FVoxelGranularSimulation::Step(FVoxelVolume* Volume, const FVoxelChunkIndex& ChunkIndex, int32 VoxelBudget, TSet<FIntVector>& OutDirtyChunks, TArray<FIntVector>& OutChangedVoxels, TArray<FIntVector>& OutRemovedVoxels)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelGranularStep);
+
+	// Everything collapses straight into the volume, so a column woken twice sees the first collapse when it's checked again
+	FVoxelAccessor Accessor(Volume, ChunkIndex);
+
+	int32 NumVisited = 0;
+	for (auto It = WokenVoxels.CreateIterator(); It && NumVisited < VoxelBudget; ++It)
+	{
+		NumVisited += CollapseColumn(Accessor, ChunkIndex, *It, OutDirtyChunks, OutChangedVoxels, OutRemovedVoxels);
+		It.RemoveCurrent();
+	}
+
+	SET_DWORD_STAT(STAT_VoxelPendingGranularColumns, WokenVoxels.Num());
+}
+
+int32 FVoxelGranularSimulation::CollapseColumn(FVoxelAccessor& Accessor, const FVoxelChunkIndex& ChunkIndex, const FIntVector& VoxelCoords, TSet<FIntVector>& OutDirtyChunks, TArray<FIntVector>& OutChangedVoxels, TArray<FIntVector>& OutRemovedVoxels)
+{
+	const int32 X = VoxelCoords.X;
+	const int32 Y = VoxelCoords.Y;
+	FColumnChunks Column(ChunkIndex, X, Y);
+
+	// Chunks that aren't paged in are treated as solid ground, and never read or written
+	auto IsSolid = [&](int32 Z)
+	{
+		return !Column.IsLoaded(Z) || FVoxelIntegrityChecker::IsStructural(Accessor.GetVoxel(X, Y, Z));
+	};
+
+	auto IsGranular = [&](int32 Z)
+	{
+		return Column.IsLoaded(Z) && IsGranularMaterial(Accessor.GetVoxel(X, Y, Z).getMaterial());
+	};
+
+	// Either the woken voxel lost what was under it, or the voxel above it did
+	int32 Bottom = VoxelCoords.Z;
+	if (!IsGranular(Bottom) || IsSolid(Bottom - 1))
+	{
+		Bottom++;
+		if (!IsGranular(Bottom) || IsSolid(Bottom - 1))
+		{
+			return 2;
+		}
+	}
+
+	// Find the bottom of the gap and the top of the run of sand and gravel sitting over it
+	int32 Landing = Bottom - 1;
+	while (!IsSolid(Landing - 1))
+	{
+		Landing--;
+	}
+
+	int32 Top = Bottom + 1;
+	while (IsGranular(Top))
+	{
+		Top++;
+	}
+
+	// The run drops to the bottom of the gap in one go, and whatever filled the gap moves up on top of it
+	const int32 RunLength = Top - Bottom;
+	const int32 GapLength = Bottom - Landing;
+
+	OldColumn.Reset();
+	for (int32 Z = Landing; Z < Top; Z++)
+	{
+		OldColumn.Add(Accessor.GetVoxel(X, Y, Z));
+	}
+
+	NewColumn.Reset();
+	NewColumn.Append(OldColumn.GetData() + GapLength, RunLength);
+	NewColumn.Append(OldColumn.GetData(), GapLength);
+
+	for (int32 Index = 0; Index < OldColumn.Num(); Index++)
+	{
+		const MaterialDensityPair44& Old = OldColumn[Index];
+		const MaterialDensityPair44& New = NewColumn[Index];
+		if (Old.getMaterial() == New.getMaterial() && Old.getDensity() == New.getDensity())
+		{
+			continue;
+		}
+
+		const FIntVector Changed(X, Y, Landing + Index);
+		Accessor.SetVoxel(Changed.X, Changed.Y, Changed.Z, New);
+		AddChunksMeshingVoxel(Changed, OutDirtyChunks);
+		OutChangedVoxels.Add(Changed);
+
+		if (FVoxelIntegrityChecker::IsStructural(Old) && !FVoxelIntegrityChecker::IsStructural(New))
+		{
+			OutRemovedVoxels.Add(Changed);
+		}
+	}
+
+	return OldColumn.Num() + 2;
+}
@@ -0,0 +1,209 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelIntegrity.h"
+#include "VoxelChunkIndex.h"
+#include "VoxelAccessor.h"
+
+using namespace PolyVox;
+
+namespace
+{
+	const int32 ChunkMask = VOXEL_CHUNK_SIZE - 1;
+
+	const FIntVector NeighbourOffsets[6] =
+	{
+		FIntVector(1, 0, 0),
+		FIntVector(-1, 0, 0),
+		FIntVector(0, 1, 0),
+		FIntVector(0, -1, 0),
+		FIntVector(0, 0, 1),
+		FIntVector(0, 0, -1)
+	};
+
+	// Reads a voxel without paging its chunk in. Returns false if the chunk isn't paged in.
+	FORCEINLINE bool ReadVoxel(const FVoxelChunkIndex& ChunkIndex, const FIntVector& VoxelCoords, MaterialDensityPair44& OutVoxel)
+	{
+		FVoxelVolume::Chunk* Chunk = ChunkIndex.Find(GetVoxelChunkCoords(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z));
+		if (Chunk == nullptr)
+		{
+			return false;
+		}
+
+		OutVoxel = Chunk->getVoxel(VoxelCoords.X & ChunkMask, VoxelCoords.Y & ChunkMask, VoxelCoords.Z & ChunkMask);
+		return true;
+	}
+}
+
+void FVoxelIntegrityChecker::FindIslands(const FVoxelChunkIndex& ChunkIndex, const TArray<FIntVector>& RemovedVoxels, int32 GroundZ, int32 MaxIslandSize, TArray<TArray<FIntVector>>& OutIslands)
+{
+	Visited.Reset();
+
+	int32 SearchIndex = 0;
+	for (const FIntVector& Removed : RemovedVoxels)
+	{
+		for (const FIntVector& Offset : NeighbourOffsets)
+		{
+			// Voxels an earlier search reached are either supported or already part of an island
+			const FIntVector Seed = Removed + Offset;
+			if (Visited.Contains(Seed))
+			{
+				continue;
+			}
+
+			MaterialDensityPair44 Voxel;
+			if (!ReadVoxel(ChunkIndex, Seed, Voxel) || !IsStructural(Voxel))
+			{
+				continue;
+			}
+
+			if (SearchFrom(ChunkIndex, Seed, SearchIndex++, GroundZ, MaxIslandSize))
+			{
+				OutIslands.Add(Reached);
+			}
+		}
+	}
+}
+
+bool FVoxelIntegrityChecker::SearchFrom(const FVoxelChunkIndex& ChunkIndex, const FIntVector& Seed, int32 SearchIndex, int32 GroundZ, int32 MaxIslandSize)
+{
+	Reached.Reset();
+	Reached.Add(Seed);
+	Visited.Add(Seed, SearchIndex);
+
+	// Reached doubles as the queue, so the voxels of an island are already in one array when the search runs dry
+	for (int32 Next = 0; Next < Reached.Num(); Next++)
+	{
+		const FIntVector Current = Reached[Next];
+		if (Current.Z <= GroundZ)
+		{
+			return false;
+		}
+
+		for (const FIntVector& Offset : NeighbourOffsets)
+		{
+			const FIntVector Neighbour = Current + Offset;
+			if (const int32* VisitedBy = Visited.Find(Neighbour))
+			{
+				// Reaching a voxel from an earlier search means we're connected to it, and it must have been supported or we'd have been part of its island
+				if (*VisitedBy != SearchIndex)
+				{
+					return false;
+				}
+
+				continue;
+			}
+
+			// Chunks that aren't paged in might be holding us up, so count them as support
+			MaterialDensityPair44 Voxel;
+			if (!ReadVoxel(ChunkIndex, Neighbour, Voxel))
+			{
+				return false;
+			}
+
+			if (!IsStructural(Voxel))
+			{
+				continue;
+			}
+
+			// Anything this big is treated as supported. It's cheaper to let the odd overhang float than to search the whole volume.
+			if (Reached.Num() >= MaxIslandSize)
+			{
+				return false;
+			}
+
+			Visited.Add(Neighbour, SearchIndex);
+			Reached.Add(Neighbour);
+		}
+	}
+
+	return true;
+}
+
+uint32 FVoxelFallingDebris::AddIsland(FVoxelVolume* Volume, const FVoxelChunkIndex& ChunkIndex, const TArray<FIntVector>& Voxels, TSet<FIntVector>& OutDirtyChunks, TArray<FIntVector>& OutChangedVoxels)
+{
+	FIsland& Island = Islands[Islands.AddDefaulted()];
+	Island.Id = NextIslandId++;
+	Island.Voxels = Voxels;
+	Island.Contents.SetNumUninitialized(Voxels.Num());
+	Island.Members.Reserve(Voxels.Num());
+
+	// Searches only reach voxels in chunks that are paged in, so the accessor never pages anything in
+	FVoxelAccessor Accessor(Volume, ChunkIndex);
+	const MaterialDensityPair44 Air(VOXEL_MATERIAL_AIR, 0);
+
+	for (int32 Index = 0; Index < Voxels.Num(); Index++)
+	{
+		const FIntVector& Voxel = Voxels[Index];
+		Island.Contents[Index] = Accessor.GetVoxel(Voxel.X, Voxel.Y, Voxel.Z);
+		Island.Members.Add(Voxel);
+
+		Accessor.SetVoxel(Voxel.X, Voxel.Y, Voxel.Z, Air);
+		AddChunksMeshingVoxel(Voxel, OutDirtyChunks);
+		OutChangedVoxels.Add(Voxel);
+	}
+
+	return Island.Id;
+}
+
+void FVoxelFallingDebris::Step(FVoxelVolume* Volume, const FVoxelChunkIndex& ChunkIndex, TSet<FIntVector>& OutDirtyChunks, TArray<FIntVector>& OutChangedVoxels, TArray<FIsland>& OutLandedIslands)
+{
+	FVoxelAccessor Accessor(Volume, ChunkIndex);
+
+	for (int32 IslandIndex = Islands.Num() - 1; IslandIndex >= 0; IslandIndex--)
+	{
+		FIsland& Island = Islands[IslandIndex];
+		if (CanFall(ChunkIndex, Island))
+		{
+			Island.Drop++;
+			continue;
+		}
+
+		// Put the island back where it landed. Fluid that flowed into its way is crushed. Voxels in chunks that have been paged out in the meantime are lost.
+		const FIntVector Offset(0, 0, -Island.Drop);
+		for (int32 Index = 0; Index < Island.Voxels.Num(); Index++)
+		{
+			const FIntVector VoxelCoords = Island.Voxels[Index] + Offset;
+			if (!ChunkIndex.Contains(GetVoxelChunkCoords(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z)))
+			{
+				continue;
+			}
+
+			Accessor.SetVoxel(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z, Island.Contents[Index]);
+			AddChunksMeshingVoxel(VoxelCoords, OutDirtyChunks);
+			OutChangedVoxels.Add(VoxelCoords);
+		}
+
+		OutLandedIslands.Add(MoveTemp(Island));
+		Islands.RemoveAtSwap(IslandIndex);
+	}
+}
+
+bool FVoxelFallingDebris::CanFall(const FVoxelChunkIndex& ChunkIndex, const FIsland& Island) const
+{
+	for (const FIntVector& Voxel : Island.Voxels)
+	{
+		// Don't fall through chunks that have been paged out, since the island couldn't be put back there
+		const FIntVector Current = Voxel - FIntVector(0, 0, Island.Drop);
+		if (!ChunkIndex.Contains(GetVoxelChunkCoords(Current.X, Current.Y, Current.Z)))
+		{
+			return false;
+		}
+
+		// The island can't be blocked by itself
+		const FIntVector Below = Voxel - FIntVector(0, 0, 1);
+		if (Island.Members.Contains(Below))
+		{
+			continue;
+		}
+
+		// Falling into a chunk that isn't paged in would page it in, so treat those as the ground. Fluid in the way is crushed.
+		MaterialDensityPair44 BelowVoxel;
+		if (!ReadVoxel(ChunkIndex, Below - FIntVector(0, 0, Island.Drop), BelowVoxel) || FVoxelIntegrityChecker::IsStructural(BelowVoxel))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
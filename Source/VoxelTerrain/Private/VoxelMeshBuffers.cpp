@@ -0,0 +1,188 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelMeshBuffers.h"
+#include "VoxelTerrainStats.h"
+
+// Hashes the elements of an array along with how many there are
+template<typename ElementType>
+static uint32 HashArray(const TArray<ElementType>& Array, uint32 Crc)
+{
+	const int32 Num = Array.Num();
+	Crc = FCrc::MemCrc32(&Num, sizeof(Num), Crc);
+	return FCrc::MemCrc32(Array.GetData(), Array.Num() * sizeof(ElementType), Crc);
+}
+
+// Whether two arrays hold the same bytes. Only for element types without padding.
+template<typename ElementType>
+static bool ArraysMatch(const TArray<ElementType>& A, const TArray<ElementType>& B)
+{
+	return A.Num() == B.Num() && FMemory::Memcmp(A.GetData(), B.GetData(), A.Num() * sizeof(ElementType)) == 0;
+}
+
+void FVoxelMeshBuffers::Reset()
+{
+	Vertices.Reset();
+	Indices.Reset();
+	Normals.Reset();
+	UV0.Reset();
+	Colors.Reset();
+	Tangents.Reset();
+}
+
+void FVoxelMeshBuffers::SwapWith(FVoxelMeshBuffers& Other)
+{
+	Swap(Vertices, Other.Vertices);
+	Swap(Indices, Other.Indices);
+	Swap(Normals, Other.Normals);
+	Swap(UV0, Other.UV0);
+	Swap(Colors, Other.Colors);
+	Swap(Tangents, Other.Tangents);
+}
+
+SIZE_T FVoxelMeshBuffers::GetAllocatedSize() const
+{
+	return Vertices.GetAllocatedSize() + Indices.GetAllocatedSize() + Normals.GetAllocatedSize() + UV0.GetAllocatedSize() + Colors.GetAllocatedSize() + Tangents.GetAllocatedSize();
+}
+
+uint32 FVoxelMeshBuffers::GetContentHash() const
+{
+	uint32 Crc = 0;
+	Crc = HashArray(Vertices, Crc);
+	Crc = HashArray(Indices, Crc);
+	Crc = HashArray(Normals, Crc);
+	Crc = HashArray(UV0, Crc);
+	Crc = HashArray(Colors, Crc);
+
+	// Tangents have padding after the flip flag, so hash their members rather than their bytes
+	for (const FProcMeshTangent& Tangent : Tangents)
+	{
+		Crc = FCrc::MemCrc32(&Tangent.TangentX, sizeof(Tangent.TangentX), Crc);
+		Crc = FCrc::MemCrc32(&Tangent.bFlipTangentY, sizeof(Tangent.bFlipTangentY), Crc);
+	}
+
+	return Crc;
+}
+
+bool FVoxelMeshBuffers::HasSameContents(const FVoxelMeshBuffers& Other) const
+{
+	if (!ArraysMatch(Vertices, Other.Vertices) || !ArraysMatch(Indices, Other.Indices) || !ArraysMatch(Normals, Other.Normals) ||
+		!ArraysMatch(UV0, Other.UV0) || !ArraysMatch(Colors, Other.Colors) || Tangents.Num() != Other.Tangents.Num())
+	{
+		return false;
+	}
+
+	for (int32 Index = 0; Index < Tangents.Num(); Index++)
+	{
+		if (Tangents[Index].TangentX != Other.Tangents[Index].TangentX || Tangents[Index].bFlipTangentY != Other.Tangents[Index].bFlipTangentY)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+uint32 FVoxelSharedMeshBuffers::AddRef() const
+{
+	return uint32(NumRefs.Increment());
+}
+
+uint32 FVoxelSharedMeshBuffers::Release() const
+{
+	const int32 Refs = NumRefs.Decrement();
+	check(Refs >= 0);
+
+	if (Refs == 0)
+	{
+		FVoxelMeshBufferPool::Get().Return(const_cast<FVoxelSharedMeshBuffers*>(this));
+	}
+
+	return uint32(Refs);
+}
+
+FVoxelMeshBufferPool& FVoxelMeshBufferPool::Get()
+{
+	static FVoxelMeshBufferPool Pool;
+	return Pool;
+}
+
+FVoxelMeshBufferPool::~FVoxelMeshBufferPool()
+{
+	for (FVoxelSharedMeshBuffers* Buffers : FreeList)
+	{
+		delete Buffers;
+	}
+}
+
+FVoxelMeshBuffersRef FVoxelMeshBufferPool::Acquire()
+{
+	FScopeLock Lock(&FreeListLock);
+
+	FVoxelSharedMeshBuffers* Buffers = nullptr;
+	if (FreeList.Num() > 0)
+	{
+		Buffers = FreeList.Pop(false);
+		Buffers->bFree = false;
+	}
+	else
+	{
+		Buffers = new FVoxelSharedMeshBuffers();
+	}
+
+	// Take the reference inside the lock so that a late Return of the same buffers can't put them back in the free list (see Return)
+	return FVoxelMeshBuffersRef(Buffers);
+}
+
+FVoxelMeshBuffersRef FVoxelMeshBufferPool::Acquire(FVoxelMeshBuffers&& Buffers)
+{
+	const uint32 Hash = Buffers.GetContentHash();
+
+	{
+		FScopeLock Lock(&FreeListLock);
+
+		// Buffers that nothing references any more can still be found here until they're returned; taking a reference brings them back
+		for (auto It = LiveBuffers.CreateConstKeyIterator(Hash); It; ++It)
+		{
+			if (It.Value()->HasSameContents(Buffers))
+			{
+				INC_DWORD_STAT(STAT_VoxelSharedMeshSections);
+				FVoxelMeshBuffersRef Shared(It.Value());
+				Buffers.Reset();
+				return Shared;
+			}
+		}
+	}
+
+	FVoxelMeshBuffersRef Shared = Acquire();
+	Shared->SwapWith(Buffers);
+
+	// Two threads acquiring the same contents at once can both end up here. That only costs a copy, so don't hold the lock while swapping.
+	FScopeLock Lock(&FreeListLock);
+	Shared->ContentHash = Hash;
+	Shared->bLive = true;
+	LiveBuffers.Add(Hash, Shared.GetReference());
+	return Shared;
+}
+
+void FVoxelMeshBufferPool::Return(FVoxelSharedMeshBuffers* Buffers)
+{
+	FScopeLock Lock(&FreeListLock);
+
+	// Live buffers can be picked up again by Acquire between losing their last reference and getting here, and then be returned a second time
+	// once the new owner lets go. Only return buffers that nothing references and that haven't been returned already.
+	if (Buffers->NumRefs.GetValue() > 0 || Buffers->bFree)
+	{
+		return;
+	}
+
+	if (Buffers->bLive)
+	{
+		LiveBuffers.RemoveSingle(Buffers->ContentHash, Buffers);
+		Buffers->bLive = false;
+	}
+
+	Buffers->Reset();
+	Buffers->bFree = true;
+	FreeList.Add(Buffers);
+}
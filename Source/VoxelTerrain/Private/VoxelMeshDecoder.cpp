@@ -0,0 +1,54 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelMeshDecoder.h"
+
+#if VOXEL_DECODE_SSE
+#include <emmintrin.h>
+#endif
+
+void FVoxelMeshDecoder::DecodePositions(const FEncodedVertex* Vertices, int32 NumVertices, const FVector& Offset, float Scale, FVector* OutPositions)
+{
+	// PolyVox encodes positions offset by half a voxel, so fold that into the offset along with the scale
+	const FVector Bias = (Offset - FVector(0.5f)) * Scale;
+	int32 VertexIndex = 0;
+
+#if VOXEL_DECODE_SSE
+	// An encoded vertex is three position bytes followed by one byte of voxel data, so one 16 byte load holds four vertices
+	static_assert(sizeof(FEncodedVertex) == 4, "The SSE decoder expects encoded cubic vertices to be 4 bytes");
+
+	const __m128 ScaleVector = _mm_set1_ps(Scale);
+	const __m128 BiasVector = _mm_setr_ps(Bias.X, Bias.Y, Bias.Z, 0.f);
+	const __m128i Zero = _mm_setzero_si128();
+
+	for (; VertexIndex + 4 <= NumVertices; VertexIndex += 4)
+	{
+		const __m128i Packed = _mm_loadu_si128((const __m128i*)(Vertices + VertexIndex));
+
+		// Widen the bytes to 32 bits. Each register ends up holding one vertex as X, Y, Z and its (ignored) voxel data.
+		const __m128i Low = _mm_unpacklo_epi8(Packed, Zero);
+		const __m128i High = _mm_unpackhi_epi8(Packed, Zero);
+
+		const __m128 Position0 = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(Low, Zero)), ScaleVector), BiasVector);
+		const __m128 Position1 = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(Low, Zero)), ScaleVector), BiasVector);
+		const __m128 Position2 = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(High, Zero)), ScaleVector), BiasVector);
+		const __m128 Position3 = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(High, Zero)), ScaleVector), BiasVector);
+
+		// FVector is only 12 bytes, so write the first three with overlapping stores (each store's fourth lane is overwritten by the next one)
+		// and the last one as 8 + 4 bytes so we never write past the end of the output.
+		float* Out = (float*)(OutPositions + VertexIndex);
+		_mm_storeu_ps(Out, Position0);
+		_mm_storeu_ps(Out + 3, Position1);
+		_mm_storeu_ps(Out + 6, Position2);
+		_mm_storel_pi((__m64*)(Out + 9), Position3);
+		_mm_store_ss(Out + 11, _mm_movehl_ps(Position3, Position3));
+	}
+#endif
+
+	// Whatever is left over (or everything, without SSE)
+	for (; VertexIndex < NumVertices; VertexIndex++)
+	{
+		const PolyVox::Vector3DUint8& Encoded = Vertices[VertexIndex].encodedPosition;
+		OutPositions[VertexIndex] = FVector(Encoded.getX(), Encoded.getY(), Encoded.getZ()) * Scale + Bias;
+	}
+}
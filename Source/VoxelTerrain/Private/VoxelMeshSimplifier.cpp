@@ -0,0 +1,515 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelMeshSimplifier.h"
+
+// Packs an edge into a key that's the same whichever way round it's given
+static uint64 GetEdgeKey(int32 A, int32 B)
+{
+	return A < B ? (uint64(uint32(A)) << 32) | uint32(B) : (uint64(uint32(B)) << 32) | uint32(A);
+}
+
+// The face normal of a triangle, scaled by twice its area. The mesher winds its triangles in reverse, so this is the right way round for them.
+static FVector GetFaceNormal(const FVector& P0, const FVector& P1, const FVector& P2)
+{
+	return (P2 - P0) ^ (P1 - P0);
+}
+
+void FVoxelMeshSimplifier::FQuadric::AddPlane(const FVector& N, float D, float Weight)
+{
+	XX += Weight * N.X * N.X; XY += Weight * N.X * N.Y; XZ += Weight * N.X * N.Z; XW += Weight * N.X * D;
+	YY += Weight * N.Y * N.Y; YZ += Weight * N.Y * N.Z; YW += Weight * N.Y * D;
+	ZZ += Weight * N.Z * N.Z; ZW += Weight * N.Z * D;
+	WW += Weight * D * D;
+}
+
+FVoxelMeshSimplifier::FQuadric& FVoxelMeshSimplifier::FQuadric::operator+=(const FQuadric& Other)
+{
+	XX += Other.XX; XY += Other.XY; XZ += Other.XZ; XW += Other.XW;
+	YY += Other.YY; YZ += Other.YZ; YW += Other.YW;
+	ZZ += Other.ZZ; ZW += Other.ZW;
+	WW += Other.WW;
+	return *this;
+}
+
+double FVoxelMeshSimplifier::FQuadric::Evaluate(const FVector& P) const
+{
+	const double X = P.X, Y = P.Y, Z = P.Z;
+	return XX * X * X + 2 * XY * X * Y + 2 * XZ * X * Z + 2 * XW * X
+		+ YY * Y * Y + 2 * YZ * Y * Z + 2 * YW * Y
+		+ ZZ * Z * Z + 2 * ZW * Z
+		+ WW;
+}
+
+bool FVoxelMeshSimplifier::FQuadric::FindMinimum(FVector& OutP) const
+{
+	// Solve the 3x3 system A.P = -B by Cramer's rule
+	const double Det = XX * (YY * ZZ - YZ * YZ) - XY * (XY * ZZ - YZ * XZ) + XZ * (XY * YZ - YY * XZ);
+	if (FMath::Abs(Det) < 1e-6)
+	{
+		return false;
+	}
+
+	const double BX = -XW, BY = -YW, BZ = -ZW;
+	OutP.X = float((BX * (YY * ZZ - YZ * YZ) - XY * (BY * ZZ - YZ * BZ) + XZ * (BY * YZ - YY * BZ)) / Det);
+	OutP.Y = float((XX * (BY * ZZ - YZ * BZ) - BX * (XY * ZZ - YZ * XZ) + XZ * (XY * BZ - BY * XZ)) / Det);
+	OutP.Z = float((XX * (YY * BZ - BY * YZ) - XY * (XY * BZ - BY * XZ) + BX * (XY * YZ - YY * XZ)) / Det);
+	return true;
+}
+
+void FVoxelMeshSimplifier::Simplify(FVoxelMeshBuffers& Buffers, int32 TargetTriangles, const FBox& Bounds)
+{
+	if (Buffers.Indices.Num() / 3 <= TargetTriangles)
+	{
+		return;
+	}
+
+	BuildMesh(Buffers, Bounds);
+
+	Collapses.Reset();
+	for (const auto& Edge : EdgeCounts)
+	{
+		QueueCollapse(int32(Edge.Key >> 32), int32(Edge.Key & 0xffffffff));
+	}
+
+	while (NumLiveTriangles > TargetTriangles && Collapses.Num() > 0)
+	{
+		FCollapse Collapse;
+		Collapses.HeapPop(Collapse, false);
+
+		// Skip collapses that have been overtaken by others around them
+		if (RemovedVertices[Collapse.V0] || RemovedVertices[Collapse.V1] || Stamps[Collapse.V0] != Collapse.Stamp0 || Stamps[Collapse.V1] != Collapse.Stamp1)
+		{
+			continue;
+		}
+
+		if (IsCollapseValid(Collapse))
+		{
+			ApplyCollapse(Collapse);
+		}
+	}
+
+	WriteMesh(Buffers);
+}
+
+void FVoxelMeshSimplifier::BuildMesh(const FVoxelMeshBuffers& Buffers, const FBox& Bounds)
+{
+	// The cubic mesher gives every quad its own corners, so weld them by position or there wouldn't be any edges to collapse
+	WeldedVertices.Reset();
+	Positions.Reset();
+	Remap.Reset();
+	for (const FVector& Vertex : Buffers.Vertices)
+	{
+		int32* Existing = WeldedVertices.Find(Vertex);
+		if (Existing == nullptr)
+		{
+			Existing = &WeldedVertices.Add(Vertex, Positions.Add(Vertex));
+		}
+
+		Remap.Add(*Existing);
+	}
+
+	const int32 NumVertices = Positions.Num();
+	Quadrics.Reset();
+	Quadrics.AddDefaulted(NumVertices);
+	Locked.Reset();
+	Locked.AddZeroed(NumVertices);
+	RemovedVertices.Reset();
+	RemovedVertices.AddZeroed(NumVertices);
+	Stamps.Reset();
+	Stamps.AddZeroed(NumVertices);
+
+	// Keep the inner arrays' allocations from the last mesh
+	VertexTriangles.SetNum(NumVertices);
+	for (TArray<int32>& Adjacent : VertexTriangles)
+	{
+		Adjacent.Reset();
+	}
+
+	// Greedy meshing leaves T-junctions wherever a quad's corner lands part way along a neighbouring quad's edge. Welding can't join those,
+	// so the edge looks open and both ends would be locked. Split each such edge at the vertices on it first, which only needs a lookup of the
+	// vertices on each axis aligned line, since quad edges always run along an axis.
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		LineVertices[Axis].Reset();
+	}
+
+	for (int32 Vertex = 0; Vertex < NumVertices; Vertex++)
+	{
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			FVector Line = Positions[Vertex];
+			Line[Axis] = 0.f;
+			LineVertices[Axis].Add(Line, Vertex);
+		}
+	}
+
+	Triangles.Reset();
+	EdgeCounts.Reset();
+	for (int32 Index = 0; Index + 2 < Buffers.Indices.Num(); Index += 3)
+	{
+		const int32 V[3] = { Remap[Buffers.Indices[Index]], Remap[Buffers.Indices[Index + 1]], Remap[Buffers.Indices[Index + 2]] };
+		if (V[0] == V[1] || V[1] == V[2] || V[2] == V[0])
+		{
+			continue;
+		}
+
+		SplitTriangles.Reset();
+		SplitTriangles.Append(V, 3);
+		while (SplitTriangles.Num() > 0)
+		{
+			int32 Split[3];
+			Split[2] = SplitTriangles.Pop(false);
+			Split[1] = SplitTriangles.Pop(false);
+			Split[0] = SplitTriangles.Pop(false);
+
+			// Cutting a triangle at a vertex on one of its edges gives two triangles with the same winding. Either can still have more to cut.
+			bool bSplit = false;
+			for (int32 Corner = 0; Corner < 3 && !bSplit; Corner++)
+			{
+				const int32 A = Split[Corner];
+				const int32 B = Split[(Corner + 1) % 3];
+				const int32 C = Split[(Corner + 2) % 3];
+				const int32 Middle = FindVertexOnEdge(A, B);
+				if (Middle != INDEX_NONE)
+				{
+					const int32 Halves[6] = { A, Middle, C, Middle, B, C };
+					SplitTriangles.Append(Halves, 6);
+					bSplit = true;
+				}
+			}
+
+			if (!bSplit)
+			{
+				AddTriangle(Split);
+			}
+		}
+	}
+
+	NumLiveTriangles = Triangles.Num() / 3;
+	RemovedTriangles.Reset();
+	RemovedTriangles.AddZeroed(NumLiveTriangles);
+
+	// Open edges are where the mesh meets another one, such as a section of a different material, so they have to stay where they are.
+	// So do edges shared by more than two triangles, since collapsing them could tear the surface.
+	for (const auto& Edge : EdgeCounts)
+	{
+		if (Edge.Value != 2)
+		{
+			Locked[int32(Edge.Key >> 32)] = true;
+			Locked[int32(Edge.Key & 0xffffffff)] = true;
+		}
+	}
+
+	// Lock everything on the faces of the bounds, so the mesh still lines up with its neighbours
+	const float Tolerance = KINDA_SMALL_NUMBER * 100.f;
+	for (int32 Vertex = 0; Vertex < NumVertices; Vertex++)
+	{
+		const FVector& P = Positions[Vertex];
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			if (FMath::Abs(P[Axis] - Bounds.Min[Axis]) <= Tolerance || FMath::Abs(P[Axis] - Bounds.Max[Axis]) <= Tolerance)
+			{
+				Locked[Vertex] = true;
+			}
+		}
+	}
+}
+
+int32 FVoxelMeshSimplifier::FindVertexOnEdge(int32 A, int32 B)
+{
+	const FVector& PA = Positions[A];
+	const FVector& PB = Positions[B];
+
+	// Only axis aligned edges can have T-junctions, since the mesher's diagonals are always inside a quad
+	int32 Axis = INDEX_NONE;
+	int32 NumDifferent = 0;
+	for (int32 Component = 0; Component < 3; Component++)
+	{
+		if (PA[Component] != PB[Component])
+		{
+			Axis = Component;
+			NumDifferent++;
+		}
+	}
+
+	if (NumDifferent != 1)
+	{
+		return INDEX_NONE;
+	}
+
+	FVector Line = PA;
+	Line[Axis] = 0.f;
+
+	const float Min = FMath::Min(PA[Axis], PB[Axis]);
+	const float Max = FMath::Max(PA[Axis], PB[Axis]);
+
+	LineMatches.Reset();
+	LineVertices[Axis].MultiFind(Line, LineMatches);
+	for (int32 Vertex : LineMatches)
+	{
+		const float Position = Positions[Vertex][Axis];
+		if (Position > Min && Position < Max)
+		{
+			return Vertex;
+		}
+	}
+
+	return INDEX_NONE;
+}
+
+void FVoxelMeshSimplifier::AddTriangle(const int32 V[3])
+{
+	const int32 Triangle = Triangles.Num() / 3;
+	Triangles.Append(V, 3);
+
+	const FVector Normal = GetFaceNormal(Positions[V[0]], Positions[V[1]], Positions[V[2]]);
+	const float DoubleArea = Normal.Size();
+	const FVector UnitNormal = DoubleArea > 0.f ? Normal / DoubleArea : FVector::ZeroVector;
+	const float D = -(UnitNormal | Positions[V[0]]);
+
+	for (int32 Corner = 0; Corner < 3; Corner++)
+	{
+		VertexTriangles[V[Corner]].Add(Triangle);
+		Quadrics[V[Corner]].AddPlane(UnitNormal, D, DoubleArea * 0.5f);
+		EdgeCounts.FindOrAdd(GetEdgeKey(V[Corner], V[(Corner + 1) % 3]))++;
+	}
+}
+
+void FVoxelMeshSimplifier::QueueCollapse(int32 V0, int32 V1)
+{
+	// The vertex that stays is the locked one, if either is
+	if (Locked[V1])
+	{
+		Swap(V0, V1);
+	}
+
+	if (Locked[V1])
+	{
+		return;
+	}
+
+	FQuadric Quadric = Quadrics[V0];
+	Quadric += Quadrics[V1];
+
+	FCollapse Collapse;
+	Collapse.V0 = V0;
+	Collapse.V1 = V1;
+	Collapse.Stamp0 = Stamps[V0];
+	Collapse.Stamp1 = Stamps[V1];
+
+	if (Locked[V0])
+	{
+		Collapse.Position = Positions[V0];
+		Collapse.Cost = Quadric.Evaluate(Collapse.Position);
+	}
+	else if (Quadric.FindMinimum(Collapse.Position) && FVector::DistSquared(Collapse.Position, (Positions[V0] + Positions[V1]) * 0.5f) <= FVector::DistSquared(Positions[V0], Positions[V1]))
+	{
+		// Nearly parallel planes can put the minimum miles away, so only trust it when it's close to the edge
+		Collapse.Cost = Quadric.Evaluate(Collapse.Position);
+	}
+	else
+	{
+		// Flat areas have no single best point; any point on the edge will do, so pick whichever end or the middle is cheapest
+		const FVector Candidates[3] = { Positions[V0], Positions[V1], (Positions[V0] + Positions[V1]) * 0.5f };
+		Collapse.Cost = MAX_dbl;
+		for (const FVector& Candidate : Candidates)
+		{
+			const double Cost = Quadric.Evaluate(Candidate);
+			if (Cost < Collapse.Cost)
+			{
+				Collapse.Cost = Cost;
+				Collapse.Position = Candidate;
+			}
+		}
+	}
+
+	Collapses.HeapPush(Collapse);
+}
+
+bool FVoxelMeshSimplifier::IsCollapseValid(const FCollapse& Collapse)
+{
+	const int32 V0 = Collapse.V0;
+	const int32 V1 = Collapse.V1;
+
+	// The link condition: the only vertices next to both ends can be the ones opposite the edge, or the collapse pinches the surface
+	Neighbours.Reset();
+	int32 NumEdgeTriangles = 0;
+	for (int32 Triangle : VertexTriangles[V0])
+	{
+		const int32* V = &Triangles[Triangle * 3];
+		const bool bOnEdge = V[0] == V1 || V[1] == V1 || V[2] == V1;
+		NumEdgeTriangles += bOnEdge ? 1 : 0;
+
+		for (int32 Corner = 0; Corner < 3; Corner++)
+		{
+			if (V[Corner] != V0 && V[Corner] != V1)
+			{
+				Neighbours.AddUnique(V[Corner]);
+			}
+		}
+	}
+
+	int32 NumShared = 0;
+	for (int32 Triangle : VertexTriangles[V1])
+	{
+		const int32* V = &Triangles[Triangle * 3];
+		for (int32 Corner = 0; Corner < 3; Corner++)
+		{
+			if (V[Corner] != V0 && V[Corner] != V1 && Neighbours.Contains(V[Corner]))
+			{
+				NumShared++;
+			}
+		}
+	}
+
+	// V1 is never on an open edge, so every vertex around it is in exactly two of its triangles and each shared neighbour is counted twice
+	if (NumShared > NumEdgeTriangles * 2)
+	{
+		return false;
+	}
+
+	// Don't let any triangle that survives the collapse turn over or shrink to nothing
+	for (int32 End = 0; End < 2; End++)
+	{
+		const int32 Moved = End == 0 ? V0 : V1;
+		for (int32 Triangle : VertexTriangles[Moved])
+		{
+			const int32* V = &Triangles[Triangle * 3];
+			if ((V[0] == V0 || V[1] == V0 || V[2] == V0) && (V[0] == V1 || V[1] == V1 || V[2] == V1))
+			{
+				continue;
+			}
+
+			FVector P[3];
+			FVector Q[3];
+			for (int32 Corner = 0; Corner < 3; Corner++)
+			{
+				P[Corner] = Positions[V[Corner]];
+				Q[Corner] = V[Corner] == Moved ? Collapse.Position : P[Corner];
+			}
+
+			const FVector OldNormal = GetFaceNormal(P[0], P[1], P[2]).GetSafeNormal();
+			const FVector NewNormal = GetFaceNormal(Q[0], Q[1], Q[2]).GetSafeNormal();
+			if (NewNormal.IsZero() || (OldNormal | NewNormal) < 0.2f)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void FVoxelMeshSimplifier::ApplyCollapse(const FCollapse& Collapse)
+{
+	const int32 V0 = Collapse.V0;
+	const int32 V1 = Collapse.V1;
+
+	Positions[V0] = Collapse.Position;
+	Quadrics[V0] += Quadrics[V1];
+	RemovedVertices[V1] = true;
+	Stamps[V0]++;
+
+	for (int32 Triangle : VertexTriangles[V1])
+	{
+		int32* V = &Triangles[Triangle * 3];
+		if (V[0] == V0 || V[1] == V0 || V[2] == V0)
+		{
+			// Triangles on the edge disappear
+			RemovedTriangles[Triangle] = true;
+			NumLiveTriangles--;
+
+			for (int32 Corner = 0; Corner < 3; Corner++)
+			{
+				if (V[Corner] != V1)
+				{
+					VertexTriangles[V[Corner]].RemoveSingleSwap(Triangle, false);
+				}
+			}
+		}
+		else
+		{
+			// The rest are handed over to V0
+			for (int32 Corner = 0; Corner < 3; Corner++)
+			{
+				if (V[Corner] == V1)
+				{
+					V[Corner] = V0;
+				}
+			}
+
+			VertexTriangles[V0].Add(Triangle);
+		}
+	}
+
+	VertexTriangles[V1].Reset();
+
+	// Every edge around V0 has changed cost
+	Neighbours.Reset();
+	for (int32 Triangle : VertexTriangles[V0])
+	{
+		const int32* V = &Triangles[Triangle * 3];
+		for (int32 Corner = 0; Corner < 3; Corner++)
+		{
+			if (V[Corner] != V0)
+			{
+				Neighbours.AddUnique(V[Corner]);
+			}
+		}
+	}
+
+	for (int32 Neighbour : Neighbours)
+	{
+		QueueCollapse(V0, Neighbour);
+	}
+}
+
+void FVoxelMeshSimplifier::WriteMesh(FVoxelMeshBuffers& Buffers)
+{
+	Buffers.Reset();
+
+	// Only keep the vertices that are still used
+	Remap.Reset();
+	Remap.Init(INDEX_NONE, Positions.Num());
+	for (int32 Triangle = 0; Triangle < RemovedTriangles.Num(); Triangle++)
+	{
+		if (RemovedTriangles[Triangle])
+		{
+			continue;
+		}
+
+		for (int32 Corner = 0; Corner < 3; Corner++)
+		{
+			int32& NewIndex = Remap[Triangles[Triangle * 3 + Corner]];
+			if (NewIndex == INDEX_NONE)
+			{
+				NewIndex = Buffers.Vertices.Add(Positions[Triangles[Triangle * 3 + Corner]]);
+			}
+
+			Buffers.Indices.Add(NewIndex);
+		}
+	}
+
+	// Smooth normals, weighted by the area of each triangle
+	Normals.Reset();
+	Normals.AddZeroed(Buffers.Vertices.Num());
+	for (int32 Index = 0; Index < Buffers.Indices.Num(); Index += 3)
+	{
+		const int32* V = &Buffers.Indices[Index];
+		const FVector Normal = GetFaceNormal(Buffers.Vertices[V[0]], Buffers.Vertices[V[1]], Buffers.Vertices[V[2]]);
+		Normals[V[0]] += Normal;
+		Normals[V[1]] += Normal;
+		Normals[V[2]] += Normal;
+	}
+
+	Buffers.Normals.SetNumUninitialized(Normals.Num());
+	Buffers.Tangents.SetNumUninitialized(Normals.Num());
+	for (int32 Vertex = 0; Vertex < Normals.Num(); Vertex++)
+	{
+		const FVector Normal = Normals[Vertex].GetSafeNormal();
+		const FVector Reference = FMath::Abs(Normal.Z) < 0.999f ? FVector::UpVector : FVector::ForwardVector;
+		Buffers.Normals[Vertex] = Normal;
+		Buffers.Tangents[Vertex] = FProcMeshTangent((Reference ^ Normal).GetSafeNormal(), false);
+	}
+}
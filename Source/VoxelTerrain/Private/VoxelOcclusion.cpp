@@ -0,0 +1,250 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelOcclusion.h"
+
+// How close to the camera a point can be and still be projected, in voxels
+static const float OcclusionNearPlane = 0.5f;
+
+FVoxelOcclusionBuffer::FVoxelOcclusionBuffer()
+	: Location(FVector::ZeroVector)
+	, Forward(FVector::ForwardVector)
+	, Right(FVector::RightVector)
+	, Up(FVector::UpVector)
+	, ScaleX(1.f)
+	, ScaleY(1.f)
+{
+	InverseDepths.SetNumZeroed(Width * Height);
+}
+
+void FVoxelOcclusionBuffer::SetView(const FVector& InLocation, const FVector& InForward, const FVector& InRight, const FVector& InUp, float FOV, float AspectRatio)
+{
+	Location = InLocation;
+	Forward = InForward;
+	Right = InRight;
+	Up = InUp;
+
+	const float TanHalfFOV = FMath::Tan(FMath::DegreesToRadians(FMath::Clamp(FOV, 1.f, 170.f) * 0.5f));
+	ScaleX = Width * 0.5f / TanHalfFOV;
+	ScaleY = Height * 0.5f / (TanHalfFOV / FMath::Max(AspectRatio, 0.1f));
+
+	FMemory::Memzero(InverseDepths.GetData(), InverseDepths.Num() * sizeof(float));
+}
+
+void FVoxelOcclusionBuffer::AddChunkOccluders(const FIntVector& ChunkCoords, const FVoxelChunkOccupancy& Occupancy)
+{
+	const int32 BlocksPerSide = FVoxelChunkOccupancy::FineBlocksPerSide;
+	const float BlockSize = FVoxelChunkOccupancy::FineBlockSize;
+
+	// Voxel faces are half a voxel either side of voxel centers
+	const FVector ChunkMin = FVector(ChunkCoords.X, ChunkCoords.Y, ChunkCoords.Z) * VOXEL_CHUNK_SIZE - FVector(0.5f);
+
+	for (int32 BlockY = 0; BlockY < BlocksPerSide; BlockY++)
+	{
+		// Find the longest run of full blocks up each column of the row
+		int32 RunStarts[BlocksPerSide];
+		int32 RunLengths[BlocksPerSide];
+		for (int32 BlockX = 0; BlockX < BlocksPerSide; BlockX++)
+		{
+			const uint64 Bit = 1ull << (BlockX + BlockY * BlocksPerSide);
+			RunStarts[BlockX] = 0;
+			RunLengths[BlockX] = 0;
+
+			int32 Start = 0;
+			for (int32 BlockZ = 0; BlockZ <= BlocksPerSide; BlockZ++)
+			{
+				if (BlockZ < BlocksPerSide && (Occupancy.FullFineBlocks[BlockZ] & Bit))
+				{
+					continue;
+				}
+
+				if (BlockZ - Start > RunLengths[BlockX])
+				{
+					RunStarts[BlockX] = Start;
+					RunLengths[BlockX] = BlockZ - Start;
+				}
+
+				Start = BlockZ + 1;
+			}
+		}
+
+		// Merge neighbouring columns with the same run into one box
+		for (int32 BlockX = 0; BlockX < BlocksPerSide;)
+		{
+			int32 EndX = BlockX + 1;
+			while (EndX < BlocksPerSide && RunStarts[EndX] == RunStarts[BlockX] && RunLengths[EndX] == RunLengths[BlockX])
+			{
+				EndX++;
+			}
+
+			if (RunLengths[BlockX] > 0)
+			{
+				const FVector Min = ChunkMin + FVector(BlockX, BlockY, RunStarts[BlockX]) * BlockSize;
+				AddOccluder(FBox(Min, Min + FVector(EndX - BlockX, 1, RunLengths[BlockX]) * BlockSize));
+			}
+
+			BlockX = EndX;
+		}
+	}
+}
+
+void FVoxelOcclusionBuffer::AddOccluder(const FBox& Box)
+{
+	FVector Corners[8];
+	for (int32 Corner = 0; Corner < 8; Corner++)
+	{
+		const FVector Point((Corner & 1) ? Box.Max.X : Box.Min.X, (Corner & 2) ? Box.Max.Y : Box.Min.Y, (Corner & 4) ? Box.Max.Z : Box.Min.Z);
+		if (!Project(Point, Corners[Corner]))
+		{
+			return;
+		}
+	}
+
+	// Only the faces pointing at the camera can be in front of anything. Each face is its four corners, by index, going round the face.
+	static const int32 Faces[6][4] =
+	{
+		{ 0, 2, 6, 4 }, { 1, 3, 7, 5 },
+		{ 0, 1, 5, 4 }, { 2, 3, 7, 6 },
+		{ 0, 1, 3, 2 }, { 4, 5, 7, 6 },
+	};
+
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		for (int32 Side = 0; Side < 2; Side++)
+		{
+			const bool bFacesCamera = Side == 0 ? Location[Axis] < Box.Min[Axis] : Location[Axis] > Box.Max[Axis];
+			if (bFacesCamera)
+			{
+				const int32* Face = Faces[Axis * 2 + Side];
+				RasterizeQuad(Corners[Face[0]], Corners[Face[1]], Corners[Face[2]], Corners[Face[3]]);
+			}
+		}
+	}
+}
+
+bool FVoxelOcclusionBuffer::IsVisible(const FBox& Box) const
+{
+	FVector ScreenMin(MAX_flt);
+	FVector ScreenMax(-MAX_flt);
+	for (int32 Corner = 0; Corner < 8; Corner++)
+	{
+		const FVector Point((Corner & 1) ? Box.Max.X : Box.Min.X, (Corner & 2) ? Box.Max.Y : Box.Min.Y, (Corner & 4) ? Box.Max.Z : Box.Min.Z);
+
+		// Boxes the camera is in or right next to can't be hidden
+		FVector Screen;
+		if (!Project(Point, Screen))
+		{
+			return true;
+		}
+
+		ScreenMin = ScreenMin.ComponentMin(Screen);
+		ScreenMax = ScreenMax.ComponentMax(Screen);
+	}
+
+	// The box is hidden if every pixel it might touch has an occluder nearer than the nearest corner. Boxes that are off the screen are
+	// left to frustum culling.
+	const int32 MinX = FMath::Max(FMath::FloorToInt(ScreenMin.X), 0);
+	const int32 MinY = FMath::Max(FMath::FloorToInt(ScreenMin.Y), 0);
+	const int32 MaxX = FMath::Min(FMath::CeilToInt(ScreenMax.X), Width);
+	const int32 MaxY = FMath::Min(FMath::CeilToInt(ScreenMax.Y), Height);
+	if (MinX >= MaxX || MinY >= MaxY)
+	{
+		return true;
+	}
+
+	const float NearestInverseDepth = ScreenMax.Z;
+	for (int32 Y = MinY; Y < MaxY; Y++)
+	{
+		const float* Row = InverseDepths.GetData() + Y * Width;
+		for (int32 X = MinX; X < MaxX; X++)
+		{
+			if (Row[X] <= NearestInverseDepth)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool FVoxelOcclusionBuffer::Project(const FVector& Point, FVector& OutScreen) const
+{
+	const FVector Offset = Point - Location;
+	const float Depth = Offset | Forward;
+	if (Depth < OcclusionNearPlane)
+	{
+		return false;
+	}
+
+	const float InverseDepth = 1.f / Depth;
+	OutScreen.X = Width * 0.5f + (Offset | Right) * ScaleX * InverseDepth;
+	OutScreen.Y = Height * 0.5f - (Offset | Up) * ScaleY * InverseDepth;
+	OutScreen.Z = InverseDepth;
+	return true;
+}
+
+void FVoxelOcclusionBuffer::RasterizeQuad(const FVector& A, const FVector& B, const FVector& C, const FVector& D)
+{
+	// Twice the signed area of the first half of the quad. Either winding is fine, since only faces pointing at the camera are drawn.
+	const float Area = (B.X - A.X) * (C.Y - A.Y) - (B.Y - A.Y) * (C.X - A.X);
+	if (FMath::Abs(Area) < KINDA_SMALL_NUMBER)
+	{
+		return;
+	}
+
+	// The face is flat, so one over its depth changes linearly across the screen. Step it from A.
+	const float InverseArea = 1.f / Area;
+	const float DepthStepX = ((B.Z - A.Z) * (C.Y - A.Y) - (C.Z - A.Z) * (B.Y - A.Y)) * InverseArea;
+	const float DepthStepY = ((C.Z - A.Z) * (B.X - A.X) - (B.Z - A.Z) * (C.X - A.X)) * InverseArea;
+
+	// Moving from a pixel's center to the corner of the pixel where the depth is farthest
+	const float DepthMargin = 0.5f * (FMath::Abs(DepthStepX) + FMath::Abs(DepthStepY));
+
+	// The edges going round the quad, flipped so that the inside is positive whichever way round it's wound. Each edge is shrunk by half a
+	// pixel toward its worst corner, so a pixel only passes all four when the quad covers the whole of it.
+	const FVector* Corners[4] = { &A, &B, &C, &D };
+	const float Winding = Area > 0.f ? 1.f : -1.f;
+	float EdgeStepX[4];
+	float EdgeStepY[4];
+	float EdgeOffset[4];
+	for (int32 Edge = 0; Edge < 4; Edge++)
+	{
+		const FVector& Start = *Corners[Edge];
+		const FVector& End = *Corners[(Edge + 1) % 4];
+		EdgeStepX[Edge] = -(End.Y - Start.Y) * Winding;
+		EdgeStepY[Edge] = (End.X - Start.X) * Winding;
+		EdgeOffset[Edge] = -(EdgeStepX[Edge] * Start.X + EdgeStepY[Edge] * Start.Y) - 0.5f * (FMath::Abs(EdgeStepX[Edge]) + FMath::Abs(EdgeStepY[Edge]));
+	}
+
+	const int32 MinX = FMath::Max(FMath::FloorToInt(FMath::Min(FMath::Min(A.X, B.X), FMath::Min(C.X, D.X))), 0);
+	const int32 MinY = FMath::Max(FMath::FloorToInt(FMath::Min(FMath::Min(A.Y, B.Y), FMath::Min(C.Y, D.Y))), 0);
+	const int32 MaxX = FMath::Min(FMath::CeilToInt(FMath::Max(FMath::Max(A.X, B.X), FMath::Max(C.X, D.X))), Width);
+	const int32 MaxY = FMath::Min(FMath::CeilToInt(FMath::Max(FMath::Max(A.Y, B.Y), FMath::Max(C.Y, D.Y))), Height);
+
+	for (int32 Y = MinY; Y < MaxY; Y++)
+	{
+		const float PixelY = Y + 0.5f;
+		float* Row = InverseDepths.GetData() + Y * Width;
+
+		for (int32 X = MinX; X < MaxX; X++)
+		{
+			const float PixelX = X + 0.5f;
+
+			bool bCovered = true;
+			for (int32 Edge = 0; Edge < 4 && bCovered; Edge++)
+			{
+				bCovered = EdgeStepX[Edge] * PixelX + EdgeStepY[Edge] * PixelY + EdgeOffset[Edge] >= 0.f;
+			}
+
+			if (!bCovered)
+			{
+				continue;
+			}
+
+			// Keep the farthest depth the face has anywhere in the pixel, so it never hides something it's only in front of at the center
+			const float InverseDepth = A.Z + DepthStepX * (PixelX - A.X) + DepthStepY * (PixelY - A.Y) - DepthMargin;
+			Row[X] = FMath::Max(Row[X], InverseDepth);
+		}
+	}
+}
@@ -0,0 +1,134 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelOccupancy.h"
+
+// Counts the voxels that pass Test in the fine block starting at (BlockX, BlockY, BlockZ), stopping early once it's found Limit of them
+static int32 CountVoxels(const FVoxelVolume::Chunk& Chunk, int32 BlockX, int32 BlockY, int32 BlockZ, int32 Limit, bool (*Test)(const PolyVox::MaterialDensityPair44&))
+{
+	int32 Count = 0;
+	for (int32 OffsetZ = 0; OffsetZ < FVoxelChunkOccupancy::FineBlockSize; OffsetZ++)
+	{
+		for (int32 OffsetY = 0; OffsetY < FVoxelChunkOccupancy::FineBlockSize; OffsetY++)
+		{
+			for (int32 OffsetX = 0; OffsetX < FVoxelChunkOccupancy::FineBlockSize; OffsetX++)
+			{
+				if (Test(Chunk.getVoxel(BlockX + OffsetX, BlockY + OffsetY, BlockZ + OffsetZ)) && ++Count >= Limit)
+				{
+					return Count;
+				}
+			}
+		}
+	}
+
+	return Count;
+}
+
+void FVoxelChunkOccupancy::Build(const PolyVox::MaterialDensityPair44* Voxels)
+{
+	FMemory::Memzero(FineBlocks);
+
+	// The number of opaque voxels in each fine block, to find the full ones
+	const int32 FineBlockVolume = FineBlockSize * FineBlockSize * FineBlockSize;
+	uint8 OpaqueCounts[FineBlocksPerSide * FineBlocksPerSide * FineBlocksPerSide];
+	FMemory::Memzero(OpaqueCounts);
+
+	for (int32 Z = 0; Z < VOXEL_CHUNK_SIZE; Z++)
+	{
+		uint64& Layer = FineBlocks[Z / FineBlockSize];
+
+		for (int32 Y = 0; Y < VOXEL_CHUNK_SIZE; Y++)
+		{
+			const uint64 RowBit = 1ull << ((Y / FineBlockSize) * FineBlocksPerSide);
+
+			for (int32 X = 0; X < VOXEL_CHUNK_SIZE; X++)
+			{
+				const PolyVox::MaterialDensityPair44& Voxel = *Voxels++;
+				if (IsSolid(Voxel))
+				{
+					Layer |= RowBit << (X / FineBlockSize);
+
+					if (IsOpaque(Voxel))
+					{
+						OpaqueCounts[(X / FineBlockSize) + ((Y / FineBlockSize) + (Z / FineBlockSize) * FineBlocksPerSide) * FineBlocksPerSide]++;
+					}
+				}
+			}
+		}
+	}
+
+	FMemory::Memzero(FullFineBlocks);
+	for (int32 Block = 0; Block < ARRAY_COUNT(OpaqueCounts); Block++)
+	{
+		if (OpaqueCounts[Block] == FineBlockVolume)
+		{
+			FullFineBlocks[Block / (FineBlocksPerSide * FineBlocksPerSide)] |= 1ull << (Block % (FineBlocksPerSide * FineBlocksPerSide));
+		}
+	}
+
+	UpdateCoarseBlocks();
+}
+
+void FVoxelChunkOccupancy::OnVoxelChanged(int32 X, int32 Y, int32 Z, const PolyVox::MaterialDensityPair44& Voxel, const FVoxelVolume::Chunk& Chunk)
+{
+	const uint64 Bit = 1ull << ((X / FineBlockSize) + (Y / FineBlockSize) * FineBlocksPerSide);
+	uint64& Layer = FineBlocks[Z / FineBlockSize];
+	uint64& FullLayer = FullFineBlocks[Z / FineBlockSize];
+
+	const int32 BlockX = X & ~(FineBlockSize - 1);
+	const int32 BlockY = Y & ~(FineBlockSize - 1);
+	const int32 BlockZ = Z & ~(FineBlockSize - 1);
+
+	if (IsSolid(Voxel))
+	{
+		Layer |= Bit;
+
+		// The block might have just been filled in, or had its last opaque voxel swapped for one that can be seen through
+		if (!IsOpaque(Voxel))
+		{
+			FullLayer &= ~Bit;
+		}
+		else if ((FullLayer & Bit) == 0 && CountVoxels(Chunk, BlockX, BlockY, BlockZ, MAX_int32, &IsOpaque) == FineBlockSize * FineBlockSize * FineBlockSize)
+		{
+			FullLayer |= Bit;
+		}
+	}
+	else
+	{
+		FullLayer &= ~Bit;
+
+		// The block might still have other solid voxels in it
+		if ((Layer & Bit) && CountVoxels(Chunk, BlockX, BlockY, BlockZ, 1, &IsSolid) == 0)
+		{
+			Layer &= ~Bit;
+		}
+	}
+
+	UpdateCoarseBlocks();
+}
+
+void FVoxelChunkOccupancy::UpdateCoarseBlocks()
+{
+	// The fine blocks covered by a coarse block are a 4x4 square in each of 4 layers
+	const uint64 SquareMask = 0x0F0F0F0Full;
+	const int32 FinePerCoarse = CoarseBlockSize / FineBlockSize;
+
+	CoarseBlocks = 0;
+	for (int32 CoarseZ = 0; CoarseZ < CoarseBlocksPerSide; CoarseZ++)
+	{
+		const uint64* Layers = FineBlocks + CoarseZ * FinePerCoarse;
+		const uint64 Combined = Layers[0] | Layers[1] | Layers[2] | Layers[3];
+
+		for (int32 CoarseY = 0; CoarseY < CoarseBlocksPerSide; CoarseY++)
+		{
+			for (int32 CoarseX = 0; CoarseX < CoarseBlocksPerSide; CoarseX++)
+			{
+				const uint64 Mask = SquareMask << (CoarseX * FinePerCoarse + CoarseY * FinePerCoarse * FineBlocksPerSide);
+				if (Combined & Mask)
+				{
+					CoarseBlocks |= 1 << (CoarseX + CoarseY * 2 + CoarseZ * 4);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelPaddedChunk.h"
+#include "VoxelChunkIndex.h"
+#include "VoxelTerrainStats.h"
+
+uint32 FVoxelPaddedChunk::CopyFromChunks(const FVoxelChunkIndex& ChunkIndex, const FIntVector& InChunkCoords)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelCopyChunk);
+
+	ChunkCoords = InChunkCoords;
+
+	// Only allocates the first time
+	Voxels.SetNumUninitialized(Size * Size * Size, false);
+
+	// The padded chunk overlaps the chunk itself and all 26 of its neighbours. Copy each one's part in turn, so every chunk is only looked up once.
+	uint32 MissingNeighbours = 0;
+	for (int32 NeighbourZ = -1; NeighbourZ <= 1; NeighbourZ++)
+	{
+		for (int32 NeighbourY = -1; NeighbourY <= 1; NeighbourY++)
+		{
+			for (int32 NeighbourX = -1; NeighbourX <= 1; NeighbourX++)
+			{
+				const FIntVector Neighbour(NeighbourX, NeighbourY, NeighbourZ);
+				FVoxelVolume::Chunk* Chunk = ChunkIndex.Find(ChunkCoords + Neighbour);
+				if (Chunk == nullptr)
+				{
+					MissingNeighbours |= GetNeighbourBit(Neighbour);
+				}
+
+				CopyNeighbour(Chunk, Neighbour);
+			}
+		}
+	}
+
+	return MissingNeighbours;
+}
+
+void FVoxelPaddedChunk::CopyNeighbour(FVoxelVolume::Chunk* Chunk, const FIntVector& Neighbour)
+{
+	// The part of the padded chunk this neighbour covers, relative to our chunk. That's the last layer of neighbours on the negative side,
+	// the whole chunk for ourselves, and the first layer of neighbours on the positive side.
+	int32 Min[3];
+	int32 Max[3];
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		Min[Axis] = Neighbour[Axis] < 0 ? -1 : Neighbour[Axis] * VOXEL_CHUNK_SIZE;
+		Max[Axis] = Neighbour[Axis] > 0 ? VOXEL_CHUNK_SIZE : VOXEL_CHUNK_SIZE - 1 + Neighbour[Axis] * VOXEL_CHUNK_SIZE;
+	}
+
+	// Chunks store their voxels in morton order, so rows aren't contiguous in the chunk. Walk them one row at a time into our flat array.
+	const FIntVector ToLocal = Neighbour * -VOXEL_CHUNK_SIZE;
+	for (int32 Z = Min[2]; Z <= Max[2]; Z++)
+	{
+		for (int32 Y = Min[1]; Y <= Max[1]; Y++)
+		{
+			PolyVox::MaterialDensityPair44* Row = Voxels.GetData() + GetIndex(Min[0], Y, Z);
+			if (Chunk == nullptr)
+			{
+				FMemory::Memzero(Row, (Max[0] - Min[0] + 1) * sizeof(PolyVox::MaterialDensityPair44));
+				continue;
+			}
+
+			for (int32 X = Min[0]; X <= Max[0]; X++)
+			{
+				*Row++ = Chunk->getVoxel(X + ToLocal.X, Y + ToLocal.Y, Z + ToLocal.Z);
+			}
+		}
+	}
+}
@@ -0,0 +1,395 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelRaycast.h"
+#include "VoxelChunkIndex.h"
+#include "VoxelOccupancy.h"
+#include "VoxelTerrainStats.h"
+
+#if VOXEL_RAYCAST_SSE
+#include <emmintrin.h>
+#endif
+
+// Returns the cell a trace is in at a coordinate, going in the given direction. A trace sitting exactly on a boundary is in the cell it's heading into.
+static FORCEINLINE int32 GetCellAt(float Coordinate, float Direction)
+{
+	return Direction < 0.f ? FMath::CeilToInt(Coordinate) - 1 : FMath::FloorToInt(Coordinate);
+}
+
+bool FVoxelRaycaster::Raycast(const FVoxelChunkIndex& ChunkIndex, const FVector& Start, const FVector& End, FVoxelRaycastHit& OutHit)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelRaycast);
+
+	// Work in a space where voxel X covers [X, X + 1), so cells line up with whole numbers
+	const FVector Origin = Start + FVector(0.5f);
+	const FVector Direction = End - Start;
+
+	FIntVector Cell(FMath::FloorToInt(Origin.X), FMath::FloorToInt(Origin.Y), FMath::FloorToInt(Origin.Z));
+	FVector Normal = FVector::ZeroVector;
+	float Time = 0.f;
+
+	// Traces usually spend a while in each chunk, so remember the last one
+	FIntVector LastChunkCoords = GetVoxelChunkCoords(Cell.X, Cell.Y, Cell.Z);
+	const FVoxelChunkIndex::FEntry* LastEntry = ChunkIndex.FindEntry(LastChunkCoords);
+	FVoxelChunkIndex::FEntry Entry = LastEntry != nullptr ? *LastEntry : FVoxelChunkIndex::FEntry{ nullptr, nullptr };
+
+	while (true)
+	{
+		const FIntVector ChunkCoords = GetVoxelChunkCoords(Cell.X, Cell.Y, Cell.Z);
+		if (ChunkCoords != LastChunkCoords)
+		{
+			LastChunkCoords = ChunkCoords;
+			LastEntry = ChunkIndex.FindEntry(ChunkCoords);
+			Entry = LastEntry != nullptr ? *LastEntry : FVoxelChunkIndex::FEntry{ nullptr, nullptr };
+		}
+
+		// Find the biggest empty box around the cell, or stop if the cell is solid
+		int32 BoxSize = VOXEL_CHUNK_SIZE;
+		if (Entry.Chunk != nullptr && !Entry.Occupancy->IsEmpty())
+		{
+			const int32 ChunkMask = VOXEL_CHUNK_SIZE - 1;
+			const int32 LocalX = Cell.X & ChunkMask;
+			const int32 LocalY = Cell.Y & ChunkMask;
+			const int32 LocalZ = Cell.Z & ChunkMask;
+
+			if (Entry.Occupancy->IsCoarseBlockEmpty(LocalX, LocalY, LocalZ))
+			{
+				BoxSize = FVoxelChunkOccupancy::CoarseBlockSize;
+			}
+			else if (Entry.Occupancy->IsFineBlockEmpty(LocalX, LocalY, LocalZ))
+			{
+				BoxSize = FVoxelChunkOccupancy::FineBlockSize;
+			}
+			else
+			{
+				const PolyVox::MaterialDensityPair44 Voxel = Entry.Chunk->getVoxel(LocalX, LocalY, LocalZ);
+				if (FVoxelChunkOccupancy::BlocksTraces(Voxel))
+				{
+					OutHit.bHit = true;
+					OutHit.Location = Start + Direction * Time;
+					OutHit.Normal = Normal;
+					OutHit.Time = Time;
+					OutHit.Material = Voxel.getMaterial();
+					OutHit.VoxelCoords = Cell;
+					return true;
+				}
+
+				BoxSize = 1;
+			}
+		}
+
+		// Boxes are aligned to their size, so masking off the low bits finds the corner even for negative coordinates
+		const FIntVector BoxMin(Cell.X & ~(BoxSize - 1), Cell.Y & ~(BoxSize - 1), Cell.Z & ~(BoxSize - 1));
+		const FIntVector BoxMax = BoxMin + FIntVector(BoxSize);
+
+		// Find where the trace leaves the box
+		float ExitTime = BIG_NUMBER;
+		int32 ExitAxis = -1;
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			if (Direction[Axis] != 0.f)
+			{
+				const float Boundary = Direction[Axis] > 0.f ? BoxMax[Axis] : BoxMin[Axis];
+				const float AxisTime = (Boundary - Origin[Axis]) / Direction[Axis];
+				if (AxisTime < ExitTime)
+				{
+					ExitTime = AxisTime;
+					ExitAxis = Axis;
+				}
+			}
+		}
+
+		if (ExitAxis < 0 || ExitTime > 1.f)
+		{
+			return false;
+		}
+
+		// Step into the next cell. The axis we left through steps exactly; the others are worked out from where the trace is now, but kept inside the box
+		// so rounding can't make us skip anything. If the trace left through an edge or corner, the next pass steps across the other axes straight away.
+		Time = ExitTime;
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			if (Axis == ExitAxis)
+			{
+				Cell[Axis] = Direction[Axis] > 0.f ? BoxMax[Axis] : BoxMin[Axis] - 1;
+			}
+			else
+			{
+				Cell[Axis] = FMath::Clamp(GetCellAt(Origin[Axis] + Direction[Axis] * Time, Direction[Axis]), BoxMin[Axis], BoxMax[Axis] - 1);
+			}
+		}
+
+		Normal = FVector::ZeroVector;
+		Normal[ExitAxis] = Direction[ExitAxis] > 0.f ? -1.f : 1.f;
+	}
+}
+
+// A small cache of chunk lookups shared by all of the rays in a packet
+class FVoxelPacketChunkCache
+{
+public:
+	FVoxelPacketChunkCache(const FVoxelChunkIndex& InChunkIndex)
+		: ChunkIndex(InChunkIndex)
+	{
+		FMemory::Memzero(bValid);
+	}
+
+	// Returns the chunk and occupancy at the given coordinates. Both are null if the chunk isn't paged in.
+	FORCEINLINE const FVoxelChunkIndex::FEntry& Get(const FIntVector& ChunkCoords)
+	{
+		const uint32 Slot = (ChunkCoords.X * 73856093u ^ ChunkCoords.Y * 19349663u ^ ChunkCoords.Z * 83492791u) & (NumSlots - 1);
+		if (!bValid[Slot] || Coords[Slot] != ChunkCoords)
+		{
+			const FVoxelChunkIndex::FEntry* Entry = ChunkIndex.FindEntry(ChunkCoords);
+			Entries[Slot] = Entry != nullptr ? *Entry : FVoxelChunkIndex::FEntry{ nullptr, nullptr };
+			Coords[Slot] = ChunkCoords;
+			bValid[Slot] = true;
+		}
+
+		return Entries[Slot];
+	}
+
+private:
+	static const uint32 NumSlots = 16;
+
+	const FVoxelChunkIndex& ChunkIndex;
+	FIntVector Coords[NumSlots];
+	FVoxelChunkIndex::FEntry Entries[NumSlots];
+	bool bValid[NumSlots];
+};
+
+// Returns the size of the biggest empty box around a cell, or 0 if the cell is solid (in which case its voxel is written to OutVoxel)
+static FORCEINLINE int32 GetEmptyBoxSize(FVoxelPacketChunkCache& Cache, int32 X, int32 Y, int32 Z, PolyVox::MaterialDensityPair44& OutVoxel)
+{
+	const FVoxelChunkIndex::FEntry& Entry = Cache.Get(GetVoxelChunkCoords(X, Y, Z));
+	if (Entry.Chunk == nullptr || Entry.Occupancy->IsEmpty())
+	{
+		return VOXEL_CHUNK_SIZE;
+	}
+
+	const int32 ChunkMask = VOXEL_CHUNK_SIZE - 1;
+	const int32 LocalX = X & ChunkMask;
+	const int32 LocalY = Y & ChunkMask;
+	const int32 LocalZ = Z & ChunkMask;
+
+	if (Entry.Occupancy->IsCoarseBlockEmpty(LocalX, LocalY, LocalZ))
+	{
+		return FVoxelChunkOccupancy::CoarseBlockSize;
+	}
+
+	if (Entry.Occupancy->IsFineBlockEmpty(LocalX, LocalY, LocalZ))
+	{
+		return FVoxelChunkOccupancy::FineBlockSize;
+	}
+
+	OutVoxel = Entry.Chunk->getVoxel(LocalX, LocalY, LocalZ);
+	return FVoxelChunkOccupancy::BlocksTraces(OutVoxel) ? 0 : 1;
+}
+
+#if VOXEL_RAYCAST_SSE
+
+// The state of four rays, one per SSE lane, laid out so each axis can be loaded straight into a register
+struct FVoxelRayLanes
+{
+	static const int32 NumLanes = 4;
+
+	MS_ALIGN(16) float Origin[3][NumLanes] GCC_ALIGN(16);
+	MS_ALIGN(16) float Direction[3][NumLanes] GCC_ALIGN(16);
+	MS_ALIGN(16) int32 Cell[3][NumLanes] GCC_ALIGN(16);
+	MS_ALIGN(16) int32 BoxSize[NumLanes] GCC_ALIGN(16);
+	MS_ALIGN(16) int32 ExitAxis[NumLanes] GCC_ALIGN(16);
+	MS_ALIGN(16) float Time[NumLanes] GCC_ALIGN(16);
+};
+
+// Selects between two registers with a mask, since SSE2 doesn't have blends
+static FORCEINLINE __m128i SelectInt(__m128i Mask, __m128i IfTrue, __m128i IfFalse)
+{
+	return _mm_or_si128(_mm_and_si128(Mask, IfTrue), _mm_andnot_si128(Mask, IfFalse));
+}
+
+static FORCEINLINE __m128 SelectFloat(__m128 Mask, __m128 IfTrue, __m128 IfFalse)
+{
+	return _mm_or_ps(_mm_and_ps(Mask, IfTrue), _mm_andnot_ps(Mask, IfFalse));
+}
+
+// Floor for values that fit in an int32. SSE2 only has truncation, so truncate and step down wherever that rounded up.
+static FORCEINLINE __m128i FloorToInt(__m128 Value)
+{
+	const __m128i Truncated = _mm_cvttps_epi32(Value);
+	const __m128 RoundedUp = _mm_cmpgt_ps(_mm_cvtepi32_ps(Truncated), Value);
+	return _mm_add_epi32(Truncated, _mm_castps_si128(RoundedUp));
+}
+
+// Moves every lane out of the empty box around its cell, exactly like the single ray loop in FVoxelRaycaster::Raycast.
+// Returns a mask with a bit set for each lane that left the end of its ray without hitting anything.
+static int32 StepRayLanes(FVoxelRayLanes& Lanes)
+{
+	const __m128i Zero = _mm_setzero_si128();
+	const __m128i One = _mm_set1_epi32(1);
+	const __m128 Infinity = _mm_set1_ps(BIG_NUMBER);
+	const __m128i BoxSize = _mm_load_si128((const __m128i*)Lanes.BoxSize);
+
+	__m128i BoxMin[3];
+	__m128i BoxMax[3];
+	__m128 DirectionPositive[3];
+	__m128 DirectionNegative[3];
+	__m128 AxisTime[3];
+
+	// Find where each lane leaves its box along each axis
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		const __m128i Cell = _mm_load_si128((const __m128i*)Lanes.Cell[Axis]);
+		const __m128 Origin = _mm_load_ps(Lanes.Origin[Axis]);
+		const __m128 Direction = _mm_load_ps(Lanes.Direction[Axis]);
+
+		// Boxes are aligned to their size, which is a power of two, so the corner is the cell with the low bits masked off (-Size == ~(Size - 1))
+		BoxMin[Axis] = _mm_and_si128(Cell, _mm_sub_epi32(Zero, BoxSize));
+		BoxMax[Axis] = _mm_add_epi32(BoxMin[Axis], BoxSize);
+
+		DirectionPositive[Axis] = _mm_cmpgt_ps(Direction, _mm_setzero_ps());
+		DirectionNegative[Axis] = _mm_cmplt_ps(Direction, _mm_setzero_ps());
+
+		const __m128i Boundary = SelectInt(_mm_castps_si128(DirectionPositive[Axis]), BoxMax[Axis], BoxMin[Axis]);
+		const __m128 Time = _mm_div_ps(_mm_sub_ps(_mm_cvtepi32_ps(Boundary), Origin), Direction);
+
+		// Lanes that aren't moving along this axis never leave through it (and divided by zero above)
+		const __m128 Moving = _mm_or_ps(DirectionPositive[Axis], DirectionNegative[Axis]);
+		AxisTime[Axis] = SelectFloat(Moving, Time, Infinity);
+	}
+
+	// The first axis each lane leaves through, preferring X, then Y, then Z on ties like the single ray loop
+	const __m128 ExitTime = _mm_min_ps(AxisTime[0], _mm_min_ps(AxisTime[1], AxisTime[2]));
+	__m128 ExitThrough[3];
+	ExitThrough[0] = _mm_cmpeq_ps(AxisTime[0], ExitTime);
+	ExitThrough[1] = _mm_andnot_ps(ExitThrough[0], _mm_cmpeq_ps(AxisTime[1], ExitTime));
+	ExitThrough[2] = _mm_andnot_ps(_mm_or_ps(ExitThrough[0], ExitThrough[1]), _mm_castsi128_ps(_mm_cmpeq_epi32(Zero, Zero)));
+
+	_mm_store_ps(Lanes.Time, ExitTime);
+
+	const __m128i ExitAxis = _mm_add_epi32(_mm_and_si128(_mm_castps_si128(ExitThrough[1]), One), _mm_and_si128(_mm_castps_si128(ExitThrough[2]), _mm_set1_epi32(2)));
+	_mm_store_si128((__m128i*)Lanes.ExitAxis, ExitAxis);
+
+	// Step each lane into its next cell
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		const __m128 Origin = _mm_load_ps(Lanes.Origin[Axis]);
+		const __m128 Direction = _mm_load_ps(Lanes.Direction[Axis]);
+		const __m128 Position = _mm_add_ps(Origin, _mm_mul_ps(Direction, ExitTime));
+
+		// The cell the lane is heading into along this axis: floor for positive directions and ceil - 1 (which is -floor(-x) - 1) for negative ones
+		const __m128i Negative = _mm_castps_si128(DirectionNegative[Axis]);
+		const __m128 Mirrored = SelectFloat(DirectionNegative[Axis], _mm_sub_ps(_mm_setzero_ps(), Position), Position);
+		const __m128i Floored = FloorToInt(Mirrored);
+		__m128i Cell = SelectInt(Negative, _mm_sub_epi32(_mm_sub_epi32(Zero, Floored), One), Floored);
+
+		// Keep it inside the box so rounding can't skip anything. SSE2 has no integer min and max, so compare and select.
+		const __m128i Last = _mm_sub_epi32(BoxMax[Axis], One);
+		Cell = SelectInt(_mm_cmplt_epi32(Cell, BoxMin[Axis]), BoxMin[Axis], Cell);
+		Cell = SelectInt(_mm_cmpgt_epi32(Cell, Last), Last, Cell);
+
+		// The axis the lane left through steps exactly
+		const __m128i ExitCell = SelectInt(_mm_castps_si128(DirectionPositive[Axis]), BoxMax[Axis], _mm_sub_epi32(BoxMin[Axis], One));
+		Cell = SelectInt(_mm_castps_si128(ExitThrough[Axis]), ExitCell, Cell);
+
+		_mm_store_si128((__m128i*)Lanes.Cell[Axis], Cell);
+	}
+
+	return _mm_movemask_ps(_mm_cmpgt_ps(ExitTime, _mm_set1_ps(1.f)));
+}
+
+#endif
+
+void FVoxelRaycaster::RaycastPacket(const FVoxelChunkIndex& ChunkIndex, const FVector* Starts, const FVector* Ends, int32 NumRays, FVoxelRaycastHit* OutHits)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelRaycast);
+
+	FVoxelPacketChunkCache Cache(ChunkIndex);
+
+#if VOXEL_RAYCAST_SSE
+	for (int32 FirstRay = 0; FirstRay < NumRays; FirstRay += FVoxelRayLanes::NumLanes)
+	{
+		const int32 NumLanes = FMath::Min(NumRays - FirstRay, (int32)FVoxelRayLanes::NumLanes);
+
+		// Set up the lanes the same way the single ray loop sets up its ray. Spare lanes in the last packet start out finished.
+		FVoxelRayLanes Lanes;
+		int32 ActiveLanes = 0;
+		for (int32 Lane = 0; Lane < FVoxelRayLanes::NumLanes; Lane++)
+		{
+			const int32 Ray = FirstRay + FMath::Min(Lane, NumLanes - 1);
+			const FVector Origin = Starts[Ray] + FVector(0.5f);
+			const FVector Direction = Ends[Ray] - Starts[Ray];
+
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				Lanes.Origin[Axis][Lane] = Origin[Axis];
+				Lanes.Direction[Axis][Lane] = Direction[Axis];
+				Lanes.Cell[Axis][Lane] = FMath::FloorToInt(Origin[Axis]);
+			}
+
+			Lanes.ExitAxis[Lane] = -1;
+			Lanes.Time[Lane] = 0.f;
+			Lanes.BoxSize[Lane] = 1;
+
+			if (Lane < NumLanes)
+			{
+				OutHits[Ray] = FVoxelRaycastHit();
+				ActiveLanes |= 1 << Lane;
+			}
+		}
+
+		bool bFirstStep = true;
+		while (ActiveLanes != 0)
+		{
+			// Looking at the cells can't be vectorised, so do it lane by lane. Lanes that have finished keep stepping along with the others,
+			// but whatever they find is ignored.
+			for (int32 Lane = 0; Lane < FVoxelRayLanes::NumLanes; Lane++)
+			{
+				if ((ActiveLanes & (1 << Lane)) == 0)
+				{
+					Lanes.BoxSize[Lane] = 1;
+					continue;
+				}
+
+				PolyVox::MaterialDensityPair44 Voxel;
+				Lanes.BoxSize[Lane] = GetEmptyBoxSize(Cache, Lanes.Cell[0][Lane], Lanes.Cell[1][Lane], Lanes.Cell[2][Lane], Voxel);
+
+				if (Lanes.BoxSize[Lane] == 0)
+				{
+					const int32 Ray = FirstRay + Lane;
+					const float Time = bFirstStep ? 0.f : Lanes.Time[Lane];
+
+					FVoxelRaycastHit& Hit = OutHits[Ray];
+					Hit.bHit = true;
+					Hit.Location = Starts[Ray] + (Ends[Ray] - Starts[Ray]) * Time;
+					Hit.Time = Time;
+					Hit.Material = Voxel.getMaterial();
+					Hit.VoxelCoords = FIntVector(Lanes.Cell[0][Lane], Lanes.Cell[1][Lane], Lanes.Cell[2][Lane]);
+
+					const int32 ExitAxis = Lanes.ExitAxis[Lane];
+					if (ExitAxis >= 0)
+					{
+						Hit.Normal[ExitAxis] = Lanes.Direction[ExitAxis][Lane] > 0.f ? -1.f : 1.f;
+					}
+
+					ActiveLanes &= ~(1 << Lane);
+					Lanes.BoxSize[Lane] = 1;
+				}
+			}
+
+			if (ActiveLanes == 0)
+			{
+				break;
+			}
+
+			ActiveLanes &= ~StepRayLanes(Lanes);
+			bFirstStep = false;
+		}
+	}
+#else
+	for (int32 Ray = 0; Ray < NumRays; Ray++)
+	{
+		OutHits[Ray] = FVoxelRaycastHit();
+		Raycast(ChunkIndex, Starts[Ray], Ends[Ray], OutHits[Ray]);
+	}
+#endif
+}
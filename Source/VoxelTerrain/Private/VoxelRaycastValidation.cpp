@@ -0,0 +1,171 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelTerrainActor.h"
+#include "VoxelRaycast.h"
+#include "VoxelChunkIndex.h"
+#include "VoxelOccupancy.h"
+
+// The trace the occupancy skipping replaced: step one voxel at a time and look every voxel up, with nothing skipped.
+// Uses the same conventions as FVoxelRaycaster, so the two should agree on every hit.
+static bool RaycastPerVoxel(const FVoxelChunkIndex& ChunkIndex, const FVector& Start, const FVector& End, FVoxelRaycastHit& OutHit)
+{
+	const FVector Origin = Start + FVector(0.5f);
+	const FVector Direction = End - Start;
+
+	FIntVector Cell(FMath::FloorToInt(Origin.X), FMath::FloorToInt(Origin.Y), FMath::FloorToInt(Origin.Z));
+	FVector Normal = FVector::ZeroVector;
+	float Time = 0.f;
+
+	while (true)
+	{
+		if (FVoxelVolume::Chunk* Chunk = ChunkIndex.Find(GetVoxelChunkCoords(Cell.X, Cell.Y, Cell.Z)))
+		{
+			const int32 ChunkMask = VOXEL_CHUNK_SIZE - 1;
+			const PolyVox::MaterialDensityPair44 Voxel = Chunk->getVoxel(Cell.X & ChunkMask, Cell.Y & ChunkMask, Cell.Z & ChunkMask);
+			if (FVoxelChunkOccupancy::BlocksTraces(Voxel))
+			{
+				OutHit.bHit = true;
+				OutHit.Location = Start + Direction * Time;
+				OutHit.Normal = Normal;
+				OutHit.Time = Time;
+				OutHit.Material = Voxel.getMaterial();
+				OutHit.VoxelCoords = Cell;
+				return true;
+			}
+		}
+
+		// Find where the trace leaves the voxel
+		float ExitTime = BIG_NUMBER;
+		int32 ExitAxis = -1;
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			if (Direction[Axis] != 0.f)
+			{
+				const float Boundary = Direction[Axis] > 0.f ? Cell[Axis] + 1 : Cell[Axis];
+				const float AxisTime = (Boundary - Origin[Axis]) / Direction[Axis];
+				if (AxisTime < ExitTime)
+				{
+					ExitTime = AxisTime;
+					ExitAxis = Axis;
+				}
+			}
+		}
+
+		if (ExitAxis < 0 || ExitTime > 1.f)
+		{
+			return false;
+		}
+
+		Time = ExitTime;
+		Cell[ExitAxis] += Direction[ExitAxis] > 0.f ? 1 : -1;
+
+		Normal = FVector::ZeroVector;
+		Normal[ExitAxis] = Direction[ExitAxis] > 0.f ? -1.f : 1.f;
+	}
+}
+
+// Whether two hits are the same, allowing for rounding in where along the trace they were
+static bool AreHitsEqual(const FVoxelRaycastHit& A, const FVoxelRaycastHit& B)
+{
+	if (A.bHit != B.bHit)
+	{
+		return false;
+	}
+
+	return !A.bHit || (A.VoxelCoords == B.VoxelCoords && A.Material == B.Material && FMath::IsNearlyEqual(A.Time, B.Time, KINDA_SMALL_NUMBER * 10.f));
+}
+
+// Traces random rays through the chunks that are paged in with FVoxelRaycaster, one at a time and in packets, and compares every hit with the
+// per-voxel trace
+static void ValidateVoxelRaycasts(AVoxelTerrainActor& Terrain, int32 NumRays)
+{
+	FScopeLock Lock(&Terrain.GetVolumeLock());
+
+	const FVoxelChunkIndex& ChunkIndex = Terrain.GetPager()->GetChunkIndex();
+
+	TArray<FIntVector> Chunks;
+	ChunkIndex.ForEach([&Chunks](const FIntVector& ChunkCoords, const FVoxelChunkIndex::FEntry& Entry)
+	{
+		Chunks.Add(ChunkCoords);
+	});
+
+	if (Chunks.Num() == 0)
+	{
+		UE_LOG(LogVoxelTerrain, Display, TEXT("%s has no chunks paged in yet"), *Terrain.GetName());
+		return;
+	}
+
+	// Rays start anywhere in a paged in chunk and go up to a few chunks in any direction, so they cross empty space, solid ground and the
+	// edges of what's paged in. Some are lined up with an axis, since those are the ones most likely to land exactly on a boundary.
+	FRandomStream Random(0x5eed);
+	TArray<FVector> Starts;
+	TArray<FVector> Ends;
+	Starts.Reserve(NumRays);
+	Ends.Reserve(NumRays);
+	for (int32 Ray = 0; Ray < NumRays; Ray++)
+	{
+		const FIntVector Chunk = Chunks[Random.RandHelper(Chunks.Num())];
+		const FVector Start = FVector(Chunk * VOXEL_CHUNK_SIZE) + FVector(Random.FRand(), Random.FRand(), Random.FRand()) * VOXEL_CHUNK_SIZE;
+
+		FVector Direction = Random.GetUnitVector();
+		if (Random.FRand() < 0.1f)
+		{
+			const int32 Axis = Random.RandHelper(3);
+			Direction = FVector::ZeroVector;
+			Direction[Axis] = Random.FRand() < 0.5f ? -1.f : 1.f;
+		}
+
+		Starts.Add(Start);
+		Ends.Add(Start + Direction * Random.FRandRange(1.f, VOXEL_CHUNK_SIZE * 4));
+	}
+
+	TArray<FVoxelRaycastHit> PacketHits;
+	PacketHits.SetNum(NumRays);
+	FVoxelRaycaster::RaycastPacket(ChunkIndex, Starts.GetData(), Ends.GetData(), NumRays, PacketHits.GetData());
+
+	int32 NumHits = 0;
+	int32 NumSingleMismatches = 0;
+	int32 NumPacketMismatches = 0;
+	for (int32 Ray = 0; Ray < NumRays; Ray++)
+	{
+		FVoxelRaycastHit ExpectedHit;
+		RaycastPerVoxel(ChunkIndex, Starts[Ray], Ends[Ray], ExpectedHit);
+		NumHits += ExpectedHit.bHit ? 1 : 0;
+
+		FVoxelRaycastHit SingleHit;
+		FVoxelRaycaster::Raycast(ChunkIndex, Starts[Ray], Ends[Ray], SingleHit);
+
+		if (!AreHitsEqual(SingleHit, ExpectedHit))
+		{
+			NumSingleMismatches++;
+			UE_LOG(LogVoxelTerrain, Warning, TEXT("Raycast from %s to %s hit %s, the per-voxel trace hit %s"), *Starts[Ray].ToString(), *Ends[Ray].ToString(),
+				SingleHit.bHit ? *SingleHit.VoxelCoords.ToString() : TEXT("nothing"), ExpectedHit.bHit ? *ExpectedHit.VoxelCoords.ToString() : TEXT("nothing"));
+		}
+
+		if (!AreHitsEqual(PacketHits[Ray], ExpectedHit))
+		{
+			NumPacketMismatches++;
+			UE_LOG(LogVoxelTerrain, Warning, TEXT("RaycastPacket from %s to %s hit %s, the per-voxel trace hit %s"), *Starts[Ray].ToString(), *Ends[Ray].ToString(),
+				PacketHits[Ray].bHit ? *PacketHits[Ray].VoxelCoords.ToString() : TEXT("nothing"), ExpectedHit.bHit ? *ExpectedHit.VoxelCoords.ToString() : TEXT("nothing"));
+		}
+	}
+
+	UE_LOG(LogVoxelTerrain, Display, TEXT("Validated %d rays (%d hits) over %d chunks: %d Raycast mismatches, %d RaycastPacket mismatches"),
+		NumRays, NumHits, Chunks.Num(), NumSingleMismatches, NumPacketMismatches);
+}
+
+static void ValidateVoxelRaycastsCommand(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 NumRays = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 3000;
+
+	for (TActorIterator<AVoxelTerrainActor> It(World); It; ++It)
+	{
+		ValidateVoxelRaycasts(**It, NumRays);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GValidateVoxelRaycastsCommand(
+	TEXT("VoxelTerrain.ValidateRaycasts"),
+	TEXT("Compares FVoxelRaycaster's traces and packet traces with a plain per-voxel trace on random rays. Usage: VoxelTerrain.ValidateRaycasts [NumRays]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&ValidateVoxelRaycastsCommand));
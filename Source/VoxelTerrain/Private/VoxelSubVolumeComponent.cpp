@@ -0,0 +1,308 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelSubVolumeComponent.h"
+#include "VoxelAccessor.h"
+#include "VoxelChunkComponent.h"
+
+using namespace PolyVox;
+
+// FVoxelSubVolumePager
+
+void FVoxelSubVolumePager::pageIn(const PolyVox::Region& Region, FVoxelVolume::Chunk* Chunk)
+{
+	const FIntVector ChunkCoords = GetVoxelChunkCoords(Region.getLowerX(), Region.getLowerY(), Region.getLowerZ());
+
+	// The chunk paged in before this one has finished being constructed by now, so it can be marked as modified
+	MarkChunkModified();
+
+	// Chunks that were paged out come back as they were. Anything else starts out empty.
+	TArray<MaterialDensityPair44> Voxels;
+	if (!PagedOutChunks.RemoveAndCopyValue(ChunkCoords, Voxels))
+	{
+		Voxels.SetNumZeroed(VOXEL_CHUNK_VOLUME);
+	}
+
+	FVoxelChunkOccupancy* Occupancy = nullptr;
+	if (FreeOccupancies.Num() > 0)
+	{
+		Occupancy = FreeOccupancies.Pop(false);
+	}
+	else
+	{
+		Occupancy = new FVoxelChunkOccupancy();
+		Occupancies.Emplace(Occupancy);
+	}
+
+	Occupancy->Build(Voxels.GetData());
+
+	const MaterialDensityPair44* Voxel = Voxels.GetData();
+	for (int32 Z = 0; Z < VOXEL_CHUNK_SIZE; Z++)
+	{
+		for (int32 Y = 0; Y < VOXEL_CHUNK_SIZE; Y++)
+		{
+			for (int32 X = 0; X < VOXEL_CHUNK_SIZE; X++)
+			{
+				Chunk->setVoxel(X, Y, Z, *Voxel++);
+			}
+		}
+	}
+
+	FVoxelChunkIndex::FEntry Entry;
+	Entry.Chunk = Chunk;
+	Entry.Occupancy = Occupancy;
+	ChunkIndex.Add(ChunkCoords, Entry);
+
+	// The saved voxels are gone now, so the chunk has to be paged out again whether or not it's edited. The volume only does that for
+	// modified chunks and clears the flag once pageIn returns, so it's marked when the next chunk is paged in, like the terrain's pager does.
+	UnmarkedChunk = Chunk;
+}
+
+void FVoxelSubVolumePager::pageOut(const PolyVox::Region& Region, FVoxelVolume::Chunk* Chunk)
+{
+	const FIntVector ChunkCoords = GetVoxelChunkCoords(Region.getLowerX(), Region.getLowerY(), Region.getLowerZ());
+
+	// An edit can mark the chunk and get it evicted before the next pageIn does
+	if (Chunk == UnmarkedChunk)
+	{
+		UnmarkedChunk = nullptr;
+	}
+
+	if (const FVoxelChunkIndex::FEntry* Entry = ChunkIndex.FindEntry(ChunkCoords))
+	{
+		// Empty chunks page back in empty anyway, so there's nothing to keep
+		if (!Entry->Occupancy->IsEmpty())
+		{
+			TArray<MaterialDensityPair44>& Voxels = PagedOutChunks.Add(ChunkCoords);
+			Voxels.SetNumUninitialized(VOXEL_CHUNK_VOLUME);
+
+			MaterialDensityPair44* Voxel = Voxels.GetData();
+			for (int32 Z = 0; Z < VOXEL_CHUNK_SIZE; Z++)
+			{
+				for (int32 Y = 0; Y < VOXEL_CHUNK_SIZE; Y++)
+				{
+					for (int32 X = 0; X < VOXEL_CHUNK_SIZE; X++)
+					{
+						*Voxel++ = Chunk->getVoxel(X, Y, Z);
+					}
+				}
+			}
+		}
+
+		FreeOccupancies.Add(Entry->Occupancy);
+	}
+
+	ChunkIndex.Remove(ChunkCoords);
+}
+
+void FVoxelSubVolumePager::Reset()
+{
+	// Anything still in the index belonged to a volume that has been destroyed
+	ChunkIndex.ForEach([this](const FIntVector& ChunkCoords, const FVoxelChunkIndex::FEntry& Entry)
+	{
+		FreeOccupancies.Add(Entry.Occupancy);
+	});
+
+	ChunkIndex.Reset();
+	UnmarkedChunk = nullptr;
+	PagedOutChunks.Reset();
+}
+
+void FVoxelSubVolumePager::MarkChunkModified()
+{
+	if (UnmarkedChunk != nullptr)
+	{
+		// Writing a voxel back is the only way to set the chunk's modified flag
+		UnmarkedChunk->setVoxel(0, 0, 0, UnmarkedChunk->getVoxel(0, 0, 0));
+		UnmarkedChunk = nullptr;
+	}
+}
+
+// UVoxelSubVolumeComponent
+
+UVoxelSubVolumeComponent::UVoxelSubVolumeComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	// We only need to tick to mesh changes
+	PrimaryComponentTick.bCanEverTick = true;
+
+	bCreateCollision = true;
+	ChunksMeshedPerTick = 4;
+}
+
+void UVoxelSubVolumeComponent::SetVoxelMaterial(const FVector& WorldLocation, int32 Material)
+{
+	// Solid voxels are always full
+	const uint8 NewMaterial = (uint8)FMath::Clamp(Material, 0, 15);
+	SetVoxel(WorldToVoxel(WorldLocation), MaterialDensityPair44(NewMaterial, NewMaterial != VOXEL_MATERIAL_AIR ? VOXEL_FLUID_MAX_LEVEL : 0));
+}
+
+int32 UVoxelSubVolumeComponent::GetVoxelMaterial(const FVector& WorldLocation) const
+{
+	return GetVoxel(WorldToVoxel(WorldLocation)).getMaterial();
+}
+
+void UVoxelSubVolumeComponent::ClearVoxels()
+{
+	// Destroying the volume pages everything out, so forget what the pager kept afterwards
+	Volume.Reset();
+	if (Pager.IsValid())
+	{
+		Pager->Reset();
+	}
+
+	for (UVoxelChunkComponent* ChunkComponent : ChunkComponents)
+	{
+		ChunkComponent->DestroyComponent();
+	}
+
+	ChunkComponents.Reset();
+	MeshedChunks.Reset();
+	DirtyChunks.Reset();
+	Mesher.Reset();
+	PaddedChunk.Reset();
+}
+
+void UVoxelSubVolumeComponent::SetVoxel(const FIntVector& VoxelCoords, const MaterialDensityPair44& Voxel)
+{
+	CreateVolume();
+
+	FVoxelAccessor Accessor(Volume.Get(), Pager->GetChunkIndex());
+	Accessor.SetVoxel(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z, Voxel);
+	AddChunksMeshingVoxel(VoxelCoords, DirtyChunks);
+}
+
+MaterialDensityPair44 UVoxelSubVolumeComponent::GetVoxel(const FIntVector& VoxelCoords) const
+{
+	// Reading a chunk that was paged out to save memory pages it back in, but chunks that have never been set are just air
+	if (!Volume.IsValid() || !Pager->HasChunk(GetVoxelChunkCoords(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z)))
+	{
+		return MaterialDensityPair44(VOXEL_MATERIAL_AIR, 0);
+	}
+
+	FVoxelAccessor Accessor(Volume.Get(), Pager->GetChunkIndex());
+	return Accessor.GetVoxel(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z);
+}
+
+void UVoxelSubVolumeComponent::UpdateMesh(int32 MaxChunks)
+{
+	if (DirtyChunks.Num() == 0)
+	{
+		return;
+	}
+
+	if (!Mesher.IsValid())
+	{
+		Mesher = MakeUnique<FVoxelChunkMesher>(TerrainMaterials.Num());
+		PaddedChunk = MakeUnique<FVoxelPaddedChunk>();
+	}
+
+	int32 NumMeshed = 0;
+	for (auto It = DirtyChunks.CreateIterator(); It && NumMeshed < MaxChunks; ++It, NumMeshed++)
+	{
+		const FIntVector ChunkCoords = *It;
+		It.RemoveCurrent();
+
+		// Chunks that have never been set are read as air rather than paged in, so a one chunk sub-volume doesn't page in its 26 neighbours
+		PaddedChunk->CopyFromChunks(Pager->GetChunkIndex(), ChunkCoords);
+		Mesher->MeshChunk(*PaddedChunk);
+
+		bool bEmpty = true;
+		for (int32 Material = 0; Material < Mesher->GetNumSections(); Material++)
+		{
+			bEmpty &= Mesher->GetSection(Material).Vertices.Num() == 0;
+		}
+
+		// Don't create components for chunks with nothing in them
+		UVoxelChunkComponent* const* Existing = MeshedChunks.Find(ChunkCoords);
+		if (bEmpty && Existing == nullptr)
+		{
+			continue;
+		}
+
+		UVoxelChunkComponent* ChunkComponent = Existing != nullptr ? *Existing : AcquireChunkComponent(ChunkCoords);
+
+		TArray<FVoxelMeshBuffersRef> Sections;
+		Sections.Reserve(Mesher->GetNumSections());
+		for (int32 Material = 0; Material < Mesher->GetNumSections(); Material++)
+		{
+			Sections.Add(FVoxelMeshBufferPool::Get().Acquire(MoveTemp(Mesher->GetSection(Material))));
+		}
+
+		// Set every section, then cook the chunk's collision once from all of them
+		ChunkComponent->SetMeshSections(Sections);
+
+		if (bCreateCollision)
+		{
+			ChunkComponent->SetCollisionMesh(Sections);
+		}
+	}
+
+	// Let go of the mesher's memory once everything is up to date
+	if (DirtyChunks.Num() == 0)
+	{
+		Mesher.Reset();
+		PaddedChunk.Reset();
+	}
+}
+
+FIntVector UVoxelSubVolumeComponent::WorldToVoxel(const FVector& WorldLocation) const
+{
+	// Voxel centers are at whole multiples of VOXEL_SIZE, so round rather than floor
+	const FVector Local = ComponentToWorld.InverseTransformPosition(WorldLocation) / VOXEL_SIZE;
+	return FIntVector(FMath::FloorToInt(Local.X + 0.5f), FMath::FloorToInt(Local.Y + 0.5f), FMath::FloorToInt(Local.Z + 0.5f));
+}
+
+FVector UVoxelSubVolumeComponent::VoxelToWorld(const FIntVector& VoxelCoords) const
+{
+	return ComponentToWorld.TransformPosition(FVector(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z) * VOXEL_SIZE);
+}
+
+void UVoxelSubVolumeComponent::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	UpdateMesh(ChunksMeshedPerTick);
+}
+
+void UVoxelSubVolumeComponent::OnComponentDestroyed(bool bDestroyingHierarchy)
+{
+	ClearVoxels();
+
+	Super::OnComponentDestroyed(bDestroyingHierarchy);
+}
+
+void UVoxelSubVolumeComponent::CreateVolume()
+{
+	if (!Volume.IsValid())
+	{
+		if (!Pager.IsValid())
+		{
+			Pager = MakeUnique<FVoxelSubVolumePager>();
+		}
+
+		Volume = MakeUnique<FVoxelVolume>(Pager.Get());
+	}
+}
+
+UVoxelChunkComponent* UVoxelSubVolumeComponent::AcquireChunkComponent(const FIntVector& ChunkCoords)
+{
+	UVoxelChunkComponent* ChunkComponent = NewObject<UVoxelChunkComponent>(GetOwner());
+	ChunkComponent->SetupAttachment(this);
+	ChunkComponent->SetRelativeLocation(GetVoxelChunkOrigin(ChunkCoords));
+
+	for (int32 Material = 0; Material < TerrainMaterials.Num(); Material++)
+	{
+		ChunkComponent->SetMaterial(Material, TerrainMaterials[Material]);
+	}
+
+	if (!bCreateCollision)
+	{
+		ChunkComponent->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	}
+
+	ChunkComponent->RegisterComponent();
+	ChunkComponents.Add(ChunkComponent);
+	MeshedChunks.Add(ChunkCoords, ChunkComponent);
+	return ChunkComponent;
+}
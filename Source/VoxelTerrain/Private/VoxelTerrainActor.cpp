@@ -2,21 +2,27 @@
 
 #include "VoxelTerrain.h"
 #include "VoxelTerrainActor.h"
+#include "VoxelChunkComponent.h"
+#include "VoxelSubVolumeComponent.h"
+#include "VoxelPaddedChunk.h"
+#include "VoxelTerrainStats.h"
+#include "Kismet/GameplayStatics.h"
 
 // PolyVox
-#include "PolyVox/CubicSurfaceExtractor.h"
-#include "PolyVox/Mesh.h"
 using namespace PolyVox;
 
 // ANL
-#include "VM/kernel.h"
 using namespace anl;
 
 // Sets default values
 AVoxelTerrainActor::AVoxelTerrainActor()
 {
-	// Initialize our mesh component
-	Mesh = CreateDefaultSubobject<UProceduralMeshComponent>(TEXT("Terrain Mesh"));
+	// We need to tick to stream chunks in and out
+	PrimaryActorTick.bCanEverTick = true;
+
+	// Initialize our root component. The chunk meshes are created and attached to it at runtime.
+	TerrainRoot = CreateDefaultSubobject<USceneComponent>(TEXT("Terrain Root"));
+	RootComponent = TerrainRoot;
 
 	// Default values for our noise control variables.
 	Seed = 123;
@@ -25,96 +31,1420 @@ AVoxelTerrainActor::AVoxelTerrainActor()
 	NoiseScale = 32.f;
 	NoiseOffset = 0.f;
 	TerrainHeight = 64.f;
+
+	// Default values for streaming
+	ViewDistance = 6;
+	WorldOriginRebaseDistance = 0.f;
+	HeightInChunks = 2;
+	StreamingCenter = FIntVector::ZeroValue;
+	StreamingOrigin = FVector2D::ZeroVector;
+	StreamingForward = FVector2D(1.f, 0.f);
+	StreamingCosHalfFOV = -1.f;
+	OutOfViewPriorityScale = 4.f;
+
+	// Default values for fluids
+	FluidStepInterval = 0.1f;
+	FluidCellBudget = 8192;
+	FluidStepTime = 0.f;
+
+	// Default values for editing
+	MaxIslandSize = 4096;
+	DebrisFallInterval = 0.05f;
+	DebrisStepTime = 0.f;
+	GranularVoxelBudget = 16384;
+
+	// Default values for clusters
+	ClusterDistance = 8;
+	ClusterTriangleBudgets.Add(16384);
+	ClusterTriangleBudgets.Add(4096);
+	ClusterTriangleBudgets.Add(1024);
+	MaxClusterMerges = 2;
+
+	// Default values for shadows
+	bShadowProxies = true;
+	ShadowProxyTriangleBudget = 4096;
+	MaxShadowMerges = 2;
+	ShadowMergeInterval = 1.f;
+
+	// Default values for occlusion culling
+	bOcclusionCulling = true;
+	OccluderDistance = 3;
+
+	// Default values for block ticks
+	BlockTickInterval = 0.05f;
+	RandomTicksPerChunk = 64;
+	BlockTickBudget = 1024;
+	BlockTickScanBudget = 65536;
+	BlockTickTime = 0.f;
+
+	// Generation and meshing are the expensive stages, so they get the most room and workers.
+	// Collision and upload workers are the number of chunks handled per tick.
+	GenerateStage = FVoxelPipelineStageSettings(16, 2);
+	MeshStage = FVoxelPipelineStageSettings(16, 2);
+	CollisionStage = FVoxelPipelineStageSettings(8, 2);
+	UploadStage = FVoxelPipelineStageSettings(8, 4);
+	bOptimizeVertexCache = true;
+}
+
+// Called after the C++ constructor and after the properties have been initialized.
+void AVoxelTerrainActor::PostInitializeComponents()
+{
+	// Initialize our paged volume.
+	Pager = MakeUnique<VoxelTerrainPager>(Seed, NoiseOctaves, NoiseFrequency, NoiseScale, NoiseOffset, TerrainHeight);
+	VoxelVolume = MakeShareable(new PagedVolume<MaterialDensityPair44>(Pager.Get()));
+
+	// Call the base class's function.
+	Super::PostInitializeComponents();
+}
+
+// Called when the actor has begun playing in the level
+void AVoxelTerrainActor::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Start building chunks in the background. Tick feeds it the chunks around the player.
+	TArray<FVoxelPipelineStageSettings> StageSettings;
+	StageSettings.Add(GenerateStage);
+	StageSettings.Add(MeshStage);
+	StageSettings.Add(CollisionStage);
+	StageSettings.Add(UploadStage);
+
+	Pipeline = MakeUnique<FVoxelChunkPipeline>(VoxelVolume.Get(), Pager.Get(), &VolumeLock, TerrainMaterials.Num(), StageSettings, bOptimizeVertexCache);
+}
+
+// Called when the actor is being removed from the level
+void AVoxelTerrainActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Stop the pipeline's workers before anything they use goes away
+	Pipeline.Reset();
+
+	// Merges can't be abandoned, so wait for any that are still going
+	for (auto& Pair : Clusters)
+	{
+		if (Pair.Value.MergeTask.IsValid())
+		{
+			Pair.Value.MergeTask->EnsureCompletion();
+		}
+
+		if (Pair.Value.ShadowMergeTask.IsValid())
+		{
+			Pair.Value.ShadowMergeTask->EnsureCompletion();
+		}
+	}
+
+	Clusters.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+// Called every frame
+void AVoxelTerrainActor::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (!Pipeline.IsValid())
+	{
+		return;
+	}
+
+	UpdateWorldOrigin();
+	UpdateStreaming();
+	UpdateFluids(DeltaSeconds);
+	UpdateDebris(DeltaSeconds);
+	UpdateBlockTicks(DeltaSeconds);
+	UpdateGranular();
+	RemeshDirtyChunks();
+	ReleaseLandedDebris();
+
+	// Run the game thread stages. Their worker counts are how many chunks they get through each tick.
+	RunCollisionStage();
+	RunUploadStage();
+	UpdateClusters();
+	UpdateOcclusion();
+
+	Pipeline->Tick();
+}
+
+// Gets the location chunks are streamed in around, along with the direction and field of view of the camera there
+void AVoxelTerrainActor::GetStreamingView(FVector& OutOrigin, FVector& OutForward, float& OutFOV) const
+{
+	// Stream around the first player's camera, or around the terrain itself if there isn't one
+	FVector Location = GetActorLocation();
+	FVector Forward = GetActorForwardVector();
+	OutFOV = 360.f;
+
+	APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(this, 0);
+	if (CameraManager != nullptr)
+	{
+		Location = CameraManager->GetCameraLocation();
+		Forward = CameraManager->GetCameraRotation().Vector();
+		OutFOV = CameraManager->GetFOVAngle();
+	}
+
+	OutOrigin = GetActorTransform().InverseTransformPosition(Location) / VOXEL_SIZE;
+	OutForward = GetActorTransform().InverseTransformVectorNoScale(Forward);
+}
+
+// Requests chunks that have come into view and unloads the ones that have gone out of it
+void AVoxelTerrainActor::UpdateStreaming()
+{
+	FVector Origin;
+	FVector Forward;
+	float FOV;
+	GetStreamingView(Origin, Forward, FOV);
+
+	const FIntVector CenterChunk = GetVoxelChunkCoords(FMath::FloorToInt(Origin.X), FMath::FloorToInt(Origin.Y), 0);
+	const FVector2D Forward2D = FVector2D(Forward.X, Forward.Y).GetSafeNormal();
+
+	// Turning the camera changes which chunks are most urgent, even if the player hasn't moved. Ignore small turns so we don't re-sort every tick.
+	const float MinTurnCos = 0.97f;
+	const bool bTurned = !Forward2D.IsZero() && FVector2D::DotProduct(Forward2D, StreamingForward) < MinTurnCos;
+
+	// Work out which chunks are in view whenever the player moves into a different chunk or looks somewhere else
+	if (CenterChunk != StreamingCenter || bTurned || WantedChunks.Num() == 0)
+	{
+		StreamingCenter = CenterChunk;
+		StreamingOrigin = FVector2D(Origin.X, Origin.Y) / VOXEL_CHUNK_SIZE;
+		StreamingCosHalfFOV = FMath::Cos(FMath::DegreesToRadians(FMath::Min(FOV, 360.f) * 0.5f));
+		if (!Forward2D.IsZero())
+		{
+			StreamingForward = Forward2D;
+		}
+
+		WantedChunks.Reset();
+
+		for (int32 OffsetX = -ViewDistance; OffsetX <= ViewDistance; OffsetX++)
+		{
+			for (int32 OffsetY = -ViewDistance; OffsetY <= ViewDistance; OffsetY++)
+			{
+				if (OffsetX * OffsetX + OffsetY * OffsetY > ViewDistance * ViewDistance)
+				{
+					continue;
+				}
+
+				for (int32 ChunkZ = 0; ChunkZ < HeightInChunks; ChunkZ++)
+				{
+					WantedChunks.Add(FIntVector(CenterChunk.X + OffsetX, CenterChunk.Y + OffsetY, ChunkZ));
+				}
+			}
+		}
+
+		// Most urgent first, so that the chunks around and in front of the player are built before the ones on the horizon or behind them
+		WantedChunks.Sort([this](const FIntVector& A, const FIntVector& B)
+		{
+			return GetChunkPriority(A) < GetChunkPriority(B);
+		});
+
+		// Re-rank the chunks that are already being built, and cancel the ones that are no longer needed before any more work goes into them
+		Pipeline->UpdatePriorities([this](const FIntVector& ChunkCoords)
+		{
+			return GetChunkPriority(ChunkCoords);
+		});
+
+		// Unload chunks that have gone out of view. Keep an extra chunk around the edge so chunks on the boundary don't flicker in and out.
+		const int32 UnloadDistance = ViewDistance + 1;
+		ChunksToUnload.Reset();
+		for (const auto& Pair : LoadedChunks)
+		{
+			const FIntVector Delta = Pair.Key - CenterChunk;
+			if (Delta.X * Delta.X + Delta.Y * Delta.Y > UnloadDistance * UnloadDistance)
+			{
+				ChunksToUnload.Add(Pair.Key);
+			}
+		}
+
+		for (const FIntVector& ChunkCoords : ChunksToUnload)
+		{
+			UnloadChunk(ChunkCoords);
+		}
+	}
+
+	// Request chunks most urgent first until the pipeline pushes back
+	for (const FIntVector& ChunkCoords : WantedChunks)
+	{
+		if (LoadedChunks.Contains(ChunkCoords))
+		{
+			continue;
+		}
+
+		if (!Pipeline->TryRequestChunk(ChunkCoords, GetChunkPriority(ChunkCoords)))
+		{
+			break;
+		}
+	}
+}
+
+// Moves the world origin to the camera if it has gone further than WorldOriginRebaseDistance from it
+void AVoxelTerrainActor::UpdateWorldOrigin()
+{
+	APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(this, 0);
+	if (WorldOriginRebaseDistance <= 0.f || CameraManager == nullptr)
+	{
+		return;
+	}
+
+	const FVector Location = CameraManager->GetCameraLocation();
+	if (Location.SizeSquared() <= FMath::Square(WorldOriginRebaseDistance))
+	{
+		return;
+	}
+
+	// The world applies the shift at the start of its next tick. Everything the terrain draws is attached to TerrainRoot and placed relative
+	// to its chunk, so nothing needs rebuilding when it moves.
+	UWorld* World = GetWorld();
+	const FIntVector Offset(FMath::RoundToInt(Location.X), FMath::RoundToInt(Location.Y), FMath::RoundToInt(Location.Z));
+	World->RequestNewWorldOrigin(World->OriginLocation + Offset);
+}
+
+// Returns how urgently a chunk is needed, lowest first
+float AVoxelTerrainActor::GetChunkPriority(const FIntVector& ChunkCoords) const
+{
+	// Chunks past the unload distance would be unloaded as soon as they were built
+	const int32 UnloadDistance = ViewDistance + 1;
+	const FIntVector Delta = ChunkCoords - StreamingCenter;
+	if (Delta.X * Delta.X + Delta.Y * Delta.Y > UnloadDistance * UnloadDistance)
+	{
+		return -1.f;
+	}
+
+	// Work from the middle of the chunk, in chunks
+	const FVector2D ToChunk = FVector2D(ChunkCoords.X + 0.5f, ChunkCoords.Y + 0.5f) - StreamingOrigin;
+	const float Distance = ToChunk.Size();
+
+	// The chunks around the player are always needed, whichever way they're looking
+	const float ChunkRadius = 0.75f;
+	if (Distance <= ChunkRadius * 2.f)
+	{
+		return Distance;
+	}
+
+	// Widen the view cone by the size of the chunk so that chunks on the edge of the screen count as in view
+	const float HalfFOV = FMath::Acos(StreamingCosHalfFOV) + FMath::Asin(ChunkRadius / Distance);
+	const bool bInView = HalfFOV >= PI || FVector2D::DotProduct(ToChunk / Distance, StreamingForward) >= FMath::Cos(HalfFOV);
+
+	return bInView ? Distance : Distance * OutOfViewPriorityScale;
+}
+
+// Steps the fluid simulation if it's due
+void AVoxelTerrainActor::UpdateFluids(float DeltaSeconds)
+{
+	FluidStepTime += DeltaSeconds;
+	if (FluidStepTime < FluidStepInterval)
+	{
+		return;
+	}
+
+	// Only ever take one step a tick, even after a hitch, so the budget really is a per tick budget
+	FluidStepTime = FMath::Fmod(FluidStepTime, FMath::Max(FluidStepInterval, SMALL_NUMBER));
+
+	FScopeLock Lock(&VolumeLock);
+	Fluids.Step(Pager->GetChunkIndex(), FluidCellBudget, DirtyChunks);
+}
+
+// Moves falling debris down if it's due
+void AVoxelTerrainActor::UpdateDebris(float DeltaSeconds)
+{
+	if (Debris.IsEmpty())
+	{
+		DebrisStepTime = 0.f;
+		return;
+	}
+
+	DebrisStepTime += DeltaSeconds;
+	if (DebrisStepTime < DebrisFallInterval)
+	{
+		return;
+	}
+
+	DebrisStepTime = FMath::Fmod(DebrisStepTime, FMath::Max(DebrisFallInterval, SMALL_NUMBER));
+
+	FScopeLock Lock(&VolumeLock);
+	DebrisChangedVoxels.Reset();
+	LandedIslands.Reset();
+	Debris.Step(VoxelVolume.Get(), Pager->GetChunkIndex(), DirtyChunks, DebrisChangedVoxels, LandedIslands);
+
+	// Fluid flows out of the way of where debris landed, grass under it dies, and sand on it settles
+	OnDebrisChangedVoxels();
+
+	// Falling islands are drawn by sub-volumes, which just move down with them
+	for (const FVoxelFallingDebris::FIsland& Island : Debris.GetIslands())
+	{
+		if (UVoxelSubVolumeComponent** DebrisComponent = FallingDebris.Find(Island.Id))
+		{
+			(*DebrisComponent)->SetRelativeLocation(FVector(0.f, 0.f, -Island.Drop * VOXEL_SIZE));
+		}
+	}
+
+	// Landed islands keep being drawn until the terrain has been remeshed with them back in it
+	for (const FVoxelFallingDebris::FIsland& Island : LandedIslands)
+	{
+		UVoxelSubVolumeComponent* DebrisComponent = nullptr;
+		if (!FallingDebris.RemoveAndCopyValue(Island.Id, DebrisComponent))
+		{
+			continue;
+		}
+
+		FLandedDebris& Landed = LandedDebris[LandedDebris.AddDefaulted()];
+		Landed.Component = DebrisComponent;
+
+		TSet<FIntVector> Chunks;
+		for (const FIntVector& Voxel : Island.Voxels)
+		{
+			AddChunksMeshingVoxel(Voxel - FIntVector(0, 0, Island.Drop), Chunks);
+		}
+
+		Landed.Chunks = Chunks.Array();
+	}
+}
+
+// Wakes everything that depends on the voxels falling debris changed
+void AVoxelTerrainActor::OnDebrisChangedVoxels()
+{
+	for (const FIntVector& VoxelCoords : DebrisChangedVoxels)
+	{
+		Fluids.WakeVoxel(VoxelCoords);
+		BlockTicker.OnVoxelChanged(VoxelCoords);
+		Granular.WakeVoxel(VoxelCoords);
+	}
+}
+
+// Starts drawing an island that has just been lifted out of the terrain to fall
+void AVoxelTerrainActor::ShowFallingIsland(const FVoxelFallingDebris::FIsland& Island)
+{
+	UVoxelSubVolumeComponent* DebrisComponent = nullptr;
+	if (FreeDebrisComponents.Num() > 0)
+	{
+		DebrisComponent = FreeDebrisComponents.Pop(false);
+	}
+	else
+	{
+		// Debris only falls for a moment, so it isn't worth cooking collision for
+		DebrisComponent = NewObject<UVoxelSubVolumeComponent>(this);
+		DebrisComponent->SetupAttachment(TerrainRoot);
+		DebrisComponent->TerrainMaterials = TerrainMaterials;
+		DebrisComponent->bCreateCollision = false;
+		DebrisComponent->RegisterComponent();
+		DebrisComponents.Add(DebrisComponent);
+	}
+
+	// The sub-volume uses the terrain's voxel coordinates, so it starts out exactly where the island was. Mesh it straight away, since the
+	// terrain around it will be remeshed without it.
+	DebrisComponent->SetRelativeLocation(FVector::ZeroVector);
+	for (int32 Index = 0; Index < Island.Voxels.Num(); Index++)
+	{
+		DebrisComponent->SetVoxel(Island.Voxels[Index], Island.Contents[Index]);
+	}
+
+	DebrisComponent->UpdateMesh(MAX_int32);
+	FallingDebris.Add(Island.Id, DebrisComponent);
+}
+
+// Stops drawing landed debris once the terrain it landed in has been remeshed
+void AVoxelTerrainActor::ReleaseLandedDebris()
+{
+	for (int32 Index = LandedDebris.Num() - 1; Index >= 0; Index--)
+	{
+		const FLandedDebris& Landed = LandedDebris[Index];
+
+		bool bRemeshed = true;
+		for (const FIntVector& ChunkCoords : Landed.Chunks)
+		{
+			if (DirtyChunks.Contains(ChunkCoords) || Pipeline->IsChunkInFlight(ChunkCoords))
+			{
+				bRemeshed = false;
+				break;
+			}
+		}
+
+		if (bRemeshed)
+		{
+			Landed.Component->ClearVoxels();
+			FreeDebrisComponents.Add(Landed.Component);
+			LandedDebris.RemoveAtSwap(Index);
+		}
+	}
+}
+
+// Runs random block ticks if they're due
+void AVoxelTerrainActor::UpdateBlockTicks(float DeltaSeconds)
+{
+	BlockTickTime += DeltaSeconds;
+	if (BlockTickTime < BlockTickInterval)
+	{
+		return;
+	}
+
+	BlockTickTime = FMath::Fmod(BlockTickTime, FMath::Max(BlockTickInterval, SMALL_NUMBER));
+
+	FScopeLock Lock(&VolumeLock);
+	BlockTickEdits.Reset();
+	BlockTicker.Tick(Pager->GetChunkIndex(), RandomTicksPerChunk, BlockTickBudget, BlockTickScanBudget, BlockTickEdits);
+
+	// Apply all of the edits together, so each chunk is only remeshed once however many of its voxels changed
+	FVoxelAccessor Accessor(VoxelVolume.Get(), Pager->GetChunkIndex());
+	for (const FVoxelBlockTickEdit& Edit : BlockTickEdits)
+	{
+		EditVoxel(Accessor, Edit.VoxelCoords, MaterialDensityPair44(Edit.Material, VOXEL_FLUID_MAX_LEVEL));
+	}
+}
+
+// Collapses columns of sand and gravel that have lost their support
+void AVoxelTerrainActor::UpdateGranular()
+{
+	if (Granular.IsEmpty())
+	{
+		return;
+	}
+
+	FScopeLock Lock(&VolumeLock);
+	GranularChangedVoxels.Reset();
+	Granular.Step(VoxelVolume.Get(), Pager->GetChunkIndex(), GranularVoxelBudget, DirtyChunks, GranularChangedVoxels, RemovedVoxels);
+
+	// Columns only collapse straight down, so the columns the changes were in are already settled; only the fluids and tickable voxels
+	// around them need to know
+	for (const FIntVector& VoxelCoords : GranularChangedVoxels)
+	{
+		Fluids.WakeVoxel(VoxelCoords);
+		BlockTicker.OnVoxelChanged(VoxelCoords);
+	}
+
+	// Anything that was resting on top of a run that dropped might have been left hanging
+	ResolveEdits();
+}
+
+// Sends chunks whose voxels have changed back through the pipeline to be meshed again
+void AVoxelTerrainActor::RemeshDirtyChunks()
+{
+	for (auto It = DirtyChunks.CreateIterator(); It; ++It)
+	{
+		const FIntVector ChunkCoords = *It;
+
+		// Chunks that aren't loaded pick up their changes when they're built
+		if (!LoadedChunks.Contains(ChunkCoords))
+		{
+			It.RemoveCurrent();
+			continue;
+		}
+
+		// A chunk that's already on its way through the pipeline may have been copied for meshing before it changed, so wait for it to come out the other end.
+		// Generating a chunk that's already in the volume does nothing, so a new job just meshes it again.
+		const float Priority = GetChunkPriority(ChunkCoords);
+		if (Priority < 0.f)
+		{
+			It.RemoveCurrent();
+		}
+		else if (!Pipeline->IsChunkInFlight(ChunkCoords) && Pipeline->TryRequestChunk(ChunkCoords, Priority))
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+// Cooks the collision of chunks that have been meshed
+void AVoxelTerrainActor::RunCollisionStage()
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelCookCollision);
+
+	for (int32 Count = 0; Count < Pipeline->GetStageSettings(EVoxelPipelineStage::Collision).Workers; Count++)
+	{
+		FVoxelChunkJob* Job = Pipeline->PopJob(EVoxelPipelineStage::Collision);
+		if (Job == nullptr)
+		{
+			break;
+		}
+
+		AcquireChunkComponent(Job->ChunkCoords)->SetCollisionMesh(Job->Sections);
+		Pipeline->FinishJob(EVoxelPipelineStage::Collision, Job);
+	}
+}
+
+// Hands the meshes of chunks to their components
+void AVoxelTerrainActor::RunUploadStage()
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelUploadChunk);
+
+	for (int32 Count = 0; Count < Pipeline->GetStageSettings(EVoxelPipelineStage::Upload).Workers; Count++)
+	{
+		FVoxelChunkJob* Job = Pipeline->PopJob(EVoxelPipelineStage::Upload);
+		if (Job == nullptr)
+		{
+			break;
+		}
+
+		// The component shares the job's buffers rather than copying them
+		UVoxelChunkComponent* ChunkComponent = AcquireChunkComponent(Job->ChunkCoords);
+		ChunkComponent->SetMeshSections(Job->Sections);
+		UpdateMissingNeighbours(Job->ChunkCoords, Job->MissingNeighbours);
+
+		const FIntVector ClusterCoords = GetVoxelClusterCoords(Job->ChunkCoords);
+		FCluster& Cluster = Clusters.FindChecked(ClusterCoords);
+		Cluster.bStale = true;
+		Cluster.bShadowStale = true;
+		MarkChunkShadowChanged(Job->ChunkCoords, Cluster);
+		UpdateClusterShadows(ClusterCoords, Cluster);
+
+		Pipeline->FinishJob(EVoxelPipelineStage::Upload, Job);
+	}
+}
+
+// Returns the component of a loaded chunk, setting one up if the chunk doesn't have one yet
+UVoxelChunkComponent* AVoxelTerrainActor::AcquireChunkComponent(const FIntVector& ChunkCoords)
+{
+	if (UVoxelChunkComponent** Existing = LoadedChunks.Find(ChunkCoords))
+	{
+		return *Existing;
+	}
+
+	UVoxelChunkComponent* ChunkComponent = nullptr;
+	if (FreeChunkComponents.Num() > 0)
+	{
+		ChunkComponent = FreeChunkComponents.Pop(false);
+	}
+	else
+	{
+		ChunkComponent = NewObject<UVoxelChunkComponent>(this);
+		ChunkComponent->SetupAttachment(TerrainRoot);
+
+		// Each chunk has one section per material
+		for (int32 Material = 0; Material < TerrainMaterials.Num(); Material++)
+		{
+			ChunkComponent->SetMaterial(Material, TerrainMaterials[Material]);
+		}
+
+		ChunkComponent->RegisterComponent();
+		ChunkComponents.Add(ChunkComponent);
+	}
+
+	// Pooled components were last used for some other chunk, so this has to be done every time
+	ChunkComponent->SetRelativeLocation(GetVoxelChunkOrigin(ChunkCoords));
+
+	// A chunk that's still in its cluster's merged mesh from before it was unloaded stays hidden until the cluster is merged again
+	FCluster& Cluster = Clusters.FindOrAdd(GetVoxelClusterCoords(ChunkCoords));
+	Cluster.NumChunks++;
+	Cluster.bStale = true;
+	Cluster.bShadowStale = true;
+	ChunkComponent->SetVisibility(!IsChunkDrawnByCluster(ChunkCoords, Cluster));
+
+	// The chunk casts its own shadow until the cluster's shadow mesh has it
+	MarkChunkShadowChanged(ChunkCoords, Cluster);
+	ChunkComponent->SetCastShadow(true);
+
+	LoadedChunks.Add(ChunkCoords, ChunkComponent);
+	return ChunkComponent;
+}
+
+// Empties a chunk's component and keeps it around for reuse
+void AVoxelTerrainActor::UnloadChunk(const FIntVector& ChunkCoords)
+{
+	UVoxelChunkComponent* ChunkComponent = nullptr;
+	if (LoadedChunks.RemoveAndCopyValue(ChunkCoords, ChunkComponent))
+	{
+		ChunkComponent->ClearAllMeshSections();
+		ChunkComponent->ClearCollisionMesh();
+		FreeChunkComponents.Add(ChunkComponent);
+		ChunksMissingNeighbours.Remove(ChunkCoords);
+
+		// UpdateClusters lets go of clusters once they're empty
+		const FIntVector ClusterCoords = GetVoxelClusterCoords(ChunkCoords);
+		FCluster& Cluster = Clusters.FindChecked(ClusterCoords);
+		Cluster.NumChunks--;
+		Cluster.bStale = true;
+		Cluster.bShadowStale = true;
+		MarkChunkShadowChanged(ChunkCoords, Cluster);
+		UpdateClusterShadows(ClusterCoords, Cluster);
+	}
+}
+
+// Marks loaded chunks dirty that were meshed without a chunk that has just been uploaded, and remembers which neighbours its own mesh was built without
+void AVoxelTerrainActor::UpdateMissingNeighbours(const FIntVector& ChunkCoords, uint32 MissingNeighbours)
+{
+	// Neighbours that were meshed before this chunk was generated read it as air, so they have to be meshed again now that it's here.
+	// The new job works out which neighbours are still missing.
+	for (int32 NeighbourZ = -1; NeighbourZ <= 1; NeighbourZ++)
+	{
+		for (int32 NeighbourY = -1; NeighbourY <= 1; NeighbourY++)
+		{
+			for (int32 NeighbourX = -1; NeighbourX <= 1; NeighbourX++)
+			{
+				const FIntVector Neighbour(NeighbourX, NeighbourY, NeighbourZ);
+				const uint32* NeighbourMissing = ChunksMissingNeighbours.Find(ChunkCoords + Neighbour);
+				if (NeighbourMissing != nullptr && (*NeighbourMissing & FVoxelPaddedChunk::GetNeighbourBit(Neighbour * -1)) != 0)
+				{
+					DirtyChunks.Add(ChunkCoords + Neighbour);
+					ChunksMissingNeighbours.Remove(ChunkCoords + Neighbour);
+				}
+			}
+		}
+	}
+
+	// Forget about neighbours above and below the terrain, which are never requested, and look for ones that arrived after the chunk was copied
+	bool bArrivedSinceCopy = false;
+	{
+		FScopeLock Lock(&VolumeLock);
+		for (int32 NeighbourZ = -1; NeighbourZ <= 1; NeighbourZ++)
+		{
+			for (int32 NeighbourY = -1; NeighbourY <= 1; NeighbourY++)
+			{
+				for (int32 NeighbourX = -1; NeighbourX <= 1; NeighbourX++)
+				{
+					const FIntVector Neighbour(NeighbourX, NeighbourY, NeighbourZ);
+					const uint32 Bit = FVoxelPaddedChunk::GetNeighbourBit(Neighbour);
+					if ((MissingNeighbours & Bit) == 0)
+					{
+						continue;
+					}
+
+					const int32 NeighbourChunkZ = ChunkCoords.Z + NeighbourZ;
+					if (NeighbourChunkZ < 0 || NeighbourChunkZ >= HeightInChunks)
+					{
+						MissingNeighbours &= ~Bit;
+					}
+					else if (Pager->IsChunkPagedIn(ChunkCoords + Neighbour))
+					{
+						bArrivedSinceCopy = true;
+					}
+				}
+			}
+		}
+	}
+
+	// A neighbour that was generated after the chunk was copied but uploaded before it didn't find the chunk in ChunksMissingNeighbours
+	if (bArrivedSinceCopy)
+	{
+		DirtyChunks.Add(ChunkCoords);
+		ChunksMissingNeighbours.Remove(ChunkCoords);
+	}
+	else if (MissingNeighbours != 0)
+	{
+		ChunksMissingNeighbours.Add(ChunkCoords, MissingNeighbours);
+	}
+	else
+	{
+		ChunksMissingNeighbours.Remove(ChunkCoords);
+	}
+}
+
+// Merges clusters that have gone out into the distance or changed there, and switches between drawing clusters and their chunks
+void AVoxelTerrainActor::UpdateClusters()
+{
+	const float Now = GetWorld()->GetTimeSeconds();
+	int32 NumMerging = 0;
+	int32 NumShadowMerging = 0;
+	for (auto It = Clusters.CreateIterator(); It; ++It)
+	{
+		const FIntVector ClusterCoords = It.Key();
+		FCluster& Cluster = It.Value();
+
+		// Each kind of merge only holds up starting another of the same kind. Showing and hiding the cluster never waits for either.
+		bool bMerging = false;
+		if (Cluster.MergeTask.IsValid())
+		{
+			if (Cluster.MergeTask->IsDone())
+			{
+				FinishClusterMerge(ClusterCoords, Cluster);
+			}
+			else
+			{
+				NumMerging++;
+				bMerging = true;
+			}
+		}
+
+		bool bShadowMerging = false;
+		if (Cluster.ShadowMergeTask.IsValid())
+		{
+			if (Cluster.ShadowMergeTask->IsDone())
+			{
+				FinishShadowMerge(ClusterCoords, Cluster);
+			}
+			else
+			{
+				NumShadowMerging++;
+				bShadowMerging = true;
+			}
+		}
+
+		// Empty clusters are hidden straight away, and let go of once nothing is merging into their components
+		if (Cluster.NumChunks == 0)
+		{
+			if (bMerging || bShadowMerging)
+			{
+				SetClusterShown(ClusterCoords, Cluster, false);
+				continue;
+			}
+
+			if (Cluster.Component != nullptr)
+			{
+				Cluster.Component->ClearAllMeshSections();
+				Cluster.Component->SetVisibility(false);
+				FreeClusterComponents.Add(Cluster.Component);
+			}
+
+			if (Cluster.ShadowComponent != nullptr)
+			{
+				Cluster.ShadowComponent->ClearAllMeshSections();
+				Cluster.ShadowComponent->SetVisibility(false);
+				FreeShadowComponents.Add(Cluster.ShadowComponent);
+			}
+
+			It.RemoveCurrent();
+			continue;
+		}
+
+		// Nearby clusters aren't merged until they move out into the distance, since they'd only be thrown away when their chunks changed
+		const int32 LOD = GetClusterLOD(ClusterCoords);
+		const bool bDistant = LOD != INDEX_NONE;
+		if (bDistant && !bMerging && (Cluster.bStale || Cluster.LOD != LOD) && NumMerging < MaxClusterMerges)
+		{
+			StartClusterMerge(ClusterCoords, Cluster, LOD);
+			NumMerging++;
+		}
+
+		// Nearby clusters get shadow meshes too. The old shadow mesh stays up while the new one is merged, and chunks that changed since it was
+		// started cast their own shadows until then, so edits show in shadows straight away but their old shadow takes a few frames to go.
+		const int32 ShadowTriangleBudget = GetClusterShadowTriangleBudget(LOD);
+		const bool bShadowMergeDue = Now - Cluster.ShadowMergeStartTime >= ShadowMergeInterval;
+		if (bShadowProxies && !bShadowMerging && bShadowMergeDue && (Cluster.bShadowStale || Cluster.ShadowTriangleBudget != ShadowTriangleBudget) &&
+			NumShadowMerging < MaxShadowMerges)
+		{
+			StartShadowMerge(ClusterCoords, Cluster, ShadowTriangleBudget);
+			NumShadowMerging++;
+		}
+
+		// Keep drawing the old merged mesh while a new one is on its way; it's far enough away that nobody will notice for a few frames
+		SetClusterShown(ClusterCoords, Cluster, bDistant && Cluster.Component != nullptr);
+	}
+}
+
+// Returns the level of detail a cluster should be drawn at, or INDEX_NONE if it's close enough that its chunks should be drawn instead
+int32 AVoxelTerrainActor::GetClusterLOD(const FIntVector& ClusterCoords) const
+{
+	if (ClusterDistance <= 0)
+	{
+		return INDEX_NONE;
+	}
+
+	// The distance from the streaming origin to the nearest point of the cluster, on the ground plane and in chunks
+	const FVector2D Min = FVector2D(ClusterCoords.X, ClusterCoords.Y) * VOXEL_CLUSTER_SIZE;
+	const FVector2D Max = Min + FVector2D(VOXEL_CLUSTER_SIZE, VOXEL_CLUSTER_SIZE);
+	const FVector2D Nearest(FMath::Clamp(StreamingOrigin.X, Min.X, Max.X), FMath::Clamp(StreamingOrigin.Y, Min.Y, Max.Y));
+	const float Distance = FVector2D::Distance(Nearest, StreamingOrigin);
+	if (Distance < ClusterDistance)
+	{
+		return INDEX_NONE;
+	}
+
+	// Each level starts twice as far out as the one before
+	const int32 LOD = FMath::FloorToInt(FMath::Log2(Distance / ClusterDistance));
+	return FMath::Clamp(LOD, 0, FMath::Max(ClusterTriangleBudgets.Num() - 1, 0));
+}
+
+// Returns the most triangles a cluster's shadow mesh should have at a level of detail
+int32 AVoxelTerrainActor::GetClusterShadowTriangleBudget(int32 LOD) const
+{
+	// A shadow doesn't need more detail than the mesh casting it. Nearby clusters don't have a merged mesh, so they get the full budget.
+	const int32 ClusterBudget = ClusterTriangleBudgets.IsValidIndex(LOD) ? ClusterTriangleBudgets[LOD] : 0;
+	return ClusterBudget > 0 ? FMath::Min(ShadowProxyTriangleBudget, ClusterBudget) : ShadowProxyTriangleBudget;
+}
+
+// Starts merging the meshes of a cluster's chunks in the background
+void AVoxelTerrainActor::StartClusterMerge(const FIntVector& ClusterCoords, FCluster& Cluster, int32 LOD)
+{
+	const int32 TriangleBudget = ClusterTriangleBudgets.IsValidIndex(LOD) ? ClusterTriangleBudgets[LOD] : 0;
+	Cluster.MergeTask = MakeUnique<FAsyncTask<FVoxelClusterMergeTask>>(TerrainMaterials.Num(), TriangleBudget, false, bOptimizeVertexCache);
+	AddClusterChunks(ClusterCoords, Cluster.MergeTask->GetTask(), false);
+
+	Cluster.LOD = LOD;
+	Cluster.bStale = false;
+	Cluster.MergeTask->StartBackgroundTask();
+}
+
+// Starts merging the meshes of a cluster's chunks into its shadow mesh in the background
+void AVoxelTerrainActor::StartShadowMerge(const FIntVector& ClusterCoords, FCluster& Cluster, int32 TriangleBudget)
+{
+	// Shadow depths don't care about materials, so everything goes into one section and is drawn in one go
+	Cluster.ShadowMergeTask = MakeUnique<FAsyncTask<FVoxelClusterMergeTask>>(TerrainMaterials.Num(), TriangleBudget, true, bOptimizeVertexCache);
+	AddClusterChunks(ClusterCoords, Cluster.ShadowMergeTask->GetTask(), true);
+
+	Cluster.ShadowTriangleBudget = TriangleBudget;
+	Cluster.ShadowMergeStartTime = GetWorld()->GetTimeSeconds();
+	Cluster.bShadowStale = false;
+	Cluster.ShadowChangedChunks = 0;
+	Cluster.ShadowMergeTask->StartBackgroundTask();
+}
+
+// Adds the meshes of a cluster's loaded chunks to a merge. Shadow merges leave out translucent materials, which don't cast shadows.
+void AVoxelTerrainActor::AddClusterChunks(const FIntVector& ClusterCoords, FVoxelClusterMergeTask& Task, bool bShadow) const
+{
+	// The task shares the chunks' buffers, which never change once they're in a component
+	TArray<FVoxelMeshBuffersRef> Sections;
+	const FIntVector FirstChunk = ClusterCoords * VOXEL_CLUSTER_SIZE;
+	for (int32 Z = 0; Z < VOXEL_CLUSTER_SIZE; Z++)
+	{
+		for (int32 Y = 0; Y < VOXEL_CLUSTER_SIZE; Y++)
+		{
+			for (int32 X = 0; X < VOXEL_CLUSTER_SIZE; X++)
+			{
+				UVoxelChunkComponent* const* ChunkComponent = LoadedChunks.Find(FirstChunk + FIntVector(X, Y, Z));
+				if (ChunkComponent == nullptr)
+				{
+					continue;
+				}
+
+				Sections.Reset();
+				for (int32 Material = 0; Material < (*ChunkComponent)->GetNumSections(); Material++)
+				{
+					// Section 0 is voxel material 1
+					const bool bTranslucent = GetVoxelMaterialClass(Material + 1) == EVoxelMaterialClass::Translucent;
+					Sections.Add(bShadow && bTranslucent ? FVoxelMeshBuffersRef() : (*ChunkComponent)->GetSection(Material)->Buffers);
+				}
+
+				Task.AddChunk(FIntVector(X, Y, Z), Sections);
+			}
+		}
+	}
+}
+
+// Hands a finished merge to the cluster's component
+void AVoxelTerrainActor::FinishClusterMerge(const FIntVector& ClusterCoords, FCluster& Cluster)
+{
+	if (Cluster.Component == nullptr)
+	{
+		Cluster.Component = FreeClusterComponents.Num() > 0 ? FreeClusterComponents.Pop(false) : CreateClusterComponent(false);
+		Cluster.Component->SetRelativeLocation(GetVoxelChunkOrigin(ClusterCoords * VOXEL_CLUSTER_SIZE));
+		Cluster.Component->SetVisibility(Cluster.bShown);
+	}
+
+	Cluster.Component->SetMeshSections(AcquireMergedSections(Cluster.MergeTask->GetTask()));
+
+	// Chunks may have loaded or unloaded since the last merge, so swap which ones are hidden over in the same frame as the mesh
+	Cluster.MergedChunks = Cluster.MergeTask->GetTask().GetChunkMask();
+	Cluster.MergeTask.Reset();
+
+	if (Cluster.bShown)
+	{
+		UpdateClusterChunkVisibility(ClusterCoords, Cluster);
+	}
+
+	UpdateClusterShadows(ClusterCoords, Cluster);
+}
+
+// Hands a finished shadow merge to the cluster's shadow component
+void AVoxelTerrainActor::FinishShadowMerge(const FIntVector& ClusterCoords, FCluster& Cluster)
+{
+	if (Cluster.ShadowComponent == nullptr)
+	{
+		Cluster.ShadowComponent = FreeShadowComponents.Num() > 0 ? FreeShadowComponents.Pop(false) : CreateClusterComponent(true);
+		Cluster.ShadowComponent->SetRelativeLocation(GetVoxelChunkOrigin(ClusterCoords * VOXEL_CLUSTER_SIZE));
+		Cluster.ShadowComponent->SetVisibility(true);
+	}
+
+	Cluster.ShadowComponent->SetMeshSections(AcquireMergedSections(Cluster.ShadowMergeTask->GetTask()));
+
+	// Chunks that changed while this was merging still cast their own shadows
+	Cluster.ShadowedChunks = Cluster.ShadowMergeTask->GetTask().GetChunkMask() & ~Cluster.ShadowChangedChunks;
+	Cluster.ShadowMergeTask.Reset();
+
+	UpdateClusterShadows(ClusterCoords, Cluster);
 }
 
-// Called after the C++ constructor and after the properties have been initialized.
-void AVoxelTerrainActor::PostInitializeComponents()
+// Moves the sections of a finished merge into shared buffers
+TArray<FVoxelMeshBuffersRef> AVoxelTerrainActor::AcquireMergedSections(FVoxelClusterMergeTask& Task)
 {
-	// Initialize our paged volume.
-	VoxelVolume = MakeShareable(new PagedVolume<MaterialDensityPair44>(new VoxelTerrainPager(Seed, NoiseOctaves, NoiseFrequency, NoiseScale, NoiseOffset, TerrainHeight)));
+	TArray<FVoxelMeshBuffersRef> Buffers;
+	for (FVoxelMeshBuffers& Section : Task.GetSections())
+	{
+		Buffers.Add(FVoxelMeshBufferPool::Get().Acquire(MoveTemp(Section)));
+	}
 
-	// Call the base class's function.
-	Super::PostInitializeComponents();
+	return Buffers;
 }
 
-// Called when the actor has begun playing in the level
-void AVoxelTerrainActor::BeginPlay()
+// Sets up a component for drawing a cluster's merged mesh, or for casting its shadow
+UVoxelChunkComponent* AVoxelTerrainActor::CreateClusterComponent(bool bShadowOnly)
+{
+	// Clusters are only drawn; the chunks underneath them keep their collision
+	UVoxelChunkComponent* Component = NewObject<UVoxelChunkComponent>(this);
+	Component->SetupAttachment(TerrainRoot);
+	Component->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+
+	if (bShadowOnly)
+	{
+		// Shadow meshes have a single section, and only the shadow depth passes draw them. They're drawn with the first material, voxel
+		// material 1, which is opaque, so every triangle in them casts a shadow. That's right for what's merged into them: translucent sections
+		// are left out, and cutout sections such as leaves are simplified past the point where their holes would show, so they cast solid shadows.
+		Component->bRenderInMainPass = false;
+		Component->CastShadow = true;
+		Component->SetMaterial(0, TerrainMaterials.Num() > 0 ? TerrainMaterials[0] : nullptr);
+	}
+	else
+	{
+		for (int32 Material = 0; Material < TerrainMaterials.Num(); Material++)
+		{
+			Component->SetMaterial(Material, TerrainMaterials[Material]);
+		}
+	}
+
+	Component->RegisterComponent();
+	ChunkComponents.Add(Component);
+	return Component;
+}
+
+// Draws either the cluster's merged mesh or its chunks
+void AVoxelTerrainActor::SetClusterShown(const FIntVector& ClusterCoords, FCluster& Cluster, bool bShown)
+{
+	if (Cluster.bShown == bShown)
+	{
+		return;
+	}
+
+	Cluster.bShown = bShown;
+	if (Cluster.Component != nullptr)
+	{
+		Cluster.Component->SetVisibility(bShown);
+	}
+
+	UpdateClusterChunkVisibility(ClusterCoords, Cluster);
+}
+
+// Hides the chunks that the cluster's merged mesh draws while it's shown, and shows the rest
+void AVoxelTerrainActor::UpdateClusterChunkVisibility(const FIntVector& ClusterCoords, const FCluster& Cluster)
+{
+	const FIntVector FirstChunk = ClusterCoords * VOXEL_CLUSTER_SIZE;
+	for (int32 Z = 0; Z < VOXEL_CLUSTER_SIZE; Z++)
+	{
+		for (int32 Y = 0; Y < VOXEL_CLUSTER_SIZE; Y++)
+		{
+			for (int32 X = 0; X < VOXEL_CLUSTER_SIZE; X++)
+			{
+				const FIntVector ChunkCoords = FirstChunk + FIntVector(X, Y, Z);
+				if (UVoxelChunkComponent** ChunkComponent = LoadedChunks.Find(ChunkCoords))
+				{
+					(*ChunkComponent)->SetVisibility(!IsChunkDrawnByCluster(ChunkCoords, Cluster));
+				}
+			}
+		}
+	}
+}
+
+// Whether a chunk is drawn by its cluster's merged mesh rather than its own component
+bool AVoxelTerrainActor::IsChunkDrawnByCluster(const FIntVector& ChunkCoords, const FCluster& Cluster)
+{
+	return Cluster.bShown && (Cluster.MergedChunks & (uint64(1) << GetVoxelClusterChunkIndex(ChunkCoords))) != 0;
+}
+
+// Whether a chunk's current mesh is in its cluster's shadow mesh, so it doesn't need to cast its own shadow
+bool AVoxelTerrainActor::IsChunkShadowedByCluster(const FIntVector& ChunkCoords, const FCluster& Cluster) const
+{
+	return bShadowProxies && Cluster.ShadowComponent != nullptr && (Cluster.ShadowedChunks & (uint64(1) << GetVoxelClusterChunkIndex(ChunkCoords))) != 0;
+}
+
+// Notes that a chunk's mesh has changed or gone, so it casts its own shadow until the cluster's shadow mesh catches up
+void AVoxelTerrainActor::MarkChunkShadowChanged(const FIntVector& ChunkCoords, FCluster& Cluster)
+{
+	const uint64 ChunkBit = uint64(1) << GetVoxelClusterChunkIndex(ChunkCoords);
+	Cluster.ShadowedChunks &= ~ChunkBit;
+	Cluster.ShadowChangedChunks |= ChunkBit;
+}
+
+// Turns shadows on for the cluster's chunks and merged mesh wherever its shadow mesh doesn't cast them, and off everywhere else
+void AVoxelTerrainActor::UpdateClusterShadows(const FIntVector& ClusterCoords, const FCluster& Cluster)
+{
+	const FIntVector FirstChunk = ClusterCoords * VOXEL_CLUSTER_SIZE;
+	for (int32 Z = 0; Z < VOXEL_CLUSTER_SIZE; Z++)
+	{
+		for (int32 Y = 0; Y < VOXEL_CLUSTER_SIZE; Y++)
+		{
+			for (int32 X = 0; X < VOXEL_CLUSTER_SIZE; X++)
+			{
+				const FIntVector ChunkCoords = FirstChunk + FIntVector(X, Y, Z);
+				if (UVoxelChunkComponent** ChunkComponent = LoadedChunks.Find(ChunkCoords))
+				{
+					(*ChunkComponent)->SetCastShadow(!IsChunkShadowedByCluster(ChunkCoords, Cluster));
+				}
+			}
+		}
+	}
+
+	// The merged mesh stands in for its chunks' shadows while they're hidden, unless the shadow mesh has every one of them
+	if (Cluster.Component != nullptr)
+	{
+		const bool bShadowMeshCovers = bShadowProxies && Cluster.ShadowComponent != nullptr && (Cluster.MergedChunks & ~Cluster.ShadowedChunks) == 0;
+		Cluster.Component->SetCastShadow(!bShadowMeshCovers);
+	}
+}
+
+// Hides the chunks and clusters that the nearby terrain hides from the camera, and shows the rest
+void AVoxelTerrainActor::UpdateOcclusion()
 {
-	// Extract the voxel mesh from PolyVox
-	PolyVox::Region ToExtract(Vector3DInt32(0, 0, 0), Vector3DInt32(127, 127, 63));
-	auto ExtractedMesh = extractCubicMesh(VoxelVolume.Get(), ToExtract);
-	auto DecodedMesh = decodeMesh(ExtractedMesh);
+	SCOPE_CYCLE_COUNTER(STAT_VoxelOcclusionCulling);
 
-	// This isn't the most efficient way to handle this, but it works.
-	// To improve the performance of this code, you'll want to modify 
-	// the code so that you only run this section of code once.
-	for (int Material = 0; Material < TerrainMaterials.Num; Material++)
+	APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(this, 0);
+	if (!bOcclusionCulling || CameraManager == nullptr)
 	{
-		// Define variables to pass into the CreateMeshSection function
-		auto Vertices = TArray<FVector>();
-		auto Indices = TArray<int32>();
-		auto Normals = TArray<FVector>();
-		auto UV0 = TArray<FVector2D>();
-		auto Colors = TArray<FColor>();
-		auto Tangents = TArray<FProcMeshTangent>();
+		for (auto& Pair : LoadedChunks)
+		{
+			Pair.Value->SetOccluded(false);
+		}
+
+		for (auto& Pair : Clusters)
+		{
+			if (Pair.Value.Component != nullptr)
+			{
+				Pair.Value.Component->SetOccluded(false);
+			}
+		}
 
-		// Loop over all of the triangle vertex indices
-		for (uint32 i = 0; i < DecodedMesh.getNoOfIndices() - 2; i += 3)
+		SET_DWORD_STAT(STAT_VoxelOccludedChunks, 0);
+		return;
+	}
+
+	// Work in voxel space, where the occupancy and the chunk bounds already are
+	const FTransform& ActorTransform = GetActorTransform();
+	const FRotationMatrix CameraRotation(CameraManager->GetCameraRotation());
+	const FVector Location = ActorTransform.InverseTransformPosition(CameraManager->GetCameraLocation()) / VOXEL_SIZE;
+	const FVector Forward = ActorTransform.InverseTransformVectorNoScale(CameraRotation.GetScaledAxis(EAxis::X));
+	const FVector Right = ActorTransform.InverseTransformVectorNoScale(CameraRotation.GetScaledAxis(EAxis::Y));
+	const FVector Up = ActorTransform.InverseTransformVectorNoScale(CameraRotation.GetScaledAxis(EAxis::Z));
+
+	float AspectRatio = 16.f / 9.f;
+	UGameViewportClient* Viewport = GetWorld()->GetGameViewport();
+	if (Viewport != nullptr)
+	{
+		FVector2D ViewportSize;
+		Viewport->GetViewportSize(ViewportSize);
+		if (ViewportSize.X > 0.f && ViewportSize.Y > 0.f)
 		{
-			// We need to add the vertices of each triangle in reverse or the mesh will be upside down
-			auto Index = DecodedMesh.getIndex(i + 2);
-			auto Vertex2 = DecodedMesh.getVertex(Index);
-			auto TriangleMaterial = Vertex2.data.getMaterial();
+			AspectRatio = ViewportSize.X / ViewportSize.Y;
+		}
+	}
+
+	OcclusionBuffer.SetView(Location, Forward, Right, Up, CameraManager->GetFOVAngle(), AspectRatio);
+
+	// Draw the solid parts of the chunks around the camera. Anything they hide is farther away, so there's no need to sort them.
+	// Chunks that are paged in but not drawn yet would hide things through a hole in the terrain, so only chunks with a mesh count.
+	{
+		FScopeLock Lock(&VolumeLock);
+		const FVoxelChunkIndex& ChunkIndex = Pager->GetChunkIndex();
+		const FIntVector CameraChunk = GetVoxelChunkCoords(FMath::FloorToInt(Location.X), FMath::FloorToInt(Location.Y), FMath::FloorToInt(Location.Z));
 
-			// Before we continue, we need to be sure that the triangle is the right material; we don't want to use verticies from other materials
-			if (TriangleMaterial == (Material + 1))
+		for (int32 Y = -OccluderDistance; Y <= OccluderDistance; Y++)
+		{
+			for (int32 X = -OccluderDistance; X <= OccluderDistance; X++)
 			{
-				// If it is of the same material, then we need to add the correct indices now
-				Indices.Add(Vertices.Add(FPolyVoxVector(Vertex2.position) * 100.f));
+				for (int32 Z = 0; Z < HeightInChunks; Z++)
+				{
+					const FIntVector ChunkCoords(CameraChunk.X + X, CameraChunk.Y + Y, Z);
+					const UVoxelChunkComponent* ChunkComponent = LoadedChunks.FindRef(ChunkCoords);
+					if (ChunkComponent == nullptr || ChunkComponent->GetNumSections() == 0)
+					{
+						continue;
+					}
+
+					const FVoxelChunkIndex::FEntry* Entry = ChunkIndex.FindEntry(ChunkCoords);
+					if (Entry != nullptr && Entry->Occupancy != nullptr)
+					{
+						OcclusionBuffer.AddChunkOccluders(ChunkCoords, *Entry->Occupancy);
+					}
+				}
+			}
+		}
+	}
+
+	// Test the bounds of every chunk against them, including the ones that are occluders themselves; a chunk can't hide itself since its
+	// bounds are only hidden by occluders strictly in front of them
+	const FVector ChunkExtent(VOXEL_CHUNK_SIZE);
+	int32 NumOccluded = 0;
+
+	for (auto& Pair : LoadedChunks)
+	{
+		const FVector Min = FVector(Pair.Key.X, Pair.Key.Y, Pair.Key.Z) * VOXEL_CHUNK_SIZE - FVector(0.5f);
+		const bool bOccluded = !OcclusionBuffer.IsVisible(FBox(Min, Min + ChunkExtent));
+		Pair.Value->SetOccluded(bOccluded);
+		NumOccluded += bOccluded ? 1 : 0;
+	}
+
+	for (auto& Pair : Clusters)
+	{
+		if (Pair.Value.Component != nullptr)
+		{
+			const FVector Min = FVector(Pair.Key.X, Pair.Key.Y, Pair.Key.Z) * (VOXEL_CLUSTER_SIZE * VOXEL_CHUNK_SIZE) - FVector(0.5f);
+			const bool bOccluded = !OcclusionBuffer.IsVisible(FBox(Min, Min + ChunkExtent * VOXEL_CLUSTER_SIZE));
+			Pair.Value.Component->SetOccluded(bOccluded);
+			NumOccluded += bOccluded ? 1 : 0;
+		}
+	}
+
+	SET_DWORD_STAT(STAT_VoxelOccludedChunks, NumOccluded);
+}
+
+// Looks up the voxels at a batch of world locations
+void AVoxelTerrainActor::QueryVoxels(const TArray<FVector>& WorldLocations, TArray<FVoxelQueryResult>& OutResults)
+{
+	QueryCoords.Reset();
+	for (const FVector& WorldLocation : WorldLocations)
+	{
+		QueryCoords.Add(WorldToVoxel(WorldLocation));
+	}
+
+	OutResults.SetNumUninitialized(WorldLocations.Num());
+	QueryVoxelCoords(QueryCoords.GetData(), QueryCoords.Num(), OutResults.GetData());
+}
+
+// Looks up the voxel at a world location
+FVoxelQueryResult AVoxelTerrainActor::QueryVoxel(const FVector& WorldLocation)
+{
+	const FIntVector VoxelCoords = WorldToVoxel(WorldLocation);
+
+	FVoxelQueryResult Result;
+	QueryVoxelCoords(&VoxelCoords, 1, &Result);
+	return Result;
+}
+
+// Traces a line through the voxels
+bool AVoxelTerrainActor::RaycastVoxels(const FVector& WorldStart, const FVector& WorldEnd, FVoxelRaycastHit& OutHit)
+{
+	OutHit = FVoxelRaycastHit();
+	if (!Pager.IsValid())
+	{
+		return false;
+	}
+
+	const FTransform& Transform = GetActorTransform();
+	const FVector Start = Transform.InverseTransformPosition(WorldStart) / VOXEL_SIZE;
+	const FVector End = Transform.InverseTransformPosition(WorldEnd) / VOXEL_SIZE;
+
+	{
+		FScopeLock Lock(&VolumeLock);
+		if (!FVoxelRaycaster::Raycast(Pager->GetChunkIndex(), Start, End, OutHit))
+		{
+			return false;
+		}
+	}
+
+	// The raycaster works in voxels, so bring the hit back into the world
+	OutHit.Location = Transform.TransformPosition(OutHit.Location * VOXEL_SIZE);
+	OutHit.Normal = Transform.TransformVectorNoScale(OutHit.Normal);
+	return true;
+}
+
+// Traces many lines through the voxels
+void AVoxelTerrainActor::RaycastVoxelsMulti(const TArray<FVector>& WorldStarts, const TArray<FVector>& WorldEnds, TArray<FVoxelRaycastHit>& OutHits)
+{
+	// This comes straight from Blueprints, so a mismatch is a mistake in the caller rather than something to crash over
+	if (WorldStarts.Num() != WorldEnds.Num())
+	{
+		UE_LOG(LogVoxelTerrain, Warning, TEXT("RaycastVoxelsMulti was given %d starts but %d ends"), WorldStarts.Num(), WorldEnds.Num());
+		OutHits.Reset();
+		return;
+	}
+
+	const int32 NumRays = WorldStarts.Num();
+	OutHits.SetNum(NumRays);
+	if (!Pager.IsValid())
+	{
+		for (FVoxelRaycastHit& Hit : OutHits)
+		{
+			Hit = FVoxelRaycastHit();
+		}
+
+		return;
+	}
+
+	const FTransform& Transform = GetActorTransform();
+	RaycastStarts.Reset(NumRays);
+	RaycastEnds.Reset(NumRays);
+	for (int32 Ray = 0; Ray < NumRays; Ray++)
+	{
+		RaycastStarts.Add(Transform.InverseTransformPosition(WorldStarts[Ray]) / VOXEL_SIZE);
+		RaycastEnds.Add(Transform.InverseTransformPosition(WorldEnds[Ray]) / VOXEL_SIZE);
+	}
+
+	{
+		FScopeLock Lock(&VolumeLock);
+		FVoxelRaycaster::RaycastPacket(Pager->GetChunkIndex(), RaycastStarts.GetData(), RaycastEnds.GetData(), NumRays, OutHits.GetData());
+	}
+
+	for (FVoxelRaycastHit& Hit : OutHits)
+	{
+		if (Hit.bHit)
+		{
+			Hit.Location = Transform.TransformPosition(Hit.Location * VOXEL_SIZE);
+			Hit.Normal = Transform.TransformVectorNoScale(Hit.Normal);
+		}
+	}
+}
+
+// Sets the material of the voxel at a world location
+bool AVoxelTerrainActor::SetVoxelMaterial(const FVector& WorldLocation, int32 Material)
+{
+	if (!Pager.IsValid())
+	{
+		return false;
+	}
+
+	const FIntVector VoxelCoords = WorldToVoxel(WorldLocation);
 
-				Index = DecodedMesh.getIndex(i + 1);
-				auto Vertex1 = DecodedMesh.getVertex(Index);
-				Indices.Add(Vertices.Add(FPolyVoxVector(Vertex1.position) * 100.f));
+	FScopeLock Lock(&VolumeLock);
+	if (!Pager->IsChunkPagedIn(GetVoxelChunkCoords(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z)))
+	{
+		return false;
+	}
+
+	// Solid voxels are always full. Fluids placed this way start out full too.
+	const uint8 NewMaterial = (uint8)FMath::Clamp(Material, 0, 15);
+	const MaterialDensityPair44 Voxel(NewMaterial, NewMaterial != VOXEL_MATERIAL_AIR ? VOXEL_FLUID_MAX_LEVEL : 0);
+
+	FVoxelAccessor Accessor(VoxelVolume.Get(), Pager->GetChunkIndex());
+	EditVoxel(Accessor, VoxelCoords, Voxel);
+	ResolveEdits();
+	return true;
+}
+
+// Removes every solid voxel within a sphere
+int32 AVoxelTerrainActor::DigSphere(const FVector& WorldCenter, float WorldRadius)
+{
+	if (!Pager.IsValid())
+	{
+		return 0;
+	}
 
-				Index = DecodedMesh.getIndex(i);
-				auto Vertex0 = DecodedMesh.getVertex(Index);
-				Indices.Add(Vertices.Add(FPolyVoxVector(Vertex0.position) * 100.f));
+	const FVector Center = GetActorTransform().InverseTransformPosition(WorldCenter) / VOXEL_SIZE;
+	const float Radius = WorldRadius / (VOXEL_SIZE * GetActorScale3D().GetMax());
+	const FIntVector Min(FMath::FloorToInt(Center.X - Radius), FMath::FloorToInt(Center.Y - Radius), FMath::FloorToInt(Center.Z - Radius));
+	const FIntVector Max(FMath::CeilToInt(Center.X + Radius), FMath::CeilToInt(Center.Y + Radius), FMath::CeilToInt(Center.Z + Radius));
 
-				// Calculate the tangents of our triangle
-				const FVector Edge01 = FPolyVoxVector(Vertex1.position - Vertex0.position);
-				const FVector Edge02 = FPolyVoxVector(Vertex2.position - Vertex0.position);
+	FScopeLock Lock(&VolumeLock);
+	const FVoxelChunkIndex& ChunkIndex = Pager->GetChunkIndex();
+	FVoxelAccessor Accessor(VoxelVolume.Get(), ChunkIndex);
+	const MaterialDensityPair44 Air(VOXEL_MATERIAL_AIR, 0);
 
-				const FVector TangentX = Edge01.GetSafeNormal();
-				FVector TangentZ = (Edge01 ^ Edge02).GetSafeNormal();
+	int32 NumRemoved = 0;
+	for (int32 Z = Min.Z; Z <= Max.Z; Z++)
+	{
+		for (int32 Y = Min.Y; Y <= Max.Y; Y++)
+		{
+			for (int32 X = Min.X; X <= Max.X; X++)
+			{
+				// Leave chunks that haven't been generated alone rather than generating them just to dig them out
+				if (FVector::DistSquared(FVector(X, Y, Z), Center) > Radius * Radius || !ChunkIndex.Contains(GetVoxelChunkCoords(X, Y, Z)))
+				{
+					continue;
+				}
 
-				for (int32 i = 0; i < 3; i++)
+				if (FVoxelIntegrityChecker::IsStructural(Accessor.GetVoxel(X, Y, Z)))
 				{
-					Tangents.Add(FProcMeshTangent(TangentX, false));
-					Normals.Add(TangentZ);
+					EditVoxel(Accessor, FIntVector(X, Y, Z), Air);
+					NumRemoved++;
 				}
 			}
 		}
+	}
+
+	ResolveEdits();
+	return NumRemoved;
+}
+
+// Changes a voxel, keeping everything that depends on it up to date
+void AVoxelTerrainActor::EditVoxel(FVoxelAccessor& Accessor, const FIntVector& VoxelCoords, const MaterialDensityPair44& Voxel)
+{
+	const MaterialDensityPair44 OldVoxel = Accessor.GetVoxel(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z);
+	Accessor.SetVoxel(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z, Voxel);
+
+	AddChunksMeshingVoxel(VoxelCoords, DirtyChunks);
+	Fluids.WakeVoxel(VoxelCoords);
+	BlockTicker.OnVoxelChanged(VoxelCoords);
+	Granular.WakeVoxel(VoxelCoords);
+
+	if (FVoxelIntegrityChecker::IsStructural(OldVoxel) && !FVoxelIntegrityChecker::IsStructural(Voxel))
+	{
+		RemovedVoxels.Add(VoxelCoords);
+	}
+}
+
+// Drops anything the edits since the last call left hanging
+void AVoxelTerrainActor::ResolveEdits()
+{
+	if (RemovedVoxels.Num() == 0)
+	{
+		return;
+	}
+
+	// The bottom of the terrain is the bottom of the first layer of chunks, and everything resting on it is supported
+	const int32 GroundZ = 0;
+
+	Islands.Reset();
+	IntegrityChecker.FindIslands(Pager->GetChunkIndex(), RemovedVoxels, GroundZ, MaxIslandSize, Islands);
+	RemovedVoxels.Reset();
+
+	// Lift the islands out of the terrain so it only has to be remeshed once while they fall
+	DebrisChangedVoxels.Reset();
+	for (const TArray<FIntVector>& Island : Islands)
+	{
+		Debris.AddIsland(VoxelVolume.Get(), Pager->GetChunkIndex(), Island, DirtyChunks, DebrisChangedVoxels);
+		ShowFallingIsland(Debris.GetIslands().Last());
+	}
+
+	OnDebrisChangedVoxels();
+}
+
+// Pours fluid into the voxel at a world location
+bool AVoxelTerrainActor::AddFluid(const FVector& WorldLocation, EVoxelFluid Fluid)
+{
+	if (!Pager.IsValid())
+	{
+		return false;
+	}
+
+	FScopeLock Lock(&VolumeLock);
+	return Fluids.AddFluid(Pager->GetChunkIndex(), WorldToVoxel(WorldLocation), Fluid, VOXEL_FLUID_MAX_LEVEL, DirtyChunks);
+}
+
+// Looks up voxels by their voxel coordinates
+void AVoxelTerrainActor::QueryVoxelCoords(const FIntVector* VoxelCoords, int32 NumQueries, FVoxelQueryResult* OutResults)
+{
+	// Queries can come in before the terrain has begun play
+	if (!Pager.IsValid())
+	{
+		for (int32 QueryIndex = 0; QueryIndex < NumQueries; QueryIndex++)
+		{
+			OutResults[QueryIndex] = FVoxelQueryResult();
+		}
 
-		// Finally create the mesh
-		Mesh->CreateMeshSection(Material, Vertices, Indices, Normals, UV0, Colors, Tangents, true);
-		Mesh->SetMaterial(Material, TerrainMaterials[Material]);
+		return;
 	}
+
+	FScopeLock Lock(&VolumeLock);
+	BatchQuery.Run(Pager->GetChunkIndex(), VoxelCoords, NumQueries, OutResults);
+}
+
+// Converts a world location to voxel coordinates
+FIntVector AVoxelTerrainActor::WorldToVoxel(const FVector& WorldLocation) const
+{
+	// Voxel centers are at whole multiples of VOXEL_SIZE, so round rather than floor
+	const FVector Local = GetActorTransform().InverseTransformPosition(WorldLocation) / VOXEL_SIZE;
+	return FIntVector(FMath::FloorToInt(Local.X + 0.5f), FMath::FloorToInt(Local.Y + 0.5f), FMath::FloorToInt(Local.Z + 0.5f));
+}
+
+// Converts voxel coordinates to the world location of the voxel's center
+FVector AVoxelTerrainActor::VoxelToWorld(const FIntVector& VoxelCoords) const
+{
+	return GetActorTransform().TransformPosition(FVector(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z) * VOXEL_SIZE);
 }
 
 // VoxelTerrainPager Definitions
 // Constructor
 VoxelTerrainPager::VoxelTerrainPager(uint32 NoiseSeed, uint32 Octaves, float Frequency, float Scale, float Offset, float Height) : PagedVolume<MaterialDensityPair44>::Pager(), Seed(NoiseSeed), NoiseOctaves(Octaves), NoiseFrequency(Frequency), NoiseScale(Scale), NoiseOffset(Offset), TerrainHeight(Height)
 {
+	BuildNoiseKernel();
 
+	// The executor sizes its cache from the kernel, so it has to be created after the kernel is built
+	NoiseExecutor = MakeUnique<CNoiseExecutor>(NoiseKernel);
 }
 
-// Called when a new chunk is paged in
-// This function will automatically generate our voxel-based terrain from simplex noise
-void VoxelTerrainPager::pageIn(const PolyVox::Region& region, PagedVolume<MaterialDensityPair44>::Chunk* Chunk)
+// Builds the noise kernel that pageIn evaluates
+void VoxelTerrainPager::BuildNoiseKernel()
 {
-	// This is our kernel. It is responsible for generating our noise.
-	CKernel NoiseKernel;
-
 	// Commonly used constants
 	auto Zero = NoiseKernel.constant(0);
 	auto One = NoiseKernel.constant(1);
@@ -139,28 +1469,118 @@ void VoxelTerrainPager::pageIn(const PolyVox::Region& region, PagedVolume<Materi
 	auto TerrainZScale = NoiseKernel.scaleZ(TerrainScale, Zero);
 
 	// Finally, apply the Z offset we just calculated from the fractal to our ground plane.
-	auto PerturbGradient = NoiseKernel.translateZ(VerticalSelect, TerrainZScale);
+	PerturbGradient = NoiseKernel.translateZ(VerticalSelect, TerrainZScale);
 
 	// Now we want to determine different materials based on a variety of factors.
 	// This is made easier by the fact that we're basically generating a heightmap.
 
 	// For now our grass is always going to appear at the top level, so we don't need to do anything fancy.
-	auto GrassZ = NoiseKernel.subtract(HalfVerticalHeight, TerrainZScale);
+	GrassZ = NoiseKernel.subtract(HalfVerticalHeight, TerrainZScale);
 
 	// To generate pockets of ore we're going to need another noise generator.
-	auto OreFractal = NoiseKernel.simpleRidgedMultifractal(BasisTypes::BASIS_SIMPLEX, InterpolationTypes::INTERP_LINEAR, 2, 5 * NoiseFrequency, Seed);
+	OreFractal = NoiseKernel.simpleRidgedMultifractal(BasisTypes::BASIS_SIMPLEX, InterpolationTypes::INTERP_LINEAR, 2, 5 * NoiseFrequency, Seed);
+}
+
+// Creates a new executor for the noise kernel
+TUniquePtr<CNoiseExecutor> VoxelTerrainPager::CreateNoiseExecutor()
+{
+	return MakeUnique<CNoiseExecutor>(NoiseKernel);
+}
+
+// Hands pageIn voxels that were generated ahead of time
+void VoxelTerrainPager::SetPregeneratedVoxels(const PolyVox::Region* Region, const MaterialDensityPair44* Voxels)
+{
+	PregeneratedRegion = Region;
+	PregeneratedVoxels = Voxels;
+}
+
+// Called when a new chunk is paged in
+// This function will automatically generate our voxel-based terrain from simplex noise
+void VoxelTerrainPager::pageIn(const PolyVox::Region& region, PagedVolume<MaterialDensityPair44>::Chunk* Chunk)
+{
+	// The chunk paged in before this one has finished being constructed by now, so it can be marked as modified
+	MarkChunkModified();
+
+	// Use the voxels the pipeline generated for this chunk if there are any, otherwise generate them now
+	const MaterialDensityPair44* Voxels = PregeneratedVoxels;
+	if (Voxels == nullptr || PregeneratedRegion == nullptr || !(*PregeneratedRegion == region))
+	{
+		PageInVoxels.SetNumUninitialized(region.getWidthInVoxels() * region.getHeightInVoxels() * region.getDepthInVoxels(), false);
+		GenerateRegion(region, *NoiseExecutor, PageInVoxels.GetData());
+		Voxels = PageInVoxels.GetData();
+	}
 
-	CNoiseExecutor TerrainExecutor(NoiseKernel);
+	// Summarise which parts of the chunk are empty so traces can skip them
+	FVoxelChunkOccupancy* Occupancy = nullptr;
+	if (FreeOccupancies.Num() > 0)
+	{
+		Occupancy = FreeOccupancies.Pop(false);
+	}
+	else
+	{
+		Occupancy = new FVoxelChunkOccupancy();
+		Occupancies.Emplace(Occupancy);
+	}
+
+	Occupancy->Build(Voxels);
+
+	// Voxel position within a chunk always start from zero. So if a chunk represents region (4, 8, 12) to (11, 19, 15)
+	// then the valid chunk voxels are from (0, 0, 0) to (7, 11, 3).
+	const int32 Width = region.getWidthInVoxels();
+	const int32 Height = region.getHeightInVoxels();
+	const int32 Depth = region.getDepthInVoxels();
+
+	for (int32 z = 0; z < Depth; z++)
+	{
+		for (int32 y = 0; y < Height; y++)
+		{
+			for (int32 x = 0; x < Width; x++)
+			{
+				Chunk->setVoxel(x, y, z, *Voxels++);
+			}
+		}
+	}
+
+	FVoxelChunkIndex::FEntry Entry;
+	Entry.Chunk = Chunk;
+	Entry.Occupancy = Occupancy;
+	ChunkIndex.Add(GetVoxelChunkCoords(region.getLowerX(), region.getLowerY(), region.getLowerZ()), Entry);
+
+	// The volume only calls pageOut for chunks that have been modified since they were paged in, and it clears that flag once pageIn returns.
+	// If an untouched chunk was evicted we'd never hear about it and its index entry would point at freed memory, so every chunk gets marked
+	// as modified as soon as the next one is paged in. The volume only evicts chunks while paging in a newer one, and never the newest, so
+	// a chunk is always marked before it can be evicted.
+	UnmarkedChunk = Chunk;
+}
+
+// Marks the last chunk that was paged in as modified, so the volume calls pageOut for it when it's evicted
+void VoxelTerrainPager::MarkChunkModified()
+{
+	if (UnmarkedChunk != nullptr)
+	{
+		// Writing a voxel back is the only way to set the chunk's modified flag
+		UnmarkedChunk->setVoxel(0, 0, 0, UnmarkedChunk->getVoxel(0, 0, 0));
+		UnmarkedChunk = nullptr;
+	}
+}
+
+// Generates the voxels of a region
+void VoxelTerrainPager::GenerateRegion(const PolyVox::Region& Region, CNoiseExecutor& TerrainExecutor, MaterialDensityPair44* OutVoxels) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelGenerateChunk);
+
+	const int32 Width = Region.getWidthInVoxels();
+	const int32 Height = Region.getHeightInVoxels();
 
 	// Now that we have our noise setup, let's loop over our chunk and apply it.
-	for (int x = region.getLowerX(); x <= region.getUpperX(); x++)
+	for (int x = Region.getLowerX(); x <= Region.getUpperX(); x++)
 	{
-		for (int y = region.getLowerY(); y <= region.getUpperY() / 2; y++)
+		for (int y = Region.getLowerY(); y <= Region.getUpperY(); y++)
 		{
-			for (int z = region.getLowerZ(); z <= region.getUpperZ(); z++)
+			for (int z = Region.getLowerZ(); z <= Region.getUpperZ(); z++)
 			{
 				// Evaluate the noise
-				auto EvaluatedNoise = TerrainExecutor.evaluateScalar(x, y, z, PerturbGradient);
+				auto EvaluatedNoise = TerrainExecutor.evaluateScalar(x, y, z, PerturbGradient.GetValue());
 				MaterialDensityPair44 Voxel;
 
 				bool bSolid = EvaluatedNoise > 0.5;
@@ -173,7 +1593,7 @@ void VoxelTerrainPager::pageIn(const PolyVox::Region& region, PagedVolume<Materi
 				// Grass = 3
 				// Ore = 4
 
-				int ActualGrassZ = FMath::FloorToInt(TerrainExecutor.evaluateScalar(x, y, z, GrassZ));
+				int ActualGrassZ = FMath::FloorToInt(TerrainExecutor.evaluateScalar(x, y, z, GrassZ.GetValue()));
 				int DirtZ = ActualGrassZ - 1;
 				int DirtThickness = 3;
 
@@ -189,7 +1609,7 @@ void VoxelTerrainPager::pageIn(const PolyVox::Region& region, PagedVolume<Materi
 					}
 					else
 					{
-						auto EvaluatedOreFractal = TerrainExecutor.evaluateScalar(x, y, z, OreFractal);
+						auto EvaluatedOreFractal = TerrainExecutor.evaluateScalar(x, y, z, OreFractal.GetValue());
 
 						if (EvaluatedOreFractal > 1.95)
 							Voxel.setMaterial(4);
@@ -202,10 +1622,8 @@ void VoxelTerrainPager::pageIn(const PolyVox::Region& region, PagedVolume<Materi
 					Voxel.setMaterial(0);
 				}
 
-				// Voxel position within a chunk always start from zero. So if a chunk represents region (4, 8, 12) to (11, 19, 15)
-				// then the valid chunk voxels are from (0, 0, 0) to (7, 11, 3). Hence we subtract the lower corner position of the
-				// region from the volume space position in order to get the chunk space position.
-				Chunk->setVoxel(x - region.getLowerX(), y - region.getLowerY(), z - region.getLowerZ(), Voxel);
+				// Store the voxel relative to the lower corner of the region
+				OutVoxels[(x - Region.getLowerX()) + (y - Region.getLowerY()) * Width + (z - Region.getLowerZ()) * Width * Height] = Voxel;
 			}
 		}
 	}
@@ -214,4 +1632,18 @@ void VoxelTerrainPager::pageIn(const PolyVox::Region& region, PagedVolume<Materi
 // Called when a chunk is paged out
 void VoxelTerrainPager::pageOut(const PolyVox::Region& region, PagedVolume<MaterialDensityPair44>::Chunk* Chunk)
 {
-}
\ No newline at end of file
+	const FIntVector ChunkCoords = GetVoxelChunkCoords(region.getLowerX(), region.getLowerY(), region.getLowerZ());
+
+	// An edit can mark the chunk and get it evicted before the next pageIn does
+	if (Chunk == UnmarkedChunk)
+	{
+		UnmarkedChunk = nullptr;
+	}
+
+	if (const FVoxelChunkIndex::FEntry* Entry = ChunkIndex.FindEntry(ChunkCoords))
+	{
+		FreeOccupancies.Add(Entry->Occupancy);
+	}
+
+	ChunkIndex.Remove(ChunkCoords);
+}
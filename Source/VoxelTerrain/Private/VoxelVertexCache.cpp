@@ -0,0 +1,345 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#include "VoxelTerrain.h"
+#include "VoxelVertexCache.h"
+#include "VoxelTerrainStats.h"
+
+// The size of the LRU cache Forsyth's algorithm simulates while ordering triangles
+static const int32 ForsythCacheSize = 32;
+
+void FVoxelVertexCacheOptimizer::Optimize(FVoxelMeshBuffers& Buffers)
+{
+	SCOPE_CYCLE_COUNTER(STAT_VoxelOptimizeVertexCache);
+
+	const int32 NumTriangles = Buffers.Indices.Num() / 3;
+	if (NumTriangles == 0)
+	{
+		return;
+	}
+
+	const int32 MissesBefore = CountCacheMisses(Buffers.Indices, Buffers.Vertices.Num(), FinalVertices);
+
+	WeldVertices(Buffers);
+	OrderTriangles(WeldSources.Num());
+
+	// Number the vertices in the order the triangles first use them, so they're also read from memory in order
+	FinalVertices.Reset();
+	FinalVertices.Init(INDEX_NONE, WeldSources.Num());
+
+	Output.Reset();
+	const bool bHasUVs = Buffers.UV0.Num() == Buffers.Vertices.Num();
+	const bool bHasColors = Buffers.Colors.Num() == Buffers.Vertices.Num();
+	const bool bHasNormals = Buffers.Normals.Num() == Buffers.Vertices.Num();
+	const bool bHasTangents = Buffers.Tangents.Num() == Buffers.Vertices.Num();
+
+	Output.Indices.SetNumUninitialized(OrderedIndices.Num(), false);
+	for (int32 Index = 0; Index < OrderedIndices.Num(); Index++)
+	{
+		const int32 Welded = OrderedIndices[Index];
+		if (FinalVertices[Welded] == INDEX_NONE)
+		{
+			const int32 Source = WeldSources[Welded];
+			FinalVertices[Welded] = Output.Vertices.Add(Buffers.Vertices[Source]);
+
+			if (bHasNormals)
+			{
+				Output.Normals.Add(Buffers.Normals[Source]);
+			}
+
+			if (bHasUVs)
+			{
+				Output.UV0.Add(Buffers.UV0[Source]);
+			}
+
+			if (bHasColors)
+			{
+				Output.Colors.Add(Buffers.Colors[Source]);
+			}
+
+			if (bHasTangents)
+			{
+				Output.Tangents.Add(Buffers.Tangents[Source]);
+			}
+		}
+
+		Output.Indices[Index] = FinalVertices[Welded];
+	}
+
+	Buffers.SwapWith(Output);
+
+	const int32 MissesAfter = CountCacheMisses(Buffers.Indices, Buffers.Vertices.Num(), FinalVertices);
+
+	TotalTriangles += NumTriangles;
+	TotalMissesBefore += MissesBefore;
+	TotalMissesAfter += MissesAfter;
+
+	INC_DWORD_STAT_BY(STAT_VoxelVertexCacheTriangles, NumTriangles);
+	INC_DWORD_STAT_BY(STAT_VoxelVertexCacheMissesBefore, MissesBefore);
+	INC_DWORD_STAT_BY(STAT_VoxelVertexCacheMissesAfter, MissesAfter);
+
+	UE_LOG(LogVoxelTerrain, VeryVerbose, TEXT("Optimized %d triangles for the vertex cache: ACMR %.3f -> %.3f, %d -> %d vertices"),
+		NumTriangles, float(MissesBefore) / NumTriangles, float(MissesAfter) / NumTriangles, Output.Vertices.Num(), Buffers.Vertices.Num());
+}
+
+float FVoxelVertexCacheOptimizer::GetACMR(const TArray<int32>& Indices, int32 NumVertices)
+{
+	const int32 NumTriangles = Indices.Num() / 3;
+	if (NumTriangles == 0)
+	{
+		return 0.f;
+	}
+
+	TArray<int32> Scratch;
+	return float(CountCacheMisses(Indices, NumVertices, Scratch)) / NumTriangles;
+}
+
+int32 FVoxelVertexCacheOptimizer::CountCacheMisses(const TArray<int32>& Indices, int32 NumVertices, TArray<int32>& Scratch)
+{
+	// Each miss pushes one vertex into the FIFO, so a vertex is still cached if fewer than MeasuredCacheSize misses have happened since its own
+	TArray<int32>& MissedAt = Scratch;
+	MissedAt.Reset();
+	MissedAt.Init(-MeasuredCacheSize - 1, NumVertices);
+
+	int32 NumMisses = 0;
+	for (int32 Index : Indices)
+	{
+		if (NumMisses - MissedAt[Index] > MeasuredCacheSize)
+		{
+			MissedAt[Index] = NumMisses++;
+		}
+	}
+
+	return NumMisses;
+}
+
+void FVoxelVertexCacheOptimizer::WeldVertices(const FVoxelMeshBuffers& Buffers)
+{
+	const int32 NumVertices = Buffers.Vertices.Num();
+	const bool bHasNormals = Buffers.Normals.Num() == NumVertices;
+	const bool bHasUVs = Buffers.UV0.Num() == NumVertices;
+	const bool bHasColors = Buffers.Colors.Num() == NumVertices;
+	const bool bHasTangents = Buffers.Tangents.Num() == NumVertices;
+
+	// Whether two vertices are the same in every attribute
+	auto IsSameVertex = [&](int32 A, int32 B)
+	{
+		return Buffers.Vertices[A] == Buffers.Vertices[B]
+			&& (!bHasNormals || Buffers.Normals[A] == Buffers.Normals[B])
+			&& (!bHasUVs || Buffers.UV0[A] == Buffers.UV0[B])
+			&& (!bHasColors || Buffers.Colors[A] == Buffers.Colors[B])
+			&& (!bHasTangents || (Buffers.Tangents[A].TangentX == Buffers.Tangents[B].TangentX && Buffers.Tangents[A].bFlipTangentY == Buffers.Tangents[B].bFlipTangentY));
+	};
+
+	WeldTable.Reset();
+	WeldSources.Reset();
+	WeldedVertices.SetNumUninitialized(NumVertices, false);
+
+	for (int32 Vertex = 0; Vertex < NumVertices; Vertex++)
+	{
+		// Vertices with the same position and normal are nearly always the same in everything else too
+		uint32 Hash = FCrc::MemCrc32(&Buffers.Vertices[Vertex], sizeof(FVector));
+		if (bHasNormals)
+		{
+			Hash = FCrc::MemCrc32(&Buffers.Normals[Vertex], sizeof(FVector), Hash);
+		}
+
+		int32 Welded = INDEX_NONE;
+		for (auto It = WeldTable.CreateConstKeyIterator(Hash); It; ++It)
+		{
+			if (IsSameVertex(WeldSources[It.Value()], Vertex))
+			{
+				Welded = It.Value();
+				break;
+			}
+		}
+
+		if (Welded == INDEX_NONE)
+		{
+			Welded = WeldSources.Add(Vertex);
+			WeldTable.Add(Hash, Welded);
+		}
+
+		WeldedVertices[Vertex] = Welded;
+	}
+
+	Indices.SetNumUninitialized(Buffers.Indices.Num(), false);
+	for (int32 Index = 0; Index < Buffers.Indices.Num(); Index++)
+	{
+		Indices[Index] = WeldedVertices[Buffers.Indices[Index]];
+	}
+}
+
+float FVoxelVertexCacheOptimizer::GetVertexScore(int32 CachePosition, int32 NumActiveTriangles)
+{
+	// Vertices that no triangle still needs are never worth anything
+	if (NumActiveTriangles == 0)
+	{
+		return -1.f;
+	}
+
+	float Score = 0.f;
+	if (CachePosition >= 0)
+	{
+		// The last triangle's vertices get a fixed score, so that strips aren't favoured over fans. After that it falls off with age.
+		if (CachePosition < 3)
+		{
+			Score = 0.75f;
+		}
+		else
+		{
+			const float Scale = 1.f / (ForsythCacheSize - 3);
+			Score = FMath::Pow(1.f - (CachePosition - 3) * Scale, 1.5f);
+		}
+	}
+
+	// Finish off vertices with few triangles left, so they don't linger and need loading again later
+	return Score + 2.f * FMath::InvSqrt((float)NumActiveTriangles);
+}
+
+void FVoxelVertexCacheOptimizer::OrderTriangles(int32 NumVertices)
+{
+	const int32 NumTriangles = Indices.Num() / 3;
+
+	// Gather the triangles that use each vertex
+	ActiveTriangleCounts.Reset();
+	ActiveTriangleCounts.AddZeroed(NumVertices);
+	for (int32 Index : Indices)
+	{
+		ActiveTriangleCounts[Index]++;
+	}
+
+	VertexTriangleStarts.SetNumUninitialized(NumVertices + 1, false);
+	VertexTriangleStarts[0] = 0;
+	for (int32 Vertex = 0; Vertex < NumVertices; Vertex++)
+	{
+		VertexTriangleStarts[Vertex + 1] = VertexTriangleStarts[Vertex] + ActiveTriangleCounts[Vertex];
+	}
+
+	// Fill each vertex's list, using the counts as cursors and counting them back up as we go
+	VertexTriangles.SetNumUninitialized(Indices.Num(), false);
+	FMemory::Memzero(ActiveTriangleCounts.GetData(), NumVertices * sizeof(int32));
+	for (int32 Index = 0; Index < Indices.Num(); Index++)
+	{
+		const int32 Vertex = Indices[Index];
+		VertexTriangles[VertexTriangleStarts[Vertex] + ActiveTriangleCounts[Vertex]++] = Index / 3;
+	}
+
+	CachePositions.Reset();
+	CachePositions.Init(INDEX_NONE, NumVertices);
+	VertexScores.SetNumUninitialized(NumVertices, false);
+	for (int32 Vertex = 0; Vertex < NumVertices; Vertex++)
+	{
+		VertexScores[Vertex] = GetVertexScore(INDEX_NONE, ActiveTriangleCounts[Vertex]);
+	}
+
+	TriangleScores.SetNumUninitialized(NumTriangles, false);
+	AddedTriangles.Reset();
+	AddedTriangles.AddZeroed(NumTriangles);
+
+	int32 BestTriangle = INDEX_NONE;
+	float BestScore = -1.f;
+	for (int32 Triangle = 0; Triangle < NumTriangles; Triangle++)
+	{
+		const int32* Corners = &Indices[Triangle * 3];
+		TriangleScores[Triangle] = VertexScores[Corners[0]] + VertexScores[Corners[1]] + VertexScores[Corners[2]];
+		if (TriangleScores[Triangle] > BestScore)
+		{
+			BestScore = TriangleScores[Triangle];
+			BestTriangle = Triangle;
+		}
+	}
+
+	// The simulated LRU cache, most recent first, with room for a triangle's worth of vertices to spill off the end
+	int32 Cache[ForsythCacheSize + 3];
+	int32 CacheSize = 0;
+
+	OrderedIndices.SetNumUninitialized(Indices.Num(), false);
+
+	// Where to carry on looking for an unadded triangle when the cache has nothing left to offer
+	int32 SearchCursor = 0;
+
+	for (int32 Added = 0; Added < NumTriangles; Added++)
+	{
+		if (BestTriangle == INDEX_NONE)
+		{
+			// Everything the cache touches has been drawn, so start again from the next triangle that hasn't been. Scanning for the best
+			// score instead would make this quadratic, and the first triangle left is as good a place to start as any.
+			while (AddedTriangles[SearchCursor])
+			{
+				SearchCursor++;
+			}
+
+			BestTriangle = SearchCursor;
+		}
+
+		const int32* Corners = &Indices[BestTriangle * 3];
+		OrderedIndices[Added * 3 + 0] = Corners[0];
+		OrderedIndices[Added * 3 + 1] = Corners[1];
+		OrderedIndices[Added * 3 + 2] = Corners[2];
+		AddedTriangles[BestTriangle] = true;
+
+		// Move the triangle out of its vertices' active lists, which are kept at the front of each vertex's range
+		for (int32 Corner = 0; Corner < 3; Corner++)
+		{
+			const int32 Vertex = Corners[Corner];
+			int32* Triangles = &VertexTriangles[VertexTriangleStarts[Vertex]];
+			const int32 Last = --ActiveTriangleCounts[Vertex];
+			for (int32 Slot = 0; Slot <= Last; Slot++)
+			{
+				if (Triangles[Slot] == BestTriangle)
+				{
+					Swap(Triangles[Slot], Triangles[Last]);
+					break;
+				}
+			}
+		}
+
+		// Put the triangle's vertices at the front of the cache, pushing everything else back
+		int32 NewCache[ForsythCacheSize + 3];
+		int32 NewCacheSize = 0;
+		for (int32 Corner = 0; Corner < 3; Corner++)
+		{
+			NewCache[NewCacheSize++] = Corners[Corner];
+		}
+
+		for (int32 Slot = 0; Slot < CacheSize; Slot++)
+		{
+			const int32 Vertex = Cache[Slot];
+			if (Vertex != Corners[0] && Vertex != Corners[1] && Vertex != Corners[2])
+			{
+				NewCache[NewCacheSize++] = Vertex;
+			}
+		}
+
+		// Rescore everything that was in the cache. Whatever fell off the end has no cache position any more.
+		for (int32 Slot = 0; Slot < NewCacheSize; Slot++)
+		{
+			const int32 Vertex = NewCache[Slot];
+			CachePositions[Vertex] = Slot < ForsythCacheSize ? Slot : INDEX_NONE;
+			VertexScores[Vertex] = GetVertexScore(CachePositions[Vertex], ActiveTriangleCounts[Vertex]);
+		}
+
+		// The next triangle is the best one left that uses a cached vertex
+		BestTriangle = INDEX_NONE;
+		BestScore = -1.f;
+		CacheSize = FMath::Min(NewCacheSize, ForsythCacheSize);
+		for (int32 Slot = 0; Slot < CacheSize; Slot++)
+		{
+			const int32 Vertex = NewCache[Slot];
+			Cache[Slot] = Vertex;
+
+			const int32* Triangles = &VertexTriangles[VertexTriangleStarts[Vertex]];
+			for (int32 Active = 0; Active < ActiveTriangleCounts[Vertex]; Active++)
+			{
+				const int32 Triangle = Triangles[Active];
+				const int32* TriangleCorners = &Indices[Triangle * 3];
+				TriangleScores[Triangle] = VertexScores[TriangleCorners[0]] + VertexScores[TriangleCorners[1]] + VertexScores[TriangleCorners[2]];
+				if (TriangleScores[Triangle] > BestScore)
+				{
+					BestScore = TriangleScores[Triangle];
+					BestTriangle = Triangle;
+				}
+			}
+		}
+	}
+}
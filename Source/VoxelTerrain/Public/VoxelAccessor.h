@@ -0,0 +1,65 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+#include "VoxelChunkIndex.h"
+#include "VoxelOccupancy.h"
+
+// Reads and writes voxels through the terrain's chunk index, remembering the last chunk it touched.
+// Queries, traces and edits tend to hit the same chunk over and over, and those skip the lookup entirely.
+// Only use an accessor while holding the volume's lock, and throw it away before releasing the lock, since the volume can page chunks out at any time after that.
+class VOXELTERRAIN_API FVoxelAccessor
+{
+public:
+	// Constructor
+	FVoxelAccessor(FVoxelVolume* InVolume, const FVoxelChunkIndex& InChunkIndex)
+		: Volume(InVolume)
+		, ChunkIndex(InChunkIndex)
+	{}
+
+	// Returns a voxel, paging its chunk in if it isn't already
+	FORCEINLINE PolyVox::MaterialDensityPair44 GetVoxel(int32 X, int32 Y, int32 Z)
+	{
+		return GetChunk(X, Y, Z)->getVoxel(X & ChunkMask, Y & ChunkMask, Z & ChunkMask);
+	}
+
+	// Changes a voxel, paging its chunk in if it isn't already. Keeps the chunk's occupancy up to date.
+	FORCEINLINE void SetVoxel(int32 X, int32 Y, int32 Z, const PolyVox::MaterialDensityPair44& Voxel)
+	{
+		const FVoxelChunkIndex::FEntry& Entry = GetEntry(X, Y, Z);
+		Entry.Chunk->setVoxel(X & ChunkMask, Y & ChunkMask, Z & ChunkMask, Voxel);
+		Entry.Occupancy->OnVoxelChanged(X & ChunkMask, Y & ChunkMask, Z & ChunkMask, Voxel, *Entry.Chunk);
+	}
+
+	// Returns the chunk that contains a voxel, paging it in if it isn't already
+	FORCEINLINE FVoxelVolume::Chunk* GetChunk(int32 X, int32 Y, int32 Z)
+	{
+		return GetEntry(X, Y, Z).Chunk;
+	}
+
+	// Returns the chunk and occupancy of the chunk that contains a voxel, paging it in if it isn't already
+	FORCEINLINE const FVoxelChunkIndex::FEntry& GetEntry(int32 X, int32 Y, int32 Z)
+	{
+		const FIntVector ChunkCoords = GetVoxelChunkCoords(X, Y, Z);
+		if (LastEntry.Chunk != nullptr && ChunkCoords == LastChunkCoords)
+		{
+			return LastEntry;
+		}
+
+		return FindEntry(ChunkCoords);
+	}
+
+private:
+	static const int32 ChunkMask = VOXEL_CHUNK_SIZE - 1;
+
+	// Looks a chunk up in the index, falling back to the volume to page it in, and remembers it
+	const FVoxelChunkIndex::FEntry& FindEntry(const FIntVector& ChunkCoords);
+
+	FVoxelVolume* Volume;
+	const FVoxelChunkIndex& ChunkIndex;
+
+	// The last chunk we touched. This is a copy, since entries move around in the index as chunks are paged in and out.
+	FIntVector LastChunkCoords = FIntVector::ZeroValue;
+	FVoxelChunkIndex::FEntry LastEntry = { nullptr, nullptr };
+};
@@ -0,0 +1,53 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+#include "VoxelBatchQuery.generated.h"
+
+class FVoxelChunkIndex;
+
+// What a voxel query found
+USTRUCT(BlueprintType)
+struct FVoxelQueryResult
+{
+	GENERATED_USTRUCT_BODY()
+
+	// The voxel's material. 0 is air, and anything else is one more than its index in TerrainMaterials.
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadOnly, VisibleAnywhere) uint8 Material;
+
+	// The voxel's density
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadOnly, VisibleAnywhere) uint8 Density;
+
+	// Whether the voxel's chunk has been generated. Voxels in chunks that haven't are reported as air.
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadOnly, VisibleAnywhere) bool bLoaded;
+
+	FVoxelQueryResult()
+		: Material(0)
+		, Density(0)
+		, bLoaded(false)
+	{}
+};
+
+// Answers a batch of voxel queries at once. The queries are sorted by chunk, so each chunk is looked up once no matter how many queries land in it.
+// Keep one around rather than creating one per batch; it reuses its scratch space.
+class VOXELTERRAIN_API FVoxelBatchQuery
+{
+public:
+	// Looks up NumQueries voxels, writing one result per voxel in the same order. Never pages chunks in.
+	// Call with the volume's lock held.
+	void Run(const FVoxelChunkIndex& ChunkIndex, const FIntVector* VoxelCoords, int32 NumQueries, FVoxelQueryResult* OutResults);
+
+private:
+	struct FEntry
+	{
+		// The packed coordinates of the voxel's chunk
+		uint64 ChunkKey;
+
+		// Where the query came in the batch
+		int32 QueryIndex;
+	};
+
+	// The queries, sorted by chunk
+	TArray<FEntry> Entries;
+};
@@ -0,0 +1,100 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+#include "VoxelCellList.h"
+
+class FVoxelChunkIndex;
+
+// A change a block tick wants to make to a voxel
+struct FVoxelBlockTickEdit
+{
+	FIntVector VoxelCoords;
+	uint8 Material;
+};
+
+// Random block ticks: grass spreads onto uncovered dirt and dies back to dirt when it's covered over, and ore veins slowly fill back in around holes.
+// Each chunk keeps a compact list of the voxels that could change, built when the chunk is first seen and kept up to date as voxels change,
+// so ticks never scan whole chunks. Building a list is spread over as many ticks as its scan budget needs, so chunks streaming in don't stall one.
+// Voxels that can't be judged because a neighbouring chunk isn't paged in stay off the list; when that chunk arrives, the border facing it is
+// scanned again. Chunks tick in parallel on worker threads. They only read the volume and hand back the edits they want to make, which the owner
+// applies in one batch.
+class VOXELTERRAIN_API FVoxelBlockTicker
+{
+public:
+	// The chance that enclosed stone between two ore voxels turns into ore when it ticks
+	static const float OreRegrowChance;
+
+	// Ticks random voxels. Every voxel that could change has a RandomTicksPerChunk / VOXEL_CHUNK_VOLUME chance of ticking, the same as if
+	// RandomTicksPerChunk random voxels of every chunk were ticked, except only voxels that could change are ever visited.
+	// No more than TickBudget voxels tick in total, and no more than ScanBudget voxels are scanned for new chunks' lists. Adds the edits the ticks
+	// want to make to OutEdits. Call with the volume's lock held.
+	void Tick(const FVoxelChunkIndex& ChunkIndex, int32 RandomTicksPerChunk, int32 TickBudget, int32 ScanBudget, TArray<FVoxelBlockTickEdit>& OutEdits);
+
+	// Reconsiders a voxel and its neighbours after the voxel has changed
+	void OnVoxelChanged(const FIntVector& VoxelCoords);
+
+	// The number of voxels that could change
+	int32 GetNumTickableVoxels() const;
+
+private:
+	// A box of voxels in a chunk that still has to be scanned for voxels that belong on the chunk's list
+	struct FPendingScan
+	{
+		FIntVector ChunkCoords;
+
+		// The box, relative to the chunk
+		FIntVector Min;
+		FIntVector Size;
+
+		// How many of the box's voxels have been scanned so far, X first, then Y, then Z
+		int32 NumScanned;
+	};
+
+	// One chunk's share of a tick
+	struct FChunkTask
+	{
+		FIntVector ChunkCoords;
+		FVoxelCellList* Cells;
+
+		// How many voxels to tick
+		int32 NumTicks;
+
+		// The part of a pending scan to do after ticking. ScanStart and ScanEnd count voxels through the box the same way as NumScanned.
+		FIntVector ScanMin;
+		FIntVector ScanSize;
+		int32 ScanStart;
+		int32 ScanEnd;
+
+		// Each task has its own random stream so that ticking in parallel doesn't fight over one
+		FRandomStream Random;
+
+		// The edits the ticks want to make
+		TArray<FVoxelBlockTickEdit> Edits;
+	};
+
+	// Ticks a chunk and does its share of any scan. Only reads the volume.
+	void TickChunk(const FVoxelChunkIndex& ChunkIndex, FChunkTask& Task) const;
+
+	// Queues a scan of a box of a chunk
+	void AddScan(const FIntVector& ChunkCoords, const FIntVector& Min, const FIntVector& Size);
+
+	// The chunks we've seen and the voxels in each that could change
+	TMap<FIntVector, FVoxelCellList*> ChunkCells;
+
+	// Storage for the lists, and the ones that are free to be reused
+	TArray<TUniquePtr<FVoxelCellList>> CellLists;
+	TArray<FVoxelCellList*> FreeCellLists;
+
+	// Scans that haven't finished yet, oldest first
+	TArray<FPendingScan> PendingScans;
+
+	// Scratch space for Tick. Kept around so the tasks' arrays keep their allocations.
+	TArray<FChunkTask> Tasks;
+	TMap<FIntVector, int32> ChunkTasks;
+	TArray<FIntVector> NewChunks;
+
+	// The number of ticks so far, used to seed the random streams
+	uint32 TickCount = 0;
+};
@@ -0,0 +1,88 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+
+// A compact list of some of the cells in a chunk, with a bit per cell so that each cell is only ever on the list once.
+// Simulations keep one per chunk of the cells they need to visit, so they never have to scan whole chunks.
+struct FVoxelCellList
+{
+	// Constructor
+	FVoxelCellList()
+	{
+		FMemory::Memzero(Bits);
+	}
+
+	// Returns the index of a cell from its coordinates relative to the chunk
+	static FORCEINLINE int32 GetCellIndex(int32 X, int32 Y, int32 Z)
+	{
+		return X + (Y << VOXEL_CHUNK_SHIFT) + (Z << (VOXEL_CHUNK_SHIFT * 2));
+	}
+
+	// Returns the coordinates of a cell, relative to the chunk, from its index
+	static FORCEINLINE FIntVector GetCellCoords(int32 CellIndex)
+	{
+		const int32 Mask = VOXEL_CHUNK_SIZE - 1;
+		return FIntVector(CellIndex & Mask, (CellIndex >> VOXEL_CHUNK_SHIFT) & Mask, CellIndex >> (VOXEL_CHUNK_SHIFT * 2));
+	}
+
+	// The number of cells on the list
+	int32 Num() const { return Cells.Num(); }
+
+	// The cell at a position in the list
+	uint16 operator[](int32 Index) const { return Cells[Index]; }
+
+	// Whether a cell is on the list
+	FORCEINLINE bool Contains(int32 CellIndex) const
+	{
+		return (Bits[CellIndex >> 5] & (1u << (CellIndex & 31))) != 0;
+	}
+
+	// Adds a cell to the end of the list if it isn't already on it
+	FORCEINLINE void Add(int32 CellIndex)
+	{
+		uint32& Word = Bits[CellIndex >> 5];
+		const uint32 Bit = 1u << (CellIndex & 31);
+		if ((Word & Bit) == 0)
+		{
+			Word |= Bit;
+			Cells.Add((uint16)CellIndex);
+		}
+	}
+
+	// Removes the cell at a position in the list, moving the last cell into its place
+	FORCEINLINE void RemoveAtSwap(int32 Index)
+	{
+		const uint16 CellIndex = Cells[Index];
+		Bits[CellIndex >> 5] &= ~(1u << (CellIndex & 31));
+		Cells.RemoveAtSwap(Index, 1, false);
+	}
+
+	// Takes the first Count cells off the list, copying them into OutCells
+	void PopFront(int32 Count, TArray<uint16>& OutCells)
+	{
+		OutCells.Reset();
+		OutCells.Append(Cells.GetData(), Count);
+		Cells.RemoveAt(0, Count, false);
+
+		for (const uint16 CellIndex : OutCells)
+		{
+			Bits[CellIndex >> 5] &= ~(1u << (CellIndex & 31));
+		}
+	}
+
+	// Empties the list, keeping its allocation
+	void Reset()
+	{
+		Cells.Reset();
+		FMemory::Memzero(Bits);
+	}
+
+private:
+	// The cells on the list, in the order they were added
+	TArray<uint16> Cells;
+
+	// One bit per cell in the chunk, set if the cell is on the list
+	uint32 Bits[VOXEL_CHUNK_VOLUME / 32];
+};
@@ -0,0 +1,157 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "Components/MeshComponent.h"
+#include "Interfaces/Interface_CollisionDataProvider.h"
+#include "VoxelMeshBuffers.h"
+#include "VoxelChunkComponent.generated.h"
+
+// One section of a chunk component
+struct FVoxelChunkSection
+{
+	// The section's geometry. Shared with the scene proxy, so it must never be modified once it's been set.
+	FVoxelMeshBuffersRef Buffers;
+
+	// Local space bounds of the section's vertices
+	FBox LocalBox;
+
+	// Whether the section is drawn
+	bool bSectionVisible;
+
+	FVoxelChunkSection()
+		: LocalBox(0)
+		, bSectionVisible(true)
+	{}
+};
+
+// The collision of a chunk mesh, cooked from shared mesh buffers.
+// Identical buffers are shared between chunks, so chunk components whose collision is made of the same buffers share one of these and its
+// cooked body rather than each cooking their own copy.
+UCLASS(Transient)
+class VOXELTERRAIN_API UVoxelChunkCollision : public UObject, public IInterface_CollisionDataProvider
+{
+	GENERATED_BODY()
+
+public:
+	// Returns the collision for a set of buffers, cooking it unless a chunk is already using collision made of the same buffers.
+	// Call Release once done with it. Each entry becomes a physical material index.
+	static UVoxelChunkCollision* Acquire(const TArray<FVoxelMeshBuffersRef>& Buffers);
+
+	// Lets go of collision returned by Acquire. Shared collision is kept in the root set, so it's only garbage collected once nothing uses it.
+	void Release();
+
+	// The cooked collision
+	class UBodySetup* GetBodySetup() const { return BodySetup; }
+
+	// IInterface_CollisionDataProvider functions
+	virtual bool GetPhysicsTriMeshData(struct FTriMeshCollisionData* CollisionData, bool InUseAllTriData) override;
+	virtual bool ContainsPhysicsTriMeshData(bool InUseAllTriData) const override;
+	virtual bool WantsNegXTriMesh() override { return false; }
+
+private:
+	// Returns the collision that's currently shared, by a hash of the buffers it's made of. Only used on the game thread.
+	static TMultiMap<uint32, UVoxelChunkCollision*>& GetSharedCollision();
+
+	// Hashes a set of buffers by identity. Identical contents already share buffers, so this is enough to find identical collision.
+	static uint32 HashBuffers(const TArray<FVoxelMeshBuffersRef>& Buffers);
+
+	// The geometry that collision is cooked from
+	TArray<FVoxelMeshBuffersRef> Buffers;
+
+	// The number of components using this collision
+	int32 NumUsers = 0;
+
+	// Collision data
+	UPROPERTY() class UBodySetup* BodySetup;
+};
+
+// Renders the mesh of a terrain chunk.
+// This works much like UProceduralMeshComponent, except that sections are handed over by moving buffers in rather than copying them,
+// and the component, its scene proxy and physics cooking all read the same buffers. Sections with identical buffers also share their GPU buffers.
+// Collision is set separately from the rendered sections so that the terrain can cook it and upload the mesh in different frames.
+UCLASS()
+class VOXELTERRAIN_API UVoxelChunkComponent : public UMeshComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Constructor
+	UVoxelChunkComponent(const FObjectInitializer& ObjectInitializer);
+
+	// Replaces a section with the contents of Buffers without copying them. Buffers comes back empty.
+	void SetMeshSection(int32 SectionIndex, FVoxelMeshBuffers&& Buffers);
+
+	// Replaces a section with already shared buffers. The buffers must not be modified afterwards.
+	void SetMeshSection(int32 SectionIndex, FVoxelMeshBuffersRef Buffers);
+
+	// Replaces every section at once, one per entry, so that the bounds and scene proxy are only updated once however many sections there
+	// are. Collision is left alone; set it once for the whole chunk with SetCollisionMesh.
+	void SetMeshSections(const TArray<FVoxelMeshBuffersRef>& Buffers);
+
+	// Removes a section's geometry
+	void ClearMeshSection(int32 SectionIndex);
+
+	// Removes all of the sections
+	void ClearAllMeshSections();
+
+	// Replaces the collision mesh with the given buffers, cooking it unless another chunk already has the same collision. Each entry becomes a
+	// physical material index. Fluid sections are left out, so fluids can be walked and swum through.
+	void SetCollisionMesh(const TArray<FVoxelMeshBuffersRef>& Buffers);
+
+	// Removes the collision mesh
+	void ClearCollisionMesh();
+
+	// Hides or shows the chunk in the main pass for occlusion culling. It still casts shadows, since whatever hides it from the camera needn't
+	// hide it from the light. This only passes a flag to the scene proxy, so it's cheap enough to change every frame.
+	void SetOccluded(bool bNewOccluded);
+
+	// Whether the chunk has been hidden by occlusion culling
+	bool IsOccluded() const { return bOccluded; }
+
+	// Returns the number of sections
+	int32 GetNumSections() const { return Sections.Num(); }
+
+	// Returns a section, or nullptr if there isn't one at that index
+	const FVoxelChunkSection* GetSection(int32 SectionIndex) const { return Sections.IsValidIndex(SectionIndex) ? &Sections[SectionIndex] : nullptr; }
+
+	// UPrimitiveComponent functions
+	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
+	virtual class UBodySetup* GetBodySetup() override;
+
+	// UMeshComponent functions
+	virtual int32 GetNumMaterials() const override;
+
+	// UActorComponent functions
+	virtual void OnComponentDestroyed(bool bDestroyingHierarchy) override;
+
+private:
+	// USceneComponent functions
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+
+	// Called whenever a section changes
+	void SectionsChanged();
+
+	// Points a section at a set of buffers without updating anything else
+	void SetSectionBuffers(int32 SectionIndex, FVoxelMeshBuffersRef Buffers);
+
+	// Recalculates LocalBounds from the sections
+	void UpdateLocalBounds();
+
+	// Switches to different collision, letting go of the old one
+	void SetCollision(UVoxelChunkCollision* NewCollision);
+
+	// The chunk's sections
+	TArray<FVoxelChunkSection> Sections;
+
+	// Local space bounds of the whole mesh
+	FBoxSphereBounds LocalBounds;
+
+	// The chunk's collision, which may be shared with other chunks
+	UPROPERTY(Transient) UVoxelChunkCollision* Collision;
+
+	// Whether the chunk has been hidden by occlusion culling
+	bool bOccluded;
+
+	friend class FVoxelChunkSceneProxy;
+};
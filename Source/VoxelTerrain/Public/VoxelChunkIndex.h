@@ -0,0 +1,122 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+
+struct FVoxelChunkOccupancy;
+
+// Finds the volume's chunks by chunk coordinates.
+// This is a flat open addressing table keyed by the packed coordinates, so a lookup is a multiply, a shift and usually a probe or two,
+// without the bookkeeping PagedVolume does on every access.
+class VOXELTERRAIN_API FVoxelChunkIndex
+{
+public:
+	// What the index knows about a chunk
+	struct FEntry
+	{
+		// The chunk itself
+		FVoxelVolume::Chunk* Chunk;
+
+		// Which parts of the chunk are empty
+		FVoxelChunkOccupancy* Occupancy;
+	};
+
+	// Constructor
+	FVoxelChunkIndex();
+
+	// Adds a chunk, replacing any chunk already at the same coordinates
+	void Add(const FIntVector& ChunkCoords, const FEntry& Entry);
+
+	// Removes a chunk if it's in the index
+	void Remove(const FIntVector& ChunkCoords);
+
+	// Removes every chunk
+	void Reset();
+
+	// Returns the entry for the chunk at the given coordinates, or nullptr if there isn't one.
+	// The entry can move when chunks are added or removed, so copy it rather than holding on to it.
+	FORCEINLINE const FEntry* FindEntry(const FIntVector& ChunkCoords) const
+	{
+		const uint64 Key = PackCoords(ChunkCoords);
+		for (uint32 Slot = GetHomeSlot(Key); ; Slot = (Slot + 1) & SlotMask)
+		{
+			const FSlot& Candidate = Slots[Slot];
+			if (Candidate.Key == Key)
+			{
+				return &Candidate.Entry;
+			}
+
+			if (Candidate.Key == EmptyKey)
+			{
+				return nullptr;
+			}
+		}
+	}
+
+	// Returns the chunk at the given coordinates, or nullptr if there isn't one
+	FORCEINLINE FVoxelVolume::Chunk* Find(const FIntVector& ChunkCoords) const
+	{
+		const FEntry* Entry = FindEntry(ChunkCoords);
+		return Entry != nullptr ? Entry->Chunk : nullptr;
+	}
+
+	// Whether there's a chunk at the given coordinates
+	bool Contains(const FIntVector& ChunkCoords) const { return Find(ChunkCoords) != nullptr; }
+
+	// The number of chunks in the index
+	int32 Num() const { return NumChunks; }
+
+	// Calls Function(ChunkCoords, Entry) for every chunk in the index, in no particular order
+	template<typename FunctionType>
+	void ForEach(FunctionType Function) const
+	{
+		for (const FSlot& Slot : Slots)
+		{
+			if (Slot.Key != EmptyKey)
+			{
+				Function(UnpackCoords(Slot.Key), Slot.Entry);
+			}
+		}
+	}
+
+	// Packs chunk coordinates into a key. Each coordinate keeps its low 21 bits, which covers a million chunks either side of the origin.
+	static uint64 PackCoords(const FIntVector& ChunkCoords)
+	{
+		return (uint64)(ChunkCoords.X & CoordMask) | ((uint64)(ChunkCoords.Y & CoordMask) << CoordBits) | ((uint64)(ChunkCoords.Z & CoordMask) << (CoordBits * 2));
+	}
+
+	// Turns a key back into chunk coordinates
+	static FIntVector UnpackCoords(uint64 Key);
+
+private:
+	struct FSlot
+	{
+		uint64 Key;
+		FEntry Entry;
+	};
+
+	static const int32 CoordBits = 21;
+	static const uint32 CoordMask = (1u << CoordBits) - 1;
+
+	// Packed keys only use the low 63 bits, so this can never be a real key
+	static const uint64 EmptyKey = ~0ull;
+
+	// The slot a key would be in if nothing else were in the way. Fibonacci hashing spreads neighbouring chunks across the table.
+	FORCEINLINE uint32 GetHomeSlot(uint64 Key) const
+	{
+		return (uint32)((Key * 0x9E3779B97F4A7C15ull) >> SlotShift);
+	}
+
+	// Sets up an empty table with 2^Log2NumSlots slots
+	void InitSlots(uint32 Log2NumSlots);
+
+	// Puts a key into the table. Doesn't check the load factor.
+	void Insert(uint64 Key, const FEntry& Entry);
+
+	// The table. Its size is always a power of two and it's never more than half full, so probe sequences stay short.
+	TArray<FSlot> Slots;
+	uint32 SlotMask = 0;
+	uint32 SlotShift = 64;
+	int32 NumChunks = 0;
+};
@@ -0,0 +1,75 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+#include "VoxelMeshBuffers.h"
+#include "VoxelMeshDecoder.h"
+
+class FVoxelPaddedChunk;
+
+// Turns a chunk into one mesh section per terrain material.
+// A face is meshed wherever a voxel meets a different material that isn't opaque, so opaque faces next to glass, water or leaves are kept,
+// while faces between voxels of the same cutout or translucent material are dropped to keep overdraw down. Each material's section is drawn
+// with that material's blend mode, so only translucent sections end up in the engine's sorted translucency pass.
+// A mesher owns all of the memory it needs and reuses it for every chunk, so keep one around instead of creating one per chunk.
+class VOXELTERRAIN_API FVoxelChunkMesher
+{
+public:
+	// Constructor
+	FVoxelChunkMesher(int32 NumMaterials);
+
+	// Builds the chunk's cubic mesh and sorts its quads into sections. Vertex positions are relative to the chunk, which goes at GetVoxelChunkOrigin.
+	// This only reads the padded chunk, so it doesn't need the volume's lock.
+	void MeshChunk(const FVoxelPaddedChunk& Chunk);
+
+	// The section for a terrain material. Material 0 is the first entry in TerrainMaterials, which is voxel material 1.
+	const FVoxelMeshBuffers& GetSection(int32 Material) const { return Sections[Material]; }
+
+	// Mutable access to a section so it can be moved into a UVoxelChunkComponent. The mesher gets back whatever storage the component hands it.
+	FVoxelMeshBuffers& GetSection(int32 Material) { return Sections[Material]; }
+
+	// The number of sections this mesher produces
+	int32 GetNumSections() const { return Sections.Num(); }
+
+	// The number of times this mesher had to grow its buffers after meshing its first chunk
+	uint32 GetSteadyStateAllocations() const { return SteadyStateAllocations; }
+
+private:
+	// Finds the faces of every slice of the chunk across one axis and merges them into quads
+	void FindQuads(const FVoxelPaddedChunk& Chunk, int32 Axis);
+
+	// Greedily merges the faces in a slice's mask into as few quads as it can. Clears the mask as it goes.
+	void MergeFaces(uint8* Mask, int32 Axis, int32 Slice, bool bFacesPositive);
+
+	// Adds a quad covering Width by Height faces, starting at (U, V) in the slice
+	void AddQuad(int32 Axis, int32 Slice, int32 U, int32 V, int32 Width, int32 Height, uint8 Material, bool bFacesPositive);
+
+	// Decodes the quads and writes them into the sections
+	void WriteSections();
+
+	// The number of bytes allocated by the sections and scratch space
+	SIZE_T GetAllocatedSize() const;
+
+	// One section per terrain material
+	TArray<FVoxelMeshBuffers> Sections;
+
+	// Whether each voxel material is opaque, by material
+	bool OpaqueMaterials[256];
+
+	// The material of each face in the slice being meshed, or zero where there's no face. Holds a mask for each direction the faces can point.
+	TArray<uint8> FaceMasks;
+
+	// The quads found so far, as four encoded corners each, and their materials
+	TArray<FVoxelMeshDecoder::FEncodedVertex> QuadCorners;
+	TArray<uint8> QuadMaterials;
+
+	// Scratch space for writing the sections
+	TArray<FVector> DecodedPositions;
+	TArray<int32> QuadCounts;
+	TArray<int32> SectionCursors;
+
+	// Allocation tracking
+	bool bWarmedUp = false;
+	uint32 SteadyStateAllocations = 0;
+};
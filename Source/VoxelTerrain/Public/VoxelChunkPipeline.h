@@ -0,0 +1,208 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+#include "VoxelMeshBuffers.h"
+#include "VoxelChunkPipeline.generated.h"
+
+class VoxelTerrainPager;
+
+// The stages a chunk goes through on its way from being requested to being drawn.
+// There's no lighting pass in the terrain yet; when there is, it slots in between Generate and Mesh.
+enum class EVoxelPipelineStage : uint8
+{
+	// Generates the chunk's voxels on a worker thread and pages them into the volume
+	Generate,
+
+	// Copies the chunk and its border out of the chunks that are paged in and meshes the copy on a worker thread
+	Mesh,
+
+	// Cooks the chunk's collision on the game thread
+	Collision,
+
+	// Hands the chunk's mesh to its component on the game thread
+	Upload,
+
+	Num
+};
+
+// How much work a pipeline stage is allowed to hold and do at once
+USTRUCT(BlueprintType)
+struct FVoxelPipelineStageSettings
+{
+	GENERATED_USTRUCT_BODY()
+
+	// The most chunks that can be in this stage at once, counting the ones that are finished but waiting for room in the next stage.
+	// When a stage is full the stage before it stops starting new work, so a slow stage can't make the others pile up chunks.
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 Capacity;
+
+	// The number of worker threads for background stages, or the number of chunks processed per tick for game thread stages
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 Workers;
+
+	FVoxelPipelineStageSettings()
+		: Capacity(8)
+		, Workers(1)
+	{}
+
+	FVoxelPipelineStageSettings(int32 InCapacity, int32 InWorkers)
+		: Capacity(InCapacity)
+		, Workers(InWorkers)
+	{}
+};
+
+// Refers to a job in the pipeline. Handles stay safe to use after their job is finished or cancelled; they just stop doing anything.
+struct FVoxelChunkJobHandle
+{
+	// The chunk the job is for
+	FIntVector ChunkCoords;
+
+	// Tells apart jobs for the same chunk, since jobs are recycled. Zero means the handle doesn't refer to a job.
+	uint32 Serial;
+
+	FVoxelChunkJobHandle()
+		: ChunkCoords(FIntVector::ZeroValue)
+		, Serial(0)
+	{}
+
+	bool IsValid() const { return Serial != 0; }
+};
+
+// A chunk making its way through the pipeline. Jobs are recycled, so their buffers keep their allocations between chunks.
+struct FVoxelChunkJob
+{
+	// The chunk this job is for
+	FIntVector ChunkCoords;
+
+	// Which use of this job object this is. See FVoxelChunkJobHandle.
+	uint32 Serial = 0;
+
+	// Jobs with lower values are worked on first
+	float Priority = 0.f;
+
+	// Set when the chunk is no longer needed. Workers check this between steps and skip whatever is left.
+	FThreadSafeBool bCancelled;
+
+	// The chunk's voxels, generated before it's paged into the volume
+	TArray<PolyVox::MaterialDensityPair44> Voxels;
+
+	// The chunk's mesh, one section per terrain material
+	TArray<FVoxelMeshBuffersRef> Sections;
+
+	// The neighbours that weren't paged in when the chunk was copied for meshing, as a mask of FVoxelPaddedChunk::GetNeighbourBit.
+	// The mesh treats them as air, so it has to be built again once they arrive.
+	uint32 MissingNeighbours = 0;
+};
+
+// Runs chunks through generation, meshing, collision and upload.
+// Background stages run on their own worker threads. Game thread stages are run by whoever owns the pipeline, using PopJob and FinishJob.
+class VOXELTERRAIN_API FVoxelChunkPipeline
+{
+public:
+	// Constructor. Starts the worker threads. With bInOptimizeVertexCache, the mesh stage also reorders each section for the vertex cache.
+	FVoxelChunkPipeline(FVoxelVolume* InVolume, VoxelTerrainPager* InPager, FCriticalSection* InVolumeLock, int32 InNumMaterials, const TArray<FVoxelPipelineStageSettings>& InStageSettings, bool bInOptimizeVertexCache);
+
+	// Destructor. Stops the worker threads.
+	~FVoxelChunkPipeline();
+
+	// Starts a job for a chunk, or updates the priority of the chunk's job if it already has one. Returns false if the first stage is full.
+	// Jobs with lower priority values are worked on first.
+	bool TryRequestChunk(const FIntVector& ChunkCoords, float Priority, FVoxelChunkJobHandle* OutHandle = nullptr);
+
+	// Whether a chunk has a job anywhere in the pipeline
+	bool IsChunkInFlight(const FIntVector& ChunkCoords) const;
+
+	// Returns a handle to a chunk's job, or an invalid handle if it doesn't have one
+	FVoxelChunkJobHandle FindJob(const FIntVector& ChunkCoords) const;
+
+	// Cancels a job. If it's waiting in a stage it's dropped straight away; if a worker has it, the worker skips whatever is left of it.
+	void CancelJob(const FVoxelChunkJobHandle& Handle);
+
+	// Changes the priority of a job
+	void SetJobPriority(const FVoxelChunkJobHandle& Handle, float Priority);
+
+	// Recalculates the priority of every job. Jobs that get a negative priority are cancelled.
+	void UpdatePriorities(TFunctionRef<float(const FIntVector&)> GetPriority);
+
+	// Takes the highest priority job waiting in a stage, or returns nullptr if there isn't one
+	FVoxelChunkJob* PopJob(EVoxelPipelineStage Stage);
+
+	// Marks a job taken with PopJob as done. It moves on to the next stage as soon as that stage has room.
+	void FinishJob(EVoxelPipelineStage Stage, FVoxelChunkJob* Job);
+
+	// The settings of a stage
+	const FVoxelPipelineStageSettings& GetStageSettings(EVoxelPipelineStage Stage) const { return Stages[(int32)Stage].Settings; }
+
+	// The number of chunks in a stage, including the ones that are finished but waiting for room in the next stage
+	int32 GetStageDepth(EVoxelPipelineStage Stage) const;
+
+	// Publishes the queue depths as stats. Called on the game thread once per tick.
+	void Tick();
+
+private:
+	class FWorker;
+
+	// Bookkeeping for one stage
+	struct FStage
+	{
+		FVoxelPipelineStageSettings Settings;
+
+		// Jobs waiting to be worked on
+		TArray<FVoxelChunkJob*> Queue;
+
+		// Jobs that are done but waiting for room in the next stage
+		TArray<FVoxelChunkJob*> Finished;
+
+		// Jobs being worked on
+		int32 NumInFlight = 0;
+
+		// The number of jobs this stage is holding
+		int32 GetDepth() const { return Queue.Num() + Finished.Num() + NumInFlight; }
+
+		// Whether the stage can take another job
+		bool HasRoom() const { return GetDepth() < Settings.Capacity; }
+	};
+
+	// Moves finished jobs into the next stage for as long as it has room. Call with PipelineLock held.
+	void AdvanceJobs();
+
+	// Wakes the workers of a stage. Call with PipelineLock held.
+	void WakeWorkers(EVoxelPipelineStage Stage);
+
+	// Retires a job that has made it through every stage or has been cancelled. Call with PipelineLock held.
+	void RetireJob(FVoxelChunkJob* Job);
+
+	// Cancels a job and drops it if no one is working on it. Returns whether that freed up room in a stage. Call with PipelineLock held.
+	bool CancelJobLocked(FVoxelChunkJob* Job);
+
+	// Work done by the background stages
+	void GenerateChunk(FVoxelChunkJob& Job, FWorker& Worker);
+	void MeshChunk(FVoxelChunkJob& Job, FWorker& Worker);
+
+	// The terrain we're building chunks for
+	FVoxelVolume* Volume;
+	VoxelTerrainPager* Pager;
+	FCriticalSection* VolumeLock;
+	int32 NumMaterials;
+	bool bOptimizeVertexCache;
+
+	// Guards all of the stages and jobs
+	mutable FCriticalSection PipelineLock;
+
+	FStage Stages[(int32)EVoxelPipelineStage::Num];
+
+	// Every chunk with a job in the pipeline
+	TMap<FIntVector, FVoxelChunkJob*> ActiveJobs;
+
+	// Jobs that can be reused
+	TArray<FVoxelChunkJob*> FreeJobs;
+
+	// The serial given to the next job
+	uint32 NextSerial = 1;
+
+	// Scratch space for UpdatePriorities
+	TArray<FVoxelChunkJob*> CancelledScratch;
+
+	// Background worker threads
+	TArray<FWorker*> Workers;
+};
@@ -0,0 +1,77 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+#include "VoxelMeshBuffers.h"
+#include "Async/AsyncWork.h"
+
+// How many chunks wide a cluster is along each axis. Distant chunks are drawn a cluster at a time, by one component with one combined mesh.
+const int32 VOXEL_CLUSTER_SIZE = 4;
+
+// log2(VOXEL_CLUSTER_SIZE), for turning chunk coordinates into cluster coordinates
+const int32 VOXEL_CLUSTER_SHIFT = 2;
+static_assert((1 << VOXEL_CLUSTER_SHIFT) == VOXEL_CLUSTER_SIZE, "VOXEL_CLUSTER_SHIFT doesn't match VOXEL_CLUSTER_SIZE");
+
+// Returns the cluster that contains a chunk. The shift rounds down, so negative coordinates end up in the right cluster.
+inline FIntVector GetVoxelClusterCoords(const FIntVector& ChunkCoords)
+{
+	return FIntVector(ChunkCoords.X >> VOXEL_CLUSTER_SHIFT, ChunkCoords.Y >> VOXEL_CLUSTER_SHIFT, ChunkCoords.Z >> VOXEL_CLUSTER_SHIFT);
+}
+
+// Returns which of its cluster's chunks a chunk is, from 0 to VOXEL_CLUSTER_SIZE^3 - 1
+inline int32 GetVoxelClusterChunkIndex(const FIntVector& ChunkCoords)
+{
+	const int32 Mask = VOXEL_CLUSTER_SIZE - 1;
+	return (ChunkCoords.X & Mask) | ((ChunkCoords.Y & Mask) << VOXEL_CLUSTER_SHIFT) | ((ChunkCoords.Z & Mask) << (VOXEL_CLUSTER_SHIFT * 2));
+}
+
+static_assert(VOXEL_CLUSTER_SIZE * VOXEL_CLUSTER_SIZE * VOXEL_CLUSTER_SIZE <= 64, "A cluster's chunks have to fit in a 64 bit mask");
+
+// Merges the meshes of a cluster's chunks into one mesh per material, relative to the cluster's first chunk, then simplifies it down to a
+// triangle budget. The cluster's outside faces are left alone so that it still meets its neighbours whatever their level of detail. Meant to run on the thread pool through FAsyncTask. It only reads the chunks' shared buffers, which never change, so it doesn't need any locks.
+class VOXELTERRAIN_API FVoxelClusterMergeTask : public FNonAbandonableTask
+{
+public:
+	// Constructor. A TriangleBudget of zero keeps every triangle. With bInMergeMaterials every material goes into one section, for meshes
+	// that are never seen in colour such as shadow proxies. With bInOptimizeVertexCache the merged sections are reordered for the vertex cache.
+	FVoxelClusterMergeTask(int32 NumMaterials, int32 InTriangleBudget, bool bInMergeMaterials, bool bInOptimizeVertexCache);
+
+	// Adds a chunk's sections to be merged. ChunkOffset is where the chunk is in the cluster, in chunks.
+	void AddChunk(const FIntVector& ChunkOffset, const TArray<FVoxelMeshBuffersRef>& ChunkSections);
+
+	// The merged mesh, one section per material or just one if materials are merged. Only valid once the task is done.
+	TArray<FVoxelMeshBuffers>& GetSections() { return Sections; }
+
+	// A bit for each chunk that was added, by GetVoxelClusterChunkIndex
+	uint64 GetChunkMask() const { return ChunkMask; }
+
+	// FAsyncTask functions
+	void DoWork();
+	TStatId GetStatId() const;
+
+private:
+	// A chunk to be merged
+	struct FChunk
+	{
+		// Where the chunk's vertices go in the cluster
+		FVector Offset;
+
+		TArray<FVoxelMeshBuffersRef> Sections;
+	};
+
+	TArray<FChunk> Chunks;
+	uint64 ChunkMask;
+
+	// The most triangles the merged mesh can have, across all of its sections
+	int32 TriangleBudget;
+
+	// Whether every material goes into the first section
+	bool bMergeMaterials;
+
+	// Whether to reorder the merged sections for the vertex cache
+	bool bOptimizeVertexCache;
+
+	// The merged mesh
+	TArray<FVoxelMeshBuffers> Sections;
+};
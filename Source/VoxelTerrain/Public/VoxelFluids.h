@@ -0,0 +1,121 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+#include "VoxelCellList.h"
+#include "VoxelFluids.generated.h"
+
+class FVoxelChunkIndex;
+struct FVoxelChunkOccupancy;
+
+// The fluids that can flow through the terrain
+UENUM(BlueprintType)
+enum class EVoxelFluid : uint8
+{
+	Water,
+	Lava
+};
+
+// A cellular automaton that moves water and lava through the volume. Fluid voxels keep how full they are in their density.
+// Only cells that might move are visited: each chunk keeps a compact list of its active cells, and cells drop off the list once they settle.
+// Chunks are stepped in parallel in eight passes, one per corner of a 2x2x2 checkerboard, so no two chunks stepping at the same time touch.
+// Anything a chunk does to its neighbours is queued up and applied between passes.
+class VOXELTERRAIN_API FVoxelFluidSimulation
+{
+public:
+	// Lava only flows on every this many steps, so it creeps along slower than water
+	static const int32 LavaFlowInterval = 4;
+
+	// The material fluid voxels are made of
+	static uint8 GetFluidMaterial(EVoxelFluid Fluid) { return Fluid == EVoxelFluid::Lava ? VOXEL_MATERIAL_LAVA : VOXEL_MATERIAL_WATER; }
+
+	// Whether a material is a fluid
+	static bool IsFluidMaterial(uint8 Material) { return IsVoxelMaterialFluid(Material); }
+
+	// Pours fluid into a voxel, up to VOXEL_FLUID_MAX_LEVEL. Returns false if the voxel is solid, holds the other fluid or isn't paged in.
+	// Adds chunks whose mesh changed to OutDirtyChunks. Call with the volume's lock held.
+	bool AddFluid(const FVoxelChunkIndex& ChunkIndex, const FIntVector& VoxelCoords, EVoxelFluid Fluid, uint8 Level, TSet<FIntVector>& OutDirtyChunks);
+
+	// Wakes a voxel and its neighbours, e.g. after the terrain next to some fluid has been dug out. Call with the volume's lock held.
+	void WakeVoxel(const FIntVector& VoxelCoords);
+
+	// Runs one step, visiting at most CellBudget active cells. Cells past the budget are left for the next step, so a flood can't blow up the frame.
+	// Adds chunks whose mesh changed to OutDirtyChunks. Call with the volume's lock held.
+	void Step(const FVoxelChunkIndex& ChunkIndex, int32 CellBudget, TSet<FIntVector>& OutDirtyChunks);
+
+	// The number of cells waiting to be visited
+	int32 GetNumActiveCells() const;
+
+private:
+	// Fluid flowing out of a chunk into one of its neighbours
+	struct FTransfer
+	{
+		FIntVector VoxelCoords;
+
+		// The voxel the fluid came from, which gets back whatever doesn't fit
+		FIntVector SourceCoords;
+
+		uint8 Material;
+		uint8 Amount;
+	};
+
+	// One chunk's share of a step
+	struct FChunkTask
+	{
+		FIntVector ChunkCoords;
+		FVoxelCellList* ActiveCells;
+
+		// The cells to visit this step, taken off the front of the chunk's active list
+		TArray<uint16> Cells;
+
+		// What the chunk did to its neighbours, applied after the pass
+		TArray<FTransfer> Transfers;
+		TArray<FIntVector> Wakes;
+
+		// Voxels whose material changed, so the chunks drawing them need remeshing
+		TArray<FIntVector> Changed;
+	};
+
+	// Steps the cells of one chunk. Only touches the chunk itself and the task; reads its neighbours' voxels but never writes them.
+	void StepChunk(const FVoxelChunkIndex& ChunkIndex, FChunkTask& Task) const;
+
+	// Applies what a chunk did to its neighbours
+	void ApplyTask(const FVoxelChunkIndex& ChunkIndex, FChunkTask& Task, TSet<FIntVector>& OutDirtyChunks);
+
+	// Adds up to InOutAmount of a fluid to a voxel that isn't being stepped, leaving InOutAmount holding whatever didn't fit. Fluid poured into
+	// the other fluid is used up turning it to stone. Returns whether the voxel's material changed.
+	static bool PourInto(FVoxelVolume::Chunk& Chunk, FVoxelChunkOccupancy& Occupancy, int32 X, int32 Y, int32 Z, uint8 Material, uint8& InOutAmount);
+
+	// Pours fluid back into the voxel it came from. Anything that still doesn't fit is kept in Spills.
+	void ReturnFluid(const FVoxelChunkIndex& ChunkIndex, const FIntVector& VoxelCoords, uint8 Material, uint8 Amount, TSet<FIntVector>& OutDirtyChunks);
+
+	// Adds a single voxel to its chunk's active list
+	void ActivateVoxel(const FIntVector& VoxelCoords);
+
+	// Returns the active cells of a chunk, creating the list if it doesn't have one
+	FVoxelCellList& FindOrAddActiveCells(const FIntVector& ChunkCoords);
+
+	// The cells that might move on the next step, for each chunk that has any
+	TMap<FIntVector, FVoxelCellList*> ChunkActiveCells;
+
+	// Storage for the lists, and the ones that are free to be reused
+	TArray<TUniquePtr<FVoxelCellList>> CellLists;
+	TArray<FVoxelCellList*> FreeCellLists;
+
+	// The tasks for each checkerboard pass. Kept around so their arrays keep their allocations between steps.
+	TArray<FChunkTask> Passes[8];
+
+	// Fluid that couldn't be poured anywhere when it was handed back, by the voxel it belongs in. It's poured in again at the start of each step
+	// until it fits, so no fluid is ever lost.
+	TArray<FTransfer> Spills;
+
+	// Scratch space for Step
+	TArray<FIntVector> ActiveChunks;
+
+	// The number of steps taken so far
+	uint32 StepCount = 0;
+
+	// Where the next step starts handing out its budget, so that chunks past the budget go first next time
+	int32 BudgetCursor = 0;
+};
@@ -0,0 +1,43 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+
+class FVoxelChunkIndex;
+
+// Makes sand and gravel fall. A voxel that changes wakes its column, and the next step collapses the whole run of sand and gravel above
+// the gap in one go, dropping it straight onto whatever is below instead of moving it a voxel per step. Whatever was in the gap, air or fluid,
+// ends up on top of the run.
+class VOXELTERRAIN_API FVoxelGranularSimulation
+{
+public:
+	// Whether a material falls when there's nothing under it
+	static bool IsGranularMaterial(uint8 Material) { return Material == VOXEL_MATERIAL_SAND || Material == VOXEL_MATERIAL_GRAVEL; }
+
+	// Wakes the column of a voxel that changed. The voxel itself might have been left without support, or the voxel above it might have.
+	void WakeVoxel(const FIntVector& VoxelCoords);
+
+	// Collapses woken columns until VoxelBudget voxels have been moved or looked at. A column is always collapsed completely once started;
+	// columns past the budget are left for the next step, so an avalanche spreads over several ticks instead of stalling one.
+	// Adds chunks whose mesh changed to OutDirtyChunks, voxels that changed to OutChangedVoxels and voxels that stopped being solid to
+	// OutRemovedVoxels. Call with the volume's lock held.
+	void Step(FVoxelVolume* Volume, const FVoxelChunkIndex& ChunkIndex, int32 VoxelBudget, TSet<FIntVector>& OutDirtyChunks, TArray<FIntVector>& OutChangedVoxels, TArray<FIntVector>& OutRemovedVoxels);
+
+	// Whether any columns are waiting to be checked
+	bool IsEmpty() const { return WokenVoxels.Num() == 0; }
+
+	// The number of woken voxels waiting to be checked
+	int32 GetNumWokenVoxels() const { return WokenVoxels.Num(); }
+
+private:
+	// Collapses the column a woken voxel is in, if anything there can fall. Returns the number of voxels it looked at.
+	int32 CollapseColumn(class FVoxelAccessor& Accessor, const FVoxelChunkIndex& ChunkIndex, const FIntVector& VoxelCoords, TSet<FIntVector>& OutDirtyChunks, TArray<FIntVector>& OutChangedVoxels, TArray<FIntVector>& OutRemovedVoxels);
+
+	// Voxels that changed since their columns were last checked
+	TSet<FIntVector> WokenVoxels;
+
+	// Scratch space for CollapseColumn: the column from where the run lands to the top of the run, before and after
+	TArray<PolyVox::MaterialDensityPair44> OldColumn;
+	TArray<PolyVox::MaterialDensityPair44> NewColumn;
+};
@@ -0,0 +1,87 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+
+class FVoxelChunkIndex;
+
+// Finds pieces of terrain that digging has cut loose from the ground
+class VOXELTERRAIN_API FVoxelIntegrityChecker
+{
+public:
+	// Whether a voxel holds up the voxels resting on it. Air and fluids don't.
+	static bool IsStructuralMaterial(uint8 Material)
+	{
+		return Material != VOXEL_MATERIAL_AIR && Material != VOXEL_MATERIAL_WATER && Material != VOXEL_MATERIAL_LAVA;
+	}
+
+	static bool IsStructural(const PolyVox::MaterialDensityPair44& Voxel)
+	{
+		return IsStructuralMaterial(Voxel.getMaterial());
+	}
+
+	// Looks for islands next to voxels that were just removed. A search floods out through structural voxels from each neighbour of a removed voxel,
+	// and stops as soon as it reaches the ground (voxels at or below GroundZ), a chunk that isn't paged in, a voxel an earlier search found was
+	// supported, or MaxIslandSize voxels. That keeps the search to the neighbourhood of the edit. A search that runs out of voxels before any of
+	// those has found an island, which is added to OutIslands. Call with the volume's lock held.
+	void FindIslands(const FVoxelChunkIndex& ChunkIndex, const TArray<FIntVector>& RemovedVoxels, int32 GroundZ, int32 MaxIslandSize, TArray<TArray<FIntVector>>& OutIslands);
+
+private:
+	// Floods out from one voxel. Returns true if everything it reached is an island.
+	bool SearchFrom(const FVoxelChunkIndex& ChunkIndex, const FIntVector& Seed, int32 SearchIndex, int32 GroundZ, int32 MaxIslandSize);
+
+	// Every voxel reached by this call to FindIslands, and the search that reached it
+	TMap<FIntVector, int32> Visited;
+
+	// The voxels reached by the current search, in the order they were reached
+	TArray<FIntVector> Reached;
+};
+
+// Islands that have been cut loose, falling a voxel at a time until they land on something.
+// Islands are lifted out of the volume while they fall and put back where they land, so the terrain around them is only remeshed twice
+// however far they fall. The owner draws them in between, e.g. with a sub-volume that it moves down as they fall.
+class VOXELTERRAIN_API FVoxelFallingDebris
+{
+public:
+	// One falling island
+	struct FIsland
+	{
+		// Tells islands apart
+		uint32 Id = 0;
+
+		// Where the island's voxels started out, and what they're made of
+		TArray<FIntVector> Voxels;
+		TArray<PolyVox::MaterialDensityPair44> Contents;
+
+		// The same voxels, for checking whether the voxel under one of them is part of the island
+		TSet<FIntVector> Members;
+
+		// How far the island has fallen so far
+		int32 Drop = 0;
+	};
+
+	// Lifts an island out of the volume and starts it falling. Returns the island's id.
+	// Adds chunks whose mesh changed to OutDirtyChunks and voxels that changed to OutChangedVoxels. Call with the volume's lock held.
+	uint32 AddIsland(FVoxelVolume* Volume, const FVoxelChunkIndex& ChunkIndex, const TArray<FIntVector>& Voxels, TSet<FIntVector>& OutDirtyChunks, TArray<FIntVector>& OutChangedVoxels);
+
+	// Moves every falling island down a voxel. Islands that can't move have landed, and are put back into the volume where they are.
+	// Moves islands that landed into OutLandedIslands, and adds chunks whose mesh changed to OutDirtyChunks and voxels that changed to OutChangedVoxels.
+	// Call with the volume's lock held.
+	void Step(FVoxelVolume* Volume, const FVoxelChunkIndex& ChunkIndex, TSet<FIntVector>& OutDirtyChunks, TArray<FIntVector>& OutChangedVoxels, TArray<FIsland>& OutLandedIslands);
+
+	// Whether anything is falling
+	bool IsEmpty() const { return Islands.Num() == 0; }
+
+	// The islands that are falling
+	const TArray<FIsland>& GetIslands() const { return Islands; }
+
+private:
+	// Whether an island can fall another voxel
+	bool CanFall(const FVoxelChunkIndex& ChunkIndex, const FIsland& Island) const;
+
+	TArray<FIsland> Islands;
+
+	// The id given to the next island
+	uint32 NextIslandId = 1;
+};
@@ -0,0 +1,90 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "ProceduralMeshComponent.h"
+
+// The geometry of one material section of a chunk.
+// The arrays are only ever Reset() between chunks, so once they have grown to fit a chunk they never touch the allocator again.
+struct VOXELTERRAIN_API FVoxelMeshBuffers
+{
+	TArray<FVector> Vertices;
+	TArray<int32> Indices;
+	TArray<FVector> Normals;
+	TArray<FVector2D> UV0;
+	TArray<FColor> Colors;
+	TArray<FProcMeshTangent> Tangents;
+
+	// Empties the buffers without freeing their memory
+	void Reset();
+
+	// Swaps the contents of two sets of buffers. No elements are copied.
+	void SwapWith(FVoxelMeshBuffers& Other);
+
+	// Returns the number of bytes the buffers have allocated
+	SIZE_T GetAllocatedSize() const;
+
+	// Returns a hash of the contents of the buffers
+	uint32 GetContentHash() const;
+
+	// Whether two sets of buffers hold exactly the same geometry
+	bool HasSameContents(const FVoxelMeshBuffers& Other) const;
+};
+
+// Mesh buffers that are shared between a chunk component, its scene proxy and physics cooking.
+// They're immutable once handed to a component and go back to FVoxelMeshBufferPool when the last reference is released.
+// Chunks with identical geometry, such as flat plains or buried chunks with nothing to draw, all share the same set.
+class VOXELTERRAIN_API FVoxelSharedMeshBuffers : public FVoxelMeshBuffers
+{
+public:
+	// Reference counting for TRefCountPtr. These are safe to call from any thread.
+	uint32 AddRef() const;
+	uint32 Release() const;
+
+private:
+	friend class FVoxelMeshBufferPool;
+
+	mutable FThreadSafeCounter NumRefs;
+
+	// The hash of the contents, if the buffers are in the pool's table of live buffers
+	uint32 ContentHash = 0;
+	bool bLive = false;
+
+	// Whether the buffers are in the pool's free list
+	bool bFree = false;
+};
+
+typedef TRefCountPtr<FVoxelSharedMeshBuffers> FVoxelMeshBuffersRef;
+
+// A thread safe free list of shared mesh buffers.
+// Buffers keep their allocations while they're in the pool, so in steady state handing a section to a component doesn't allocate.
+class VOXELTERRAIN_API FVoxelMeshBufferPool
+{
+public:
+	// The pool used by all terrain
+	static FVoxelMeshBufferPool& Get();
+
+	// Destructor
+	~FVoxelMeshBufferPool();
+
+	// Returns an empty set of buffers, reusing a pooled one if there is one
+	FVoxelMeshBuffersRef Acquire();
+
+	// Returns a shared set of buffers holding the contents of Buffers, which comes back empty.
+	// If a set with identical contents is still in use, that set is returned and Buffers keeps its storage. Otherwise the contents are moved into
+	// a pooled set and Buffers is left holding the pooled set's old (empty) storage.
+	FVoxelMeshBuffersRef Acquire(FVoxelMeshBuffers&& Buffers);
+
+private:
+	friend class FVoxelSharedMeshBuffers;
+
+	// Called when the last reference to a set of buffers is released
+	void Return(FVoxelSharedMeshBuffers* Buffers);
+
+	// Guards the free list and the live buffers
+	FCriticalSection FreeListLock;
+	TArray<FVoxelSharedMeshBuffers*> FreeList;
+
+	// Buffers that are in use, by the hash of their contents, so that identical ones can be shared
+	TMultiMap<uint32, FVoxelSharedMeshBuffers*> LiveBuffers;
+};
@@ -0,0 +1,22 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+
+// Polyvox Includes
+#include "PolyVox/CubicSurfaceExtractor.h"
+
+// Use SSE to decode vertices on platforms that have it. Every x64 target UE4 supports has at least SSE2.
+#define VOXEL_DECODE_SSE (PLATFORM_ENABLE_VECTORINTRINSICS && !PLATFORM_ENABLE_VECTORINTRINSICS_NEON)
+
+// Bulk conversion of PolyVox's encoded cubic vertices into Unreal vertex data
+class VOXELTERRAIN_API FVoxelMeshDecoder
+{
+public:
+	typedef PolyVox::CubicVertex<PolyVox::MaterialDensityPair44> FEncodedVertex;
+
+	// Decodes, offsets and scales NumVertices encoded positions into OutPositions, four vertices at a time.
+	// This is the same as (decodePosition(Vertex.encodedPosition) + Offset) * Scale for every vertex.
+	static void DecodePositions(const FEncodedVertex* Vertices, int32 NumVertices, const FVector& Offset, float Scale, FVector* OutPositions);
+};
@@ -0,0 +1,103 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelMeshBuffers.h"
+
+// Reduces the number of triangles in a mesh by collapsing edges, cheapest first. A collapse costs how far it moves the surface away from the
+// planes of the triangles that were merged into it (Garland and Heckbert's quadric error metric), so flat areas go first and silhouettes last.
+// Vertices on the mesh's open edges and on the faces of its bounds never move, so meshes that are simplified separately still meet exactly.
+// A simplifier owns all of its scratch space and reuses it for every mesh, so keep one around instead of creating one per mesh.
+class VOXELTERRAIN_API FVoxelMeshSimplifier
+{
+public:
+	// Simplifies a section in place until it has no more than TargetTriangles triangles, or until nothing else can be collapsed without moving
+	// a locked vertex or turning a triangle over. Bounds is the box that the mesh tiles; vertices on its faces are locked.
+	// Vertices are welded by position first, so the normals of the result are smooth.
+	void Simplify(FVoxelMeshBuffers& Buffers, int32 TargetTriangles, const FBox& Bounds);
+
+private:
+	// The sum of the squared distances to a set of planes, as a symmetric 4x4 matrix
+	struct FQuadric
+	{
+		double XX, XY, XZ, XW, YY, YZ, YW, ZZ, ZW, WW;
+
+		FQuadric() { FMemory::Memzero(*this); }
+
+		// Adds the plane N.P + D = 0, weighted by Weight
+		void AddPlane(const FVector& N, float D, float Weight);
+
+		FQuadric& operator+=(const FQuadric& Other);
+
+		// The weighted sum of squared distances from P to the planes
+		double Evaluate(const FVector& P) const;
+
+		// Finds the point with the least error. Returns false if there isn't a single one, such as when all of the planes are parallel.
+		bool FindMinimum(FVector& OutP) const;
+	};
+
+	// A candidate edge collapse. V1 is merged into V0, which moves to Position.
+	struct FCollapse
+	{
+		double Cost;
+		int32 V0;
+		int32 V1;
+
+		// The vertices' stamps when this was worked out. If either has changed since, so has the collapse, and this one is thrown away.
+		uint32 Stamp0;
+		uint32 Stamp1;
+
+		FVector Position;
+
+		bool operator<(const FCollapse& Other) const { return Cost < Other.Cost; }
+	};
+
+	// Welds the vertices of Buffers by position, splits edges at T-junctions and sets up the triangles, adjacency, quadrics and locks
+	void BuildMesh(const FVoxelMeshBuffers& Buffers, const FBox& Bounds);
+
+	// Returns a vertex that lies part way along the edge from A to B, or INDEX_NONE if there isn't one
+	int32 FindVertexOnEdge(int32 A, int32 B);
+
+	// Adds a triangle of welded vertices, with its adjacency, quadrics and edges
+	void AddTriangle(const int32 V[3]);
+
+	// Works out the cost of collapsing an edge and queues it, unless both ends are locked
+	void QueueCollapse(int32 V0, int32 V1);
+
+	// Whether a collapse would leave the mesh non-manifold or turn any triangle over
+	bool IsCollapseValid(const FCollapse& Collapse);
+
+	// Merges V1 into V0 and queues collapses for V0's new edges
+	void ApplyCollapse(const FCollapse& Collapse);
+
+	// Writes the live triangles back into Buffers, with fresh normals and tangents
+	void WriteMesh(FVoxelMeshBuffers& Buffers);
+
+	// The welded vertices
+	TArray<FVector> Positions;
+	TArray<FQuadric> Quadrics;
+	TArray<bool> Locked;
+	TArray<bool> RemovedVertices;
+	TArray<uint32> Stamps;
+
+	// The triangles around each vertex
+	TArray<TArray<int32>> VertexTriangles;
+
+	// Three vertices per triangle, and whether each one has been collapsed away
+	TArray<int32> Triangles;
+	TArray<bool> RemovedTriangles;
+	int32 NumLiveTriangles = 0;
+
+	// Candidate collapses, as a heap with the cheapest on top
+	TArray<FCollapse> Collapses;
+
+	// Scratch space
+	TMap<FVector, int32> WeldedVertices;
+	TMap<uint64, int32> EdgeCounts;
+	TMultiMap<FVector, int32> LineVertices[3];
+	TArray<int32> LineMatches;
+	TArray<int32> SplitTriangles;
+	TArray<int32> Neighbours;
+	TArray<int32> Remap;
+	TArray<FVector> Normals;
+};
@@ -0,0 +1,55 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+#include "VoxelOccupancy.h"
+
+// A small depth buffer rasterised on the CPU, for finding terrain chunks that are hidden behind nearer terrain.
+// Boxes that are known to be completely solid are drawn into it as occluders, then the bounds of farther chunks are tested against it.
+// Everything is in the terrain's voxel space and nothing touches the GPU, so it doesn't need occlusion queries or even a renderer.
+// Occluders only fill the pixels they cover completely, at the farthest depth they reach in each one, so the buffer never claims more is hidden than really is.
+class VOXELTERRAIN_API FVoxelOcclusionBuffer
+{
+public:
+	// The size of the depth buffer in pixels
+	static const int32 Width = 256;
+	static const int32 Height = 128;
+
+	// Constructor
+	FVoxelOcclusionBuffer();
+
+	// Clears the buffer and sets up the camera. The location and axes are in voxel space, and FOV is the horizontal field of view in degrees.
+	void SetView(const FVector& InLocation, const FVector& InForward, const FVector& InRight, const FVector& InUp, float FOV, float AspectRatio);
+
+	// Draws the completely solid fine blocks of a chunk, merged into as few boxes as it can
+	void AddChunkOccluders(const FIntVector& ChunkCoords, const FVoxelChunkOccupancy& Occupancy);
+
+	// Draws a box that's completely solid. Boxes that reach behind the camera are skipped, since they can't be projected.
+	void AddOccluder(const FBox& Box);
+
+	// Whether any part of a box might be visible past the occluders drawn so far
+	bool IsVisible(const FBox& Box) const;
+
+private:
+	// Projects a point into the buffer, giving its pixel coordinates and one over its distance along the view direction.
+	// Returns false if the point is closer than the near plane.
+	bool Project(const FVector& Point, FVector& OutScreen) const;
+
+	// Draws a flat convex quad of projected points into the pixels it covers completely, keeping the nearest depth in each pixel
+	void RasterizeQuad(const FVector& A, const FVector& B, const FVector& C, const FVector& D);
+
+	// One over the distance to the nearest occluder at each pixel, or zero where there isn't one. Storing the reciprocal means it can be
+	// interpolated linearly across triangles on the screen.
+	TArray<float> InverseDepths;
+
+	// The camera
+	FVector Location;
+	FVector Forward;
+	FVector Right;
+	FVector Up;
+
+	// Scales from view space to the buffer, once divided by depth
+	float ScaleX;
+	float ScaleY;
+};
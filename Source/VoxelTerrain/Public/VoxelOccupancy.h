@@ -0,0 +1,69 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+
+// A summary of which parts of a chunk have anything solid in them, at three levels: the whole chunk, 16^3 blocks and 4^3 blocks.
+// Traces use it to skip over empty space in big steps instead of visiting every voxel. It also keeps which 4^3 blocks are completely solid,
+// which occlusion culling uses as occluders. Only opaque voxels count towards those, since anything else can be seen through.
+struct VOXELTERRAIN_API FVoxelChunkOccupancy
+{
+	// Block sizes in voxels, and how many blocks there are along each side of the chunk
+	static const int32 FineBlockSize = 4;
+	static const int32 FineBlocksPerSide = VOXEL_CHUNK_SIZE / FineBlockSize;
+	static const int32 CoarseBlockSize = 16;
+	static const int32 CoarseBlocksPerSide = VOXEL_CHUNK_SIZE / CoarseBlockSize;
+
+	static_assert(FineBlocksPerSide == 8, "Each fine block layer is packed into one uint64");
+	static_assert(CoarseBlocksPerSide == 2, "The coarse blocks are packed into one uint8");
+
+	// One bit per fine block, set if any voxel in the block is solid. Each entry is one layer of blocks along Z, with bit X + Y * 8.
+	uint64 FineBlocks[FineBlocksPerSide];
+
+	// One bit per fine block, set if every voxel in the block is opaque. Laid out like FineBlocks.
+	uint64 FullFineBlocks[FineBlocksPerSide];
+
+	// One bit per coarse block, set if any voxel in the block is solid. Bit X + Y * 2 + Z * 4.
+	uint8 CoarseBlocks;
+
+	// Whether a voxel counts as solid. This matches what the mesher draws.
+	static bool IsSolid(const PolyVox::MaterialDensityPair44& Voxel) { return Voxel.getMaterial() > 0; }
+
+	// Whether a voxel stops traces. Fluids are drawn, so they're solid as far as the summary goes, but traces pass through them like collision does.
+	static bool BlocksTraces(const PolyVox::MaterialDensityPair44& Voxel) { return IsSolid(Voxel) && !IsVoxelMaterialFluid(Voxel.getMaterial()); }
+
+	// Whether a voxel hides what's behind it
+	static bool IsOpaque(const PolyVox::MaterialDensityPair44& Voxel) { return IsVoxelMaterialOpaque(Voxel.getMaterial()); }
+
+	// Whether the whole chunk is empty
+	bool IsEmpty() const { return CoarseBlocks == 0; }
+
+	// Whether the block containing a voxel is empty. Coordinates are relative to the chunk.
+	bool IsCoarseBlockEmpty(int32 X, int32 Y, int32 Z) const
+	{
+		return (CoarseBlocks & (1 << ((X / CoarseBlockSize) + (Y / CoarseBlockSize) * 2 + (Z / CoarseBlockSize) * 4))) == 0;
+	}
+
+	bool IsFineBlockEmpty(int32 X, int32 Y, int32 Z) const
+	{
+		return (FineBlocks[Z / FineBlockSize] & (1ull << ((X / FineBlockSize) + (Y / FineBlockSize) * FineBlocksPerSide))) == 0;
+	}
+
+	// Whether every voxel in the block containing a voxel is opaque
+	bool IsFineBlockFull(int32 X, int32 Y, int32 Z) const
+	{
+		return (FullFineBlocks[Z / FineBlockSize] & (1ull << ((X / FineBlockSize) + (Y / FineBlockSize) * FineBlocksPerSide))) != 0;
+	}
+
+	// Builds the summary from a chunk's voxels, ordered X first, then Y, then Z
+	void Build(const PolyVox::MaterialDensityPair44* Voxels);
+
+	// Keeps the summary up to date after a voxel in the chunk has been changed. Clearing a voxel rescans its fine block in the chunk, and so
+	// does filling one in a block that's only partly opaque.
+	void OnVoxelChanged(int32 X, int32 Y, int32 Z, const PolyVox::MaterialDensityPair44& Voxel, const FVoxelVolume::Chunk& Chunk);
+
+private:
+	// Works out the coarse block bits from the fine ones
+	void UpdateCoarseBlocks();
+};
@@ -0,0 +1,46 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+
+class FVoxelChunkIndex;
+
+// A chunk's voxels along with a one voxel border from its neighbours, copied out of the volume into one flat array.
+// Meshers read voxels from here with plain index arithmetic instead of going through the volume's samplers, and don't need the volume's lock to do it.
+class VOXELTERRAIN_API FVoxelPaddedChunk
+{
+public:
+	// Side length of the padded chunk in voxels
+	static const int32 Size = VOXEL_CHUNK_SIZE + 2;
+
+	// Distance between neighbouring voxels along each axis. X is contiguous.
+	static const int32 StrideY = Size;
+	static const int32 StrideZ = Size * Size;
+
+	// Copies a chunk and its border out of whatever chunks are in an index, without paging anything in. Missing chunks read as air.
+	// Returns the neighbours that were missing, as a mask of GetNeighbourBit. Call with the lock of the volume the index belongs to held.
+	uint32 CopyFromChunks(const FVoxelChunkIndex& ChunkIndex, const FIntVector& InChunkCoords);
+
+	// The bit a neighbour has in CopyFromChunks' mask. Each component of the offset goes from -1 to 1.
+	static uint32 GetNeighbourBit(const FIntVector& Neighbour) { return 1u << ((Neighbour.X + 1) + (Neighbour.Y + 1) * 3 + (Neighbour.Z + 1) * 9); }
+
+	// The index of a voxel. Coordinates are relative to the chunk's lower corner and go from -1 to VOXEL_CHUNK_SIZE.
+	static int32 GetIndex(int32 X, int32 Y, int32 Z) { return (X + 1) + (Y + 1) * StrideY + (Z + 1) * StrideZ; }
+
+	// Returns a voxel. Coordinates are the same as GetIndex.
+	const PolyVox::MaterialDensityPair44& GetVoxel(int32 X, int32 Y, int32 Z) const { return Voxels[GetIndex(X, Y, Z)]; }
+
+	// All of the voxels, laid out as described by GetIndex
+	const PolyVox::MaterialDensityPair44* GetData() const { return Voxels.GetData(); }
+
+	// The chunk that was copied
+	const FIntVector& GetChunkCoords() const { return ChunkCoords; }
+
+private:
+	// Copies the part of the padded chunk that overlaps one of the chunk's neighbours, or the chunk itself. A null chunk reads as air.
+	void CopyNeighbour(FVoxelVolume::Chunk* Chunk, const FIntVector& Neighbour);
+
+	TArray<PolyVox::MaterialDensityPair44> Voxels;
+	FIntVector ChunkCoords = FIntVector::ZeroValue;
+};
@@ -0,0 +1,60 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+#include "VoxelRaycast.generated.h"
+
+class FVoxelChunkIndex;
+
+// Trace packets of rays four at a time with SSE on platforms that have it, the same as the mesh decoder
+#define VOXEL_RAYCAST_SSE (PLATFORM_ENABLE_VECTORINTRINSICS && !PLATFORM_ENABLE_VECTORINTRINSICS_NEON)
+
+// What a voxel trace hit
+USTRUCT(BlueprintType)
+struct FVoxelRaycastHit
+{
+	GENERATED_USTRUCT_BODY()
+
+	// Whether the trace hit anything. The rest of the hit is only filled in if it did.
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadOnly, VisibleAnywhere) bool bHit;
+
+	// Where the trace hit the voxel's surface
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadOnly, VisibleAnywhere) FVector Location;
+
+	// The normal of the face that was hit. Zero if the trace started inside a solid voxel.
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadOnly, VisibleAnywhere) FVector Normal;
+
+	// How far along the trace the hit was, from 0 at the start to 1 at the end
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadOnly, VisibleAnywhere) float Time;
+
+	// The material of the voxel that was hit
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadOnly, VisibleAnywhere) uint8 Material;
+
+	// The coordinates of the voxel that was hit
+	FIntVector VoxelCoords;
+
+	FVoxelRaycastHit()
+		: bHit(false)
+		, Location(ForceInitToZero)
+		, Normal(ForceInitToZero)
+		, Time(0.f)
+		, Material(0)
+		, VoxelCoords(FIntVector::ZeroValue)
+	{}
+};
+
+// Traces lines through the voxels, using each chunk's occupancy to step over empty chunks, 16^3 blocks and 4^3 blocks in one go.
+// Chunks that aren't paged in count as empty, and traces pass through fluids.
+class VOXELTERRAIN_API FVoxelRaycaster
+{
+public:
+	// Traces from Start to End, both in voxels, where voxel coordinates are the voxel's center. Returns true and fills OutHit (also in voxels)
+	// if the trace hits a solid voxel. Call with the volume's lock held.
+	static bool Raycast(const FVoxelChunkIndex& ChunkIndex, const FVector& Start, const FVector& End, FVoxelRaycastHit& OutHit);
+
+	// Traces NumRays rays at once, each from Starts[i] to Ends[i], filling in OutHits[i]. Rays are traced in packets of four that step together,
+	// and every ray shares one cache of chunk lookups, so fans of rays that cross the same chunks only look each chunk up once.
+	// Call with the volume's lock held.
+	static void RaycastPacket(const FVoxelChunkIndex& ChunkIndex, const FVector* Starts, const FVector* Ends, int32 NumRays, FVoxelRaycastHit* OutHits);
+};
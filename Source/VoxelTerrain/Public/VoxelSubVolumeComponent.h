@@ -0,0 +1,125 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelTypes.h"
+#include "VoxelChunkIndex.h"
+#include "VoxelOccupancy.h"
+#include "VoxelChunkMesher.h"
+#include "VoxelPaddedChunk.h"
+
+#include "Components/SceneComponent.h"
+#include "VoxelSubVolumeComponent.generated.h"
+
+// Pages chunks into a sub-volume. New chunks start out as air, and chunks the volume pages out to save memory are kept and handed back
+// when they're paged in again, since there's nothing to generate them from.
+class VOXELTERRAIN_API FVoxelSubVolumePager : public FVoxelVolume::Pager
+{
+public:
+	// PagedVolume::Pager functions
+	virtual void pageIn(const PolyVox::Region& Region, FVoxelVolume::Chunk* Chunk) override;
+	virtual void pageOut(const PolyVox::Region& Region, FVoxelVolume::Chunk* Chunk) override;
+
+	// The chunks that are currently paged in
+	const FVoxelChunkIndex& GetChunkIndex() const { return ChunkIndex; }
+
+	// Whether a chunk has ever had anything set in it, whether or not it's paged in right now
+	bool HasChunk(const FIntVector& ChunkCoords) const { return ChunkIndex.Contains(ChunkCoords) || PagedOutChunks.Contains(ChunkCoords); }
+
+	// Forgets every chunk. Call this once the volume has been destroyed.
+	void Reset();
+
+private:
+	// Marks the last chunk that was paged in as modified, so the volume calls pageOut for it when it's evicted
+	void MarkChunkModified();
+
+	// The chunks that are currently paged in
+	FVoxelChunkIndex ChunkIndex;
+
+	// The last chunk that was paged in, if it hasn't been marked as modified yet
+	FVoxelVolume::Chunk* UnmarkedChunk = nullptr;
+
+	// Storage for the occupancy of every paged in chunk, and the ones that are free to be reused
+	TArray<TUniquePtr<FVoxelChunkOccupancy>> Occupancies;
+	TArray<FVoxelChunkOccupancy*> FreeOccupancies;
+
+	// The voxels of chunks that have been paged out, ordered X first, then Y, then Z
+	TMap<FIntVector, TArray<PolyVox::MaterialDensityPair44>> PagedOutChunks;
+};
+
+// A small voxel volume that moves with whatever it's attached to, such as a vehicle or a piece of falling debris.
+// It stores its voxels the same way the terrain does and meshes them with the terrain's mesher into the same chunk components, but in the
+// component's own space. The chunk components are attached to this one, so moving it just moves them; only changing voxels remeshes.
+// Everything happens on the game thread, so there's no lock. Sub-volumes are meant to be small, so meshing is budgeted per tick rather
+// than sent through the terrain's pipeline.
+UCLASS(ClassGroup = (Rendering), meta = (BlueprintSpawnableComponent))
+class VOXELTERRAIN_API UVoxelSubVolumeComponent : public USceneComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Constructor
+	UVoxelSubVolumeComponent(const FObjectInitializer& ObjectInitializer);
+
+	// The material of each section, the same as the terrain's: voxel material 1 uses the first entry
+	UPROPERTY(Category = "Voxel Sub-Volume", BlueprintReadWrite, EditAnywhere) TArray<UMaterialInterface*> TerrainMaterials;
+
+	// Whether the chunks get collision
+	UPROPERTY(Category = "Voxel Sub-Volume", BlueprintReadWrite, EditAnywhere) bool bCreateCollision;
+
+	// The most chunks remeshed each tick
+	UPROPERTY(Category = "Voxel Sub-Volume", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 ChunksMeshedPerTick;
+
+	// Sets the material of the voxel at a world location, where 0 is air
+	UFUNCTION(Category = "Voxel Sub-Volume", BlueprintCallable) void SetVoxelMaterial(const FVector& WorldLocation, int32 Material);
+
+	// Returns the material of the voxel at a world location
+	UFUNCTION(Category = "Voxel Sub-Volume", BlueprintCallable) int32 GetVoxelMaterial(const FVector& WorldLocation) const;
+
+	// Removes every voxel
+	UFUNCTION(Category = "Voxel Sub-Volume", BlueprintCallable) void ClearVoxels();
+
+	// Changes a voxel by its coordinates in the sub-volume
+	void SetVoxel(const FIntVector& VoxelCoords, const PolyVox::MaterialDensityPair44& Voxel);
+
+	// Returns a voxel by its coordinates in the sub-volume. Voxels that have never been set are air.
+	PolyVox::MaterialDensityPair44 GetVoxel(const FIntVector& VoxelCoords) const;
+
+	// Meshes up to MaxChunks chunks whose voxels have changed. Call with a large budget to bring the mesh up to date straight away.
+	void UpdateMesh(int32 MaxChunks);
+
+	// Whether every change has been meshed
+	bool IsMeshUpToDate() const { return DirtyChunks.Num() == 0; }
+
+	// Converts between world locations and voxel coordinates in the sub-volume. A voxel's location is its center.
+	FIntVector WorldToVoxel(const FVector& WorldLocation) const;
+	FVector VoxelToWorld(const FIntVector& VoxelCoords) const;
+
+	// UActorComponent functions
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	virtual void OnComponentDestroyed(bool bDestroyingHierarchy) override;
+
+private:
+	// Creates the volume if it hasn't been yet
+	void CreateVolume();
+
+	// Returns the component of a chunk, setting one up if the chunk doesn't have one yet
+	class UVoxelChunkComponent* AcquireChunkComponent(const FIntVector& ChunkCoords);
+
+	// The voxels. The pager is declared first so that it outlives the volume, which pages everything out through it when it's destroyed.
+	TUniquePtr<FVoxelSubVolumePager> Pager;
+	TUniquePtr<FVoxelVolume> Volume;
+
+	// Only kept around while there's something to mesh, since most sub-volumes rarely change once they're built
+	TUniquePtr<FVoxelChunkMesher> Mesher;
+	TUniquePtr<FVoxelPaddedChunk> PaddedChunk;
+
+	// Chunks whose voxels have changed since they were meshed
+	TSet<FIntVector> DirtyChunks;
+
+	// The component of every chunk that has been meshed
+	TMap<FIntVector, class UVoxelChunkComponent*> MeshedChunks;
+
+	// Keeps the chunk components alive
+	UPROPERTY(Transient) TArray<class UVoxelChunkComponent*> ChunkComponents;
+};
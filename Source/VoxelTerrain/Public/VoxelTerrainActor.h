@@ -7,8 +7,24 @@
 #include "PolyVox/MaterialDensityPair.h"
 #include "PolyVox/Vector.h"
 
+// ANL Includes
+#include "VM/kernel.h"
+
+#include "VoxelTypes.h"
+#include "VoxelChunkPipeline.h"
+#include "VoxelChunkIndex.h"
+#include "VoxelOccupancy.h"
+#include "VoxelBatchQuery.h"
+#include "VoxelRaycast.h"
+#include "VoxelFluids.h"
+#include "VoxelIntegrity.h"
+#include "VoxelAccessor.h"
+#include "VoxelBlockTicks.h"
+#include "VoxelGranular.h"
+#include "VoxelClusterMesh.h"
+#include "VoxelOcclusion.h"
+
 #include "GameFramework/Actor.h"
-#include "ProceduralMeshComponent.h"
 #include "VoxelTerrainActor.generated.h"
 
 // Bridge between PolyVox Vector3DFloat and Unreal Engine 4 FVector
@@ -22,7 +38,7 @@ struct FPolyVoxVector : public FVector
 	{}
 
 	FORCEINLINE FPolyVoxVector(float InX, float InY, float InZ)
-		: FVector(InX, InY, InX)
+		: FVector(InX, InY, InZ)
 	{}
 
 	FORCEINLINE FPolyVoxVector(const FVector &InVec)
@@ -60,7 +76,60 @@ public:
 	virtual void pageIn(const PolyVox::Region& region, PolyVox::PagedVolume<PolyVox::MaterialDensityPair44>::Chunk* pChunk);
 	virtual void pageOut(const PolyVox::Region& region, PolyVox::PagedVolume<PolyVox::MaterialDensityPair44>::Chunk* pChunk);
 
+	// Creates a new executor for the noise kernel. Each thread that calls GenerateRegion needs its own.
+	TUniquePtr<anl::CNoiseExecutor> CreateNoiseExecutor();
+
+	// Generates the voxels of a region into OutVoxels, ordered X first, then Y, then Z.
+	// This doesn't touch the volume, so it can run on any thread as long as each thread uses its own executor.
+	void GenerateRegion(const PolyVox::Region& Region, anl::CNoiseExecutor& Executor, PolyVox::MaterialDensityPair44* OutVoxels) const;
+
+	// Gives pageIn voxels that were generated ahead of time by GenerateRegion, so paging that region in is just a copy.
+	// Only call this while holding the volume's lock, and clear it again (by passing nullptr) before releasing the lock.
+	void SetPregeneratedVoxels(const PolyVox::Region* Region, const PolyVox::MaterialDensityPair44* Voxels);
+
+	// Whether a chunk is currently paged into the volume. Only call this while holding the volume's lock.
+	bool IsChunkPagedIn(const FIntVector& ChunkCoords) const { return ChunkIndex.Contains(ChunkCoords); }
+
+	// The chunks that are currently paged in. Only use this while holding the volume's lock, and don't hold on to any chunk after releasing it,
+	// since the volume can page chunks out at any time.
+	const FVoxelChunkIndex& GetChunkIndex() const { return ChunkIndex; }
+
 private:
+	// Builds the noise kernel that pageIn evaluates
+	void BuildNoiseKernel();
+
+	// Marks the last chunk that was paged in as modified, so the volume calls pageOut for it when it's evicted
+	void MarkChunkModified();
+
+	// This is our kernel. It is responsible for generating our noise.
+	// It's built once up front so that paging in a chunk doesn't have to rebuild it (and reallocate all of its instructions).
+	anl::CKernel NoiseKernel;
+
+	// The kernel outputs that pageIn evaluates
+	TOptional<anl::CInstructionIndex> PerturbGradient;
+	TOptional<anl::CInstructionIndex> GrassZ;
+	TOptional<anl::CInstructionIndex> OreFractal;
+
+	// Evaluates the kernel. The volume only pages in one chunk at a time, so one executor and its cache can be reused for every chunk.
+	TUniquePtr<anl::CNoiseExecutor> NoiseExecutor;
+
+	// Scratch space for chunks that get paged in without having been generated ahead of time
+	TArray<PolyVox::MaterialDensityPair44> PageInVoxels;
+
+	// Voxels generated ahead of time for the next pageIn
+	const PolyVox::Region* PregeneratedRegion = nullptr;
+	const PolyVox::MaterialDensityPair44* PregeneratedVoxels = nullptr;
+
+	// The chunks that are currently paged in
+	FVoxelChunkIndex ChunkIndex;
+
+	// The last chunk that was paged in, if it hasn't been marked as modified yet
+	PolyVox::PagedVolume<PolyVox::MaterialDensityPair44>::Chunk* UnmarkedChunk = nullptr;
+
+	// Storage for the occupancy of every paged in chunk, and the ones that are free to be reused
+	TArray<TUniquePtr<FVoxelChunkOccupancy>> Occupancies;
+	TArray<FVoxelChunkOccupancy*> FreeOccupancies;
+
 	// Some variables to control our terrain generator
 	// The seed of our fractal
 	uint32 Seed = 123;
@@ -96,8 +165,103 @@ public:
 	// Called when the actor has begun playing in the level
 	virtual void BeginPlay() override;
 
-	// The procedurally generated mesh that represents our voxels
-	UPROPERTY(Category = "Voxel Terrain", BlueprintReadWrite, VisibleAnywhere) class UProceduralMeshComponent* Mesh;
+	// Called when the actor is being removed from the level
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Called every frame
+	virtual void Tick(float DeltaSeconds) override;
+
+	// How far around the player chunks are loaded, in chunks
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 ViewDistance;
+
+	// How far the camera can get from the world origin, in world units, before the origin is moved to it. Chunk meshes are built relative to
+	// their chunk, so moving the origin keeps everything near the camera precise however far out the terrain goes. 0 never moves it.
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0")) float WorldOriginRebaseDistance;
+
+	// The number of chunks stacked on top of each other, starting at the bottom of the terrain
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 HeightInChunks;
+
+	// How much less urgent chunks outside the camera's view are than ones in it. Chunks out of view are built as if they were this many times further away.
+	UPROPERTY(Category = "Voxel Terrain|Pipeline", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) float OutOfViewPriorityScale;
+
+	// Pipeline stage settings. Changes take effect the next time the terrain begins play.
+	UPROPERTY(Category = "Voxel Terrain|Pipeline", BlueprintReadWrite, EditAnywhere) FVoxelPipelineStageSettings GenerateStage;
+	UPROPERTY(Category = "Voxel Terrain|Pipeline", BlueprintReadWrite, EditAnywhere) FVoxelPipelineStageSettings MeshStage;
+	UPROPERTY(Category = "Voxel Terrain|Pipeline", BlueprintReadWrite, EditAnywhere) FVoxelPipelineStageSettings CollisionStage;
+	UPROPERTY(Category = "Voxel Terrain|Pipeline", BlueprintReadWrite, EditAnywhere) FVoxelPipelineStageSettings UploadStage;
+
+	// Whether chunk and cluster meshes are reordered for the GPU's vertex cache as they're built, which costs a little time on the worker
+	// threads and saves vertex shading on every frame they're drawn
+	UPROPERTY(Category = "Voxel Terrain|Pipeline", BlueprintReadWrite, EditAnywhere) bool bOptimizeVertexCache;
+
+	// How often the fluid simulation steps, in seconds. It never steps more than once a tick.
+	UPROPERTY(Category = "Voxel Terrain|Fluids", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0")) float FluidStepInterval;
+
+	// The most fluid cells a step visits. Floods bigger than this spread out over several steps instead of taking longer each tick.
+	UPROPERTY(Category = "Voxel Terrain|Fluids", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 FluidCellBudget;
+
+	// The biggest piece of terrain that can be cut loose and fall, in voxels. Searching for loose pieces after an edit gives up after this many voxels,
+	// so anything bigger stays where it is.
+	UPROPERTY(Category = "Voxel Terrain|Editing", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 MaxIslandSize;
+
+	// How long loose pieces of terrain take to fall one voxel, in seconds
+	UPROPERTY(Category = "Voxel Terrain|Editing", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0")) float DebrisFallInterval;
+
+	// The most voxels sand and gravel collapses move or look at each tick. Columns past this wait for the next tick, so big avalanches spread out
+	// over several ticks instead of stalling one.
+	UPROPERTY(Category = "Voxel Terrain|Editing", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 GranularVoxelBudget;
+
+	// How often random block ticks run, in seconds. They never run more than once a tick.
+	UPROPERTY(Category = "Voxel Terrain|Block Ticks", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0")) float BlockTickInterval;
+
+	// How often voxels tick, as the number of random voxels per chunk that would be ticked each time if we picked them from the whole chunk.
+	// Only voxels that can change are actually visited, so this costs far less than it sounds.
+	UPROPERTY(Category = "Voxel Terrain|Block Ticks", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0")) int32 RandomTicksPerChunk;
+
+	// The most voxels ticked each time across the whole terrain
+	UPROPERTY(Category = "Voxel Terrain|Block Ticks", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 BlockTickBudget;
+
+	// The most voxels scanned each time to find the ones that can tick in chunks that have just loaded. A whole chunk is VOXEL_CHUNK_VOLUME
+	// voxels, so when lots of chunks stream in at once their scans are spread over several ticks.
+	UPROPERTY(Category = "Voxel Terrain|Block Ticks", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 BlockTickScanBudget;
+
+	// How far away chunks have to be, in chunks, before they're drawn a cluster at a time by one merged mesh. 0 draws every chunk on its own.
+	UPROPERTY(Category = "Voxel Terrain|HLOD", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0")) int32 ClusterDistance;
+
+	// The most triangles a cluster's merged mesh can have at each level of detail, or 0 to keep them all. Level 0 is used from ClusterDistance,
+	// and each level after that from twice as far as the one before. Meshes with more triangles are simplified on the thread pool.
+	UPROPERTY(Category = "Voxel Terrain|HLOD", BlueprintReadWrite, EditAnywhere) TArray<int32> ClusterTriangleBudgets;
+
+	// The most clusters being merged in the background at once
+	UPROPERTY(Category = "Voxel Terrain|HLOD", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 MaxClusterMerges;
+
+	// Whether the terrain casts shadows with simplified shadow-only meshes, one per cluster, instead of with the meshes that are drawn.
+	// A chunk keeps casting its own shadow until its cluster's shadow mesh has caught up with it.
+	UPROPERTY(Category = "Voxel Terrain|Shadows", BlueprintReadWrite, EditAnywhere) bool bShadowProxies;
+
+	// The most triangles a cluster's shadow mesh can have. Distant clusters never get more than their merged mesh has.
+	UPROPERTY(Category = "Voxel Terrain|Shadows", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 ShadowProxyTriangleBudget;
+
+	// The most cluster shadow meshes being merged in the background at once. This is separate from MaxClusterMerges, so that chunks changing
+	// nearby can't hold up the merged meshes in the distance.
+	UPROPERTY(Category = "Voxel Terrain|Shadows", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1")) int32 MaxShadowMerges;
+
+	// The shortest time in seconds between starting shadow merges for the same cluster. Fluids, block ticks and falling sand can change a
+	// cluster every few frames; its changed chunks cast their own shadows in the meantime.
+	UPROPERTY(Category = "Voxel Terrain|Shadows", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0")) float ShadowMergeInterval;
+
+	// Whether to stop drawing chunks and clusters that are hidden behind nearer terrain
+	UPROPERTY(Category = "Voxel Terrain|Occlusion", BlueprintReadWrite, EditAnywhere) bool bOcclusionCulling;
+
+	// How far from the camera, in chunks, the solid parts of chunks are drawn as occluders. Farther occluders rarely hide much but cost as
+	// much to draw.
+	UPROPERTY(Category = "Voxel Terrain|Occlusion", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0")) int32 OccluderDistance;
+
+	// The root of the terrain. Every chunk's mesh is attached to it.
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadWrite, VisibleAnywhere) class USceneComponent* TerrainRoot;
+
+	// The meshes that represent our voxels, one per loaded chunk and one per merged cluster. Unused components are kept around to be reused.
+	UPROPERTY(Category = "Voxel Terrain", BlueprintReadOnly, VisibleAnywhere, Transient) TArray<class UVoxelChunkComponent*> ChunkComponents;
 
 	// The material to apply to our voxel terrain
 	UPROPERTY(Category = "Voxel Terrain", BlueprintReadWrite, EditAnywhere) TArray<UMaterialInterface*> TerrainMaterials;
@@ -120,7 +284,301 @@ public:
 
 	// The maximum height of the generated terrain in voxels. NOTE: Changing this will affect where the ground begins!
 	UPROPERTY(Category = "Voxel Terrain", BlueprintReadWrite, EditAnywhere) float TerrainHeight;
+
+	// Looks up the voxels at a batch of world locations, one result per location. Locations are grouped by chunk so each chunk is only looked up once.
+	// Voxels in chunks that haven't been generated yet come back as air with bLoaded unset; this never generates terrain.
+	UFUNCTION(Category = "Voxel Terrain", BlueprintCallable) void QueryVoxels(const TArray<FVector>& WorldLocations, TArray<FVoxelQueryResult>& OutResults);
+
+	// Looks up the voxel at a world location. Use QueryVoxels when there are many to look up.
+	UFUNCTION(Category = "Voxel Terrain", BlueprintCallable) FVoxelQueryResult QueryVoxel(const FVector& WorldLocation);
+
+	// Traces a line through the voxels and returns whether it hit a solid one. Empty space is skipped over in big steps, so long traces are cheap.
+	// Chunks that haven't been generated yet count as empty.
+	UFUNCTION(Category = "Voxel Terrain", BlueprintCallable) bool RaycastVoxels(const FVector& WorldStart, const FVector& WorldEnd, FVoxelRaycastHit& OutHit);
+
+	// Traces many lines at once, from WorldStarts[i] to WorldEnds[i], with one hit per line; check each hit's bHit. Lines are traced in packets that
+	// share their chunk lookups, which is much cheaper than tracing them one by one when they cover the same ground, like a fan of sight lines.
+	// If the arrays aren't the same length, a warning is logged and there are no hits.
+	UFUNCTION(Category = "Voxel Terrain", BlueprintCallable) void RaycastVoxelsMulti(const TArray<FVector>& WorldStarts, const TArray<FVector>& WorldEnds, TArray<FVoxelRaycastHit>& OutHits);
+
+	// Pours water or lava into the voxel at a world location and lets it flow from there. Returns false if the voxel is solid or hasn't been generated yet.
+	UFUNCTION(Category = "Voxel Terrain", BlueprintCallable) bool AddFluid(const FVector& WorldLocation, EVoxelFluid Fluid);
+
+	// Sets the material of the voxel at a world location, where 0 is air. Anything left hanging by the edit falls, and sand and gravel fall if there's nothing under them. Returns false if the voxel hasn't been generated yet.
+	UFUNCTION(Category = "Voxel Terrain", BlueprintCallable) bool SetVoxelMaterial(const FVector& WorldLocation, int32 Material);
+
+	// Removes every solid voxel within a sphere and returns how many there were. Anything left hanging by the hole falls.
+	UFUNCTION(Category = "Voxel Terrain", BlueprintCallable) int32 DigSphere(const FVector& WorldCenter, float WorldRadius);
+
+	// Looks up NumQueries voxels by their voxel coordinates, like QueryVoxels
+	void QueryVoxelCoords(const FIntVector* VoxelCoords, int32 NumQueries, FVoxelQueryResult* OutResults);
+
+	// Converts between world locations and voxel coordinates. A voxel's location is its center.
+	FIntVector WorldToVoxel(const FVector& WorldLocation) const;
+	FVector VoxelToWorld(const FIntVector& VoxelCoords) const;
+
+	// The volume and its pager. Only touch them while holding the volume's lock.
+	FVoxelVolume* GetVolume() const { return VoxelVolume.Get(); }
+	const VoxelTerrainPager* GetPager() const { return Pager.Get(); }
+
+	// PagedVolume isn't thread safe, so anything that touches the volume has to hold this
+	FCriticalSection& GetVolumeLock() { return VolumeLock; }
 	
 private:
-	TSharedPtr<PolyVox::PagedVolume<PolyVox::MaterialDensityPair44>> VoxelVolume;
+	// Gets the location chunks are streamed in around, in voxels relative to the terrain, along with the direction and field of view of the camera there
+	void GetStreamingView(FVector& OutOrigin, FVector& OutForward, float& OutFOV) const;
+
+	// Requests chunks that have come into view and unloads the ones that have gone out of it
+	void UpdateStreaming();
+
+	// Moves the world origin to the camera if it has gone further than WorldOriginRebaseDistance from it
+	void UpdateWorldOrigin();
+
+	// Returns how urgently a chunk is needed, lowest first, based on how far away it is and whether it's in view. Returns -1 if it isn't needed at all.
+	float GetChunkPriority(const FIntVector& ChunkCoords) const;
+
+	// Steps the fluid simulation if it's due
+	void UpdateFluids(float DeltaSeconds);
+
+	// Changes a voxel, keeping everything that depends on it up to date. Call with the volume's lock held, then call ResolveEdits once all the edits are done.
+	void EditVoxel(FVoxelAccessor& Accessor, const FIntVector& VoxelCoords, const PolyVox::MaterialDensityPair44& Voxel);
+
+	// Drops anything the edits since the last call left hanging. Call with the volume's lock held.
+	void ResolveEdits();
+
+	// Moves falling debris down if it's due
+	void UpdateDebris(float DeltaSeconds);
+
+	// Wakes everything that depends on the voxels in DebrisChangedVoxels
+	void OnDebrisChangedVoxels();
+
+	// Starts drawing an island that has just been lifted out of the terrain to fall
+	void ShowFallingIsland(const FVoxelFallingDebris::FIsland& Island);
+
+	// Stops drawing landed debris once the terrain it landed in has been remeshed
+	void ReleaseLandedDebris();
+
+	// Runs random block ticks if they're due
+	void UpdateBlockTicks(float DeltaSeconds);
+
+	// Collapses columns of sand and gravel that have lost their support
+	void UpdateGranular();
+
+	// Sends chunks whose voxels have changed back through the pipeline to be meshed again
+	void RemeshDirtyChunks();
+
+	// The game thread stages of the pipeline
+	void RunCollisionStage();
+	void RunUploadStage();
+
+	// Returns the component of a loaded chunk, setting one up if the chunk doesn't have one yet
+	class UVoxelChunkComponent* AcquireChunkComponent(const FIntVector& ChunkCoords);
+
+	// Empties a chunk's component and keeps it around for reuse
+	void UnloadChunk(const FIntVector& ChunkCoords);
+
+	// Marks loaded chunks dirty that were meshed without a chunk that has just been uploaded, and remembers which neighbours its own mesh was built without
+	void UpdateMissingNeighbours(const FIntVector& ChunkCoords, uint32 MissingNeighbours);
+
+	// A group of VOXEL_CLUSTER_SIZE^3 chunks that's drawn by one merged mesh while it's far enough away
+	struct FCluster
+	{
+		// Draws the merged mesh, or null if there isn't one yet
+		class UVoxelChunkComponent* Component = nullptr;
+
+		// Merges the chunks' meshes in the background
+		TUniquePtr<FAsyncTask<FVoxelClusterMergeTask>> MergeTask;
+
+		// The number of loaded chunks in the cluster
+		int32 NumChunks = 0;
+
+		// The level of detail of the last merge that was started
+		int32 LOD = INDEX_NONE;
+
+		// Whether any of the chunks has changed since the last merge was started
+		bool bStale = true;
+
+		// The chunks that are in the merged mesh, by GetVoxelClusterChunkIndex. Only these are hidden while it's drawn, so a chunk that loads
+		// after the merge is still drawn on its own until the cluster is merged again.
+		uint64 MergedChunks = 0;
+
+		// Whether the merged mesh is drawn instead of the chunks
+		bool bShown = false;
+
+		// Casts the cluster's shadow when shadow proxies are on, or null if it doesn't have a shadow mesh yet
+		class UVoxelChunkComponent* ShadowComponent = nullptr;
+
+		// Merges and simplifies the chunks' meshes into the shadow mesh in the background
+		TUniquePtr<FAsyncTask<FVoxelClusterMergeTask>> ShadowMergeTask;
+
+		// The triangle budget of the last shadow merge that was started
+		int32 ShadowTriangleBudget = INDEX_NONE;
+
+		// The world time the last shadow merge was started at
+		float ShadowMergeStartTime = -MAX_flt;
+
+		// Whether any of the chunks has changed since the last shadow merge was started
+		bool bShadowStale = true;
+
+		// The chunks whose current meshes are in the shadow mesh, by GetVoxelClusterChunkIndex. The rest cast their own shadows until a shadow
+		// merge picks them up, so nothing goes without a shadow while it streams in or changes.
+		uint64 ShadowedChunks = 0;
+
+		// The chunks that have changed since the last shadow merge was started, which that merge only has the old meshes of
+		uint64 ShadowChangedChunks = 0;
+	};
+
+	// Merges clusters that have gone out into the distance or changed there, and switches between drawing clusters and their chunks
+	void UpdateClusters();
+
+	// Returns the level of detail a cluster should be drawn at, or INDEX_NONE if it's close enough that its chunks should be drawn instead
+	int32 GetClusterLOD(const FIntVector& ClusterCoords) const;
+
+	// Returns the most triangles a cluster's shadow mesh should have at a level of detail. Nearby clusters, whose LOD is INDEX_NONE, get
+	// ShadowProxyTriangleBudget.
+	int32 GetClusterShadowTriangleBudget(int32 LOD) const;
+
+	// Starts merging the meshes of a cluster's chunks in the background
+	void StartClusterMerge(const FIntVector& ClusterCoords, FCluster& Cluster, int32 LOD);
+
+	// Starts merging the meshes of a cluster's chunks into its shadow mesh in the background
+	void StartShadowMerge(const FIntVector& ClusterCoords, FCluster& Cluster, int32 TriangleBudget);
+
+	// Adds the meshes of a cluster's loaded chunks to a merge. Shadow merges leave out translucent materials, which don't cast shadows.
+	void AddClusterChunks(const FIntVector& ClusterCoords, FVoxelClusterMergeTask& Task, bool bShadow) const;
+
+	// Hands a finished merge to the cluster's component
+	void FinishClusterMerge(const FIntVector& ClusterCoords, FCluster& Cluster);
+
+	// Hands a finished shadow merge to the cluster's shadow component
+	void FinishShadowMerge(const FIntVector& ClusterCoords, FCluster& Cluster);
+
+	// Moves the sections of a finished merge into shared buffers
+	static TArray<FVoxelMeshBuffersRef> AcquireMergedSections(FVoxelClusterMergeTask& Task);
+
+	// Sets up a component for drawing a cluster's merged mesh, or for casting its shadow
+	class UVoxelChunkComponent* CreateClusterComponent(bool bShadowOnly);
+
+	// Draws either the cluster's merged mesh or its chunks
+	void SetClusterShown(const FIntVector& ClusterCoords, FCluster& Cluster, bool bShown);
+
+	// Hides the chunks that the cluster's merged mesh draws while it's shown, and shows the rest
+	void UpdateClusterChunkVisibility(const FIntVector& ClusterCoords, const FCluster& Cluster);
+
+	// Whether a chunk is drawn by its cluster's merged mesh rather than its own component
+	static bool IsChunkDrawnByCluster(const FIntVector& ChunkCoords, const FCluster& Cluster);
+
+	// Whether a chunk's current mesh is in its cluster's shadow mesh, so it doesn't need to cast its own shadow
+	bool IsChunkShadowedByCluster(const FIntVector& ChunkCoords, const FCluster& Cluster) const;
+
+	// Notes that a chunk's mesh has changed or gone, so it casts its own shadow until the cluster's shadow mesh catches up
+	static void MarkChunkShadowChanged(const FIntVector& ChunkCoords, FCluster& Cluster);
+
+	// Turns shadows on for the cluster's chunks and merged mesh wherever its shadow mesh doesn't cast them, and off everywhere else
+	void UpdateClusterShadows(const FIntVector& ClusterCoords, const FCluster& Cluster);
+
+	// Hides the chunks and clusters that the nearby terrain hides from the camera, and shows the rest
+	void UpdateOcclusion();
+
+	// Generates our voxels. Declared before the volume so that it outlives it; the volume pages chunks out through it when it's destroyed.
+	TUniquePtr<VoxelTerrainPager> Pager;
+
+	TSharedPtr<FVoxelVolume> VoxelVolume;
+
+	// PagedVolume isn't thread safe, so anything that touches the volume has to hold this
+	FCriticalSection VolumeLock;
+
+	// Builds chunks in the background
+	TUniquePtr<FVoxelChunkPipeline> Pipeline;
+
+	// The component of every loaded chunk
+	TMap<FIntVector, class UVoxelChunkComponent*> LoadedChunks;
+
+	// Components of unloaded chunks, ready to be reused
+	TArray<class UVoxelChunkComponent*> FreeChunkComponents;
+
+	// Every cluster with a loaded chunk in it, and cluster components that are ready to be reused
+	TMap<FIntVector, FCluster> Clusters;
+	TArray<class UVoxelChunkComponent*> FreeClusterComponents;
+	TArray<class UVoxelChunkComponent*> FreeShadowComponents;
+
+	// The depth buffer that occlusion culling draws the nearby terrain into
+	FVoxelOcclusionBuffer OcclusionBuffer;
+
+	// The chunk that streaming is currently centered on
+	FIntVector StreamingCenter;
+
+	// The view that chunk priorities were last worked out for. The origin is in chunks and both are flattened onto the ground plane.
+	FVector2D StreamingOrigin;
+	FVector2D StreamingForward;
+
+	// The cosine of half the camera's field of view
+	float StreamingCosHalfFOV;
+
+	// The chunks in view, most urgent first
+	TArray<FIntVector> WantedChunks;
+
+	// Scratch space for UpdateStreaming
+	TArray<FIntVector> ChunksToUnload;
+
+	// Moves water and lava around
+	FVoxelFluidSimulation Fluids;
+
+	// How long it's been since the fluids last stepped
+	float FluidStepTime;
+
+	// Finds and drops pieces of terrain that edits leave hanging
+	FVoxelIntegrityChecker IntegrityChecker;
+	FVoxelFallingDebris Debris;
+
+	// How long it's been since the debris last fell
+	float DebrisStepTime;
+
+	// Debris that has landed, and the chunks that have to be remeshed before the terrain draws it
+	struct FLandedDebris
+	{
+		class UVoxelSubVolumeComponent* Component;
+		TArray<FIntVector> Chunks;
+	};
+
+	// The sub-volume drawing each falling island, the ones drawing landed islands, and the ones that are free to be reused
+	TMap<uint32, class UVoxelSubVolumeComponent*> FallingDebris;
+	TArray<FLandedDebris> LandedDebris;
+	TArray<class UVoxelSubVolumeComponent*> FreeDebrisComponents;
+
+	// Keeps the debris components alive
+	UPROPERTY(Transient) TArray<class UVoxelSubVolumeComponent*> DebrisComponents;
+
+	// Drops sand and gravel
+	FVoxelGranularSimulation Granular;
+
+	// Grows grass and ore
+	FVoxelBlockTicker BlockTicker;
+
+	// How long it's been since block ticks last ran
+	float BlockTickTime;
+
+	// Scratch space for UpdateBlockTicks
+	TArray<FVoxelBlockTickEdit> BlockTickEdits;
+
+	// Solid voxels removed by edits since ResolveEdits was last called
+	TArray<FIntVector> RemovedVoxels;
+
+	// Scratch space for ResolveEdits, UpdateDebris and UpdateGranular
+	TArray<TArray<FIntVector>> Islands;
+	TArray<FIntVector> DebrisChangedVoxels;
+	TArray<FVoxelFallingDebris::FIsland> LandedIslands;
+	TArray<FIntVector> GranularChangedVoxels;
+
+	// Loaded chunks whose voxels have changed since they were meshed
+	TSet<FIntVector> DirtyChunks;
+
+	// Loaded chunks that were meshed before some of their neighbours were generated, and which neighbours those were
+	TMap<FIntVector, uint32> ChunksMissingNeighbours;
+
+	// Scratch space for queries
+	FVoxelBatchQuery BatchQuery;
+	TArray<FIntVector> QueryCoords;
+	TArray<FVector> RaycastStarts;
+	TArray<FVector> RaycastEnds;
 };
\ No newline at end of file
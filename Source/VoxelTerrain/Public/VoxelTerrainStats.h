@@ -0,0 +1,70 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+DECLARE_STATS_GROUP(TEXT("Voxel Terrain"), STATGROUP_VoxelTerrain, STATCAT_Advanced);
+
+// Time spent paging in and generating chunks
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Generate Chunk"), STAT_VoxelGenerateChunk, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent copying chunks and their borders out of the volume for meshing. This is the only part of meshing that holds the volume's lock.
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Copy Chunk"), STAT_VoxelCopyChunk, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent meshing chunks
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Mesh Chunk"), STAT_VoxelMeshChunk, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Number of times a warmed up mesher had to grow one of its buffers. This should stay at zero during normal play.
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Steady-State Allocations"), STAT_VoxelSteadyStateAllocations, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent reordering meshes for the vertex cache, and the triangles reordered and their simulated cache misses before and after. Misses
+// divided by triangles is the ACMR.
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Optimize Vertex Cache"), STAT_VoxelOptimizeVertexCache, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Vertex Cache Triangles"), STAT_VoxelVertexCacheTriangles, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Vertex Cache Misses Before"), STAT_VoxelVertexCacheMissesBefore, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Vertex Cache Misses After"), STAT_VoxelVertexCacheMissesAfter, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent on the game thread cooking chunk collision
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Cook Chunk Collision"), STAT_VoxelCookCollision, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent on the game thread handing chunk meshes to their components
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Upload Chunk"), STAT_VoxelUploadChunk, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// The number of chunks in each pipeline stage, including ones waiting for room in the next stage
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Generate Queue Depth"), STAT_VoxelGenerateQueueDepth, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Mesh Queue Depth"), STAT_VoxelMeshQueueDepth, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Collision Queue Depth"), STAT_VoxelCollisionQueueDepth, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Upload Queue Depth"), STAT_VoxelUploadQueueDepth, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// The number of chunk jobs that were cancelled because the chunk was no longer needed
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Cancelled Jobs"), STAT_VoxelCancelledJobs, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// The number of chunk mesh sections and collision meshes that were shared with an identical one rather than stored, uploaded or cooked again
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Shared Mesh Sections"), STAT_VoxelSharedMeshSections, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Shared Collision Meshes"), STAT_VoxelSharedCollisionMeshes, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent merging the meshes of distant chunks into clusters
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Merge Cluster"), STAT_VoxelMergeCluster, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// The triangle budgets of the clusters that had to be simplified, and the triangles they ended up with. Ending up with more than the budget
+// means the simplifier ran out of edges it was allowed to collapse.
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Simplify Triangle Budget"), STAT_VoxelSimplifyTriangleBudget, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Simplified Triangles"), STAT_VoxelSimplifiedTriangles, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent tracing through voxels
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Voxel Raycast"), STAT_VoxelRaycast, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent stepping the fluid simulation, and the number of fluid cells still waiting to be stepped
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Fluid Step"), STAT_VoxelFluidStep, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Active Fluid Cells"), STAT_VoxelActiveFluidCells, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent on random block ticks, and the number of voxels that could change when they tick
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Block Ticks"), STAT_VoxelBlockTick, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Tickable Voxels"), STAT_VoxelTickableVoxels, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent collapsing sand and gravel, and the number of columns still waiting to be checked
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Granular Step"), STAT_VoxelGranularStep, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Pending Granular Columns"), STAT_VoxelPendingGranularColumns, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+
+// Time spent on occlusion culling, and the number of chunks and clusters it hid
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Occlusion Culling"), STAT_VoxelOcclusionCulling, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Occluded Chunks"), STAT_VoxelOccludedChunks, STATGROUP_VoxelTerrain, VOXELTERRAIN_API);
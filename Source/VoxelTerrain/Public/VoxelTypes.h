@@ -0,0 +1,124 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+// Polyvox Includes
+#include "PolyVox/PagedVolume.h"
+#include "PolyVox/MaterialDensityPair.h"
+
+// The volume that stores our terrain voxels
+typedef PolyVox::PagedVolume<PolyVox::MaterialDensityPair44> FVoxelVolume;
+
+// Side length of a terrain chunk in voxels.
+// Our PagedVolume uses the same chunk size, so this must be a power of two.
+const int32 VOXEL_CHUNK_SIZE = 32;
+
+// The size of a voxel in Unreal units
+const float VOXEL_SIZE = 100.f;
+
+// log2 of VOXEL_CHUNK_SIZE, for turning voxel coordinates into chunk coordinates
+const int32 VOXEL_CHUNK_SHIFT = 5;
+static_assert((1 << VOXEL_CHUNK_SHIFT) == VOXEL_CHUNK_SIZE, "VOXEL_CHUNK_SHIFT doesn't match VOXEL_CHUNK_SIZE");
+
+// The number of voxels in a chunk
+const int32 VOXEL_CHUNK_VOLUME = VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE;
+
+// Returns the region of the volume covered by a chunk
+inline PolyVox::Region GetVoxelChunkRegion(const FIntVector& ChunkCoords)
+{
+	const PolyVox::Vector3DInt32 Lower(ChunkCoords.X * VOXEL_CHUNK_SIZE, ChunkCoords.Y * VOXEL_CHUNK_SIZE, ChunkCoords.Z * VOXEL_CHUNK_SIZE);
+	return PolyVox::Region(Lower, Lower + PolyVox::Vector3DInt32(VOXEL_CHUNK_SIZE - 1, VOXEL_CHUNK_SIZE - 1, VOXEL_CHUNK_SIZE - 1));
+}
+
+// Returns where a chunk's component goes in the terrain's space. Chunk meshes are built relative to this, so that vertex positions stay small
+// however far the chunk is from the origin.
+inline FVector GetVoxelChunkOrigin(const FIntVector& ChunkCoords)
+{
+	return FVector(ChunkCoords.X, ChunkCoords.Y, ChunkCoords.Z) * (VOXEL_CHUNK_SIZE * VOXEL_SIZE);
+}
+
+// Returns the chunk that contains a voxel. The shift rounds down, so negative coordinates end up in the right chunk.
+inline FIntVector GetVoxelChunkCoords(int32 X, int32 Y, int32 Z)
+{
+	return FIntVector(X >> VOXEL_CHUNK_SHIFT, Y >> VOXEL_CHUNK_SHIFT, Z >> VOXEL_CHUNK_SHIFT);
+}
+
+// Materials with special behaviour. The generator fills the ground with stone (1), dirt (2), grass (3) and ore (4); fluids, sand, gravel,
+// glass and leaves are only ever added at runtime.
+const uint8 VOXEL_MATERIAL_AIR = 0;
+const uint8 VOXEL_MATERIAL_STONE = 1;
+const uint8 VOXEL_MATERIAL_DIRT = 2;
+const uint8 VOXEL_MATERIAL_GRASS = 3;
+const uint8 VOXEL_MATERIAL_ORE = 4;
+const uint8 VOXEL_MATERIAL_WATER = 5;
+const uint8 VOXEL_MATERIAL_LAVA = 6;
+const uint8 VOXEL_MATERIAL_SAND = 7;
+const uint8 VOXEL_MATERIAL_GRAVEL = 8;
+const uint8 VOXEL_MATERIAL_GLASS = 9;
+const uint8 VOXEL_MATERIAL_LEAVES = 10;
+
+// How a voxel material is drawn, which decides which faces between voxels get meshed. The terrain material assigned to it should use the
+// matching blend mode: opaque, masked or translucent.
+enum class EVoxelMaterialClass : uint8
+{
+	// Hides whatever is behind it, so faces against it are never meshed
+	Opaque,
+
+	// Alpha tested, like leaves. Faces behind it can show through the holes.
+	Cutout,
+
+	// Blended over what's behind it, like glass and water
+	Translucent
+};
+
+// Returns the class of a voxel material. Air doesn't have one and is treated as translucent.
+inline EVoxelMaterialClass GetVoxelMaterialClass(uint8 Material)
+{
+	switch (Material)
+	{
+	case VOXEL_MATERIAL_AIR:
+	case VOXEL_MATERIAL_WATER:
+	case VOXEL_MATERIAL_GLASS:
+		return EVoxelMaterialClass::Translucent;
+
+	case VOXEL_MATERIAL_LEAVES:
+		return EVoxelMaterialClass::Cutout;
+
+	default:
+		return EVoxelMaterialClass::Opaque;
+	}
+}
+
+// Whether a voxel material hides everything behind it
+inline bool IsVoxelMaterialOpaque(uint8 Material)
+{
+	return GetVoxelMaterialClass(Material) == EVoxelMaterialClass::Opaque;
+}
+
+// Whether a voxel material is a fluid, which is drawn but can be moved through
+inline bool IsVoxelMaterialFluid(uint8 Material)
+{
+	return Material == VOXEL_MATERIAL_WATER || Material == VOXEL_MATERIAL_LAVA;
+}
+
+// Fluid voxels keep how full they are in their density, from 1 up to this
+const uint8 VOXEL_FLUID_MAX_LEVEL = 15;
+
+// Adds the chunks whose meshes depend on a voxel to OutChunks. That's the voxel's own chunk, plus the next chunk along any axis where the voxel
+// is on the upper boundary, since chunks draw the faces between themselves and the chunk before them.
+inline void AddChunksMeshingVoxel(const FIntVector& VoxelCoords, TSet<FIntVector>& OutChunks)
+{
+	const FIntVector ChunkCoords = GetVoxelChunkCoords(VoxelCoords.X, VoxelCoords.Y, VoxelCoords.Z);
+	OutChunks.Add(ChunkCoords);
+
+	const int32 Last = VOXEL_CHUNK_SIZE - 1;
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		if ((VoxelCoords[Axis] & Last) == Last)
+		{
+			FIntVector NextChunk = ChunkCoords;
+			NextChunk[Axis]++;
+			OutChunks.Add(NextChunk);
+		}
+	}
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2016 Brandon Garvin
+
+#pragma once
+
+#include "VoxelMeshBuffers.h"
+
+// Reorders a mesh so that the GPU's post-transform vertex cache gets more hits, which means fewer vertex shader invocations per triangle.
+// Vertices that are exactly the same are welded first, since the mesher gives each quad its own four corners and a quad's neighbours in the same
+// plane often share them. Triangles are then put in the order picked by Tom Forsyth's linear-speed vertex cache optimisation, and vertices in
+// the order the triangles first use them.
+// Effectiveness is measured as the average cache miss ratio (ACMR): vertex shader invocations per triangle on a FIFO cache, where 0.5 is ideal
+// and 3 is no reuse at all. An optimizer owns all of its scratch space and reuses it for every mesh, so keep one around instead of creating one
+// per mesh.
+class VOXELTERRAIN_API FVoxelVertexCacheOptimizer
+{
+public:
+	// The size of the FIFO cache ACMR is measured with, which is about what current GPUs have
+	static const int32 MeasuredCacheSize = 16;
+
+	// Optimizes a section in place. The result draws exactly the same triangles.
+	void Optimize(FVoxelMeshBuffers& Buffers);
+
+	// Returns the ACMR of a triangle list on a FIFO cache of MeasuredCacheSize vertices
+	static float GetACMR(const TArray<int32>& Indices, int32 NumVertices);
+
+	// The ACMR across every mesh this optimizer has been given, before and after optimizing them
+	float GetACMRBefore() const { return TotalTriangles > 0 ? float(TotalMissesBefore) / TotalTriangles : 0.f; }
+	float GetACMRAfter() const { return TotalTriangles > 0 ? float(TotalMissesAfter) / TotalTriangles : 0.f; }
+
+private:
+	// Returns the number of vertex cache misses of a triangle list on a FIFO cache of MeasuredCacheSize vertices
+	static int32 CountCacheMisses(const TArray<int32>& Indices, int32 NumVertices, TArray<int32>& Scratch);
+
+	// Welds identical vertices, rewriting Indices to use the first of each
+	void WeldVertices(const FVoxelMeshBuffers& Buffers);
+
+	// Puts the triangles in Indices in an order that reuses cached vertices, writing them to OrderedIndices
+	void OrderTriangles(int32 NumVertices);
+
+	// Forsyth's score for a vertex, from its position in the simulated LRU cache and how many triangles still need it
+	static float GetVertexScore(int32 CachePosition, int32 NumActiveTriangles);
+
+	// Triangles, as indices into the welded vertices, before and after ordering
+	TArray<int32> Indices;
+	TArray<int32> OrderedIndices;
+
+	// The welded vertex each original vertex became, and the original vertex each welded one came from
+	TArray<int32> WeldedVertices;
+	TArray<int32> WeldSources;
+	TMultiMap<uint32, int32> WeldTable;
+
+	// Per vertex state for ordering: the triangles that use it, split into those still to be drawn and the rest
+	TArray<int32> VertexTriangleStarts;
+	TArray<int32> VertexTriangles;
+	TArray<int32> ActiveTriangleCounts;
+	TArray<int32> CachePositions;
+	TArray<float> VertexScores;
+
+	// Per triangle state for ordering
+	TArray<float> TriangleScores;
+	TArray<bool> AddedTriangles;
+
+	// Where each welded vertex ends up once vertices are in the order they're first used
+	TArray<int32> FinalVertices;
+
+	// The optimized mesh is built here, then swapped with the one being optimized
+	FVoxelMeshBuffers Output;
+
+	// Running totals for the ACMR
+	uint64 TotalTriangles = 0;
+	uint64 TotalMissesBefore = 0;
+	uint64 TotalMissesAfter = 0;
+};
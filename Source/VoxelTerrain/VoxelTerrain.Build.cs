@@ -15,7 +15,7 @@ public class VoxelTerrain : ModuleRules
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "ProceduralMeshComponent" });
 
 
-        PrivateDependencyModuleNames.AddRange(new string[] {  });
+        PrivateDependencyModuleNames.AddRange(new string[] { "RenderCore", "ShaderCore", "RHI" });
 
         ////////////////////// Custom Voxel Terrain Stuff Starts Here //////////////////////////////////////
         // You will need to compile and add additional libraries if you want to use this on platforms not listed below!
@@ -1,5 +1,38 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "VoxelTerrain.h"
+#include "VoxelTerrainStats.h"
 
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, VoxelTerrain, "VoxelTerrain" );
+
+DEFINE_LOG_CATEGORY(LogVoxelTerrain);
+
+DEFINE_STAT(STAT_VoxelGenerateChunk);
+DEFINE_STAT(STAT_VoxelCopyChunk);
+DEFINE_STAT(STAT_VoxelMeshChunk);
+DEFINE_STAT(STAT_VoxelSteadyStateAllocations);
+DEFINE_STAT(STAT_VoxelOptimizeVertexCache);
+DEFINE_STAT(STAT_VoxelVertexCacheTriangles);
+DEFINE_STAT(STAT_VoxelVertexCacheMissesBefore);
+DEFINE_STAT(STAT_VoxelVertexCacheMissesAfter);
+DEFINE_STAT(STAT_VoxelCookCollision);
+DEFINE_STAT(STAT_VoxelUploadChunk);
+DEFINE_STAT(STAT_VoxelGenerateQueueDepth);
+DEFINE_STAT(STAT_VoxelMeshQueueDepth);
+DEFINE_STAT(STAT_VoxelCollisionQueueDepth);
+DEFINE_STAT(STAT_VoxelUploadQueueDepth);
+DEFINE_STAT(STAT_VoxelCancelledJobs);
+DEFINE_STAT(STAT_VoxelSharedMeshSections);
+DEFINE_STAT(STAT_VoxelSharedCollisionMeshes);
+DEFINE_STAT(STAT_VoxelMergeCluster);
+DEFINE_STAT(STAT_VoxelSimplifyTriangleBudget);
+DEFINE_STAT(STAT_VoxelSimplifiedTriangles);
+DEFINE_STAT(STAT_VoxelRaycast);
+DEFINE_STAT(STAT_VoxelFluidStep);
+DEFINE_STAT(STAT_VoxelActiveFluidCells);
+DEFINE_STAT(STAT_VoxelBlockTick);
+DEFINE_STAT(STAT_VoxelTickableVoxels);
+DEFINE_STAT(STAT_VoxelGranularStep);
+DEFINE_STAT(STAT_VoxelPendingGranularColumns);
+DEFINE_STAT(STAT_VoxelOcclusionCulling);
+DEFINE_STAT(STAT_VoxelOccludedChunks);